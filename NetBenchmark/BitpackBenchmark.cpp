@@ -0,0 +1,230 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <msg_net.h>
+
+// Wire size and speed of a state message of the usual shape, a batch of entities with a position, a velocity, an orientation,
+// a health and a few flags. The plain message pushes every entity as a struct with operator <<, a memcpy of floats and bytes.
+// The packed message goes through the bit_writer of net_bitpack.h: positions over a 4 km world to the centimeter, velocities
+// up to 50 m/s to the centimeter per second, the orientation as the three smallest components of its quaternion and the
+// health and flags in the bits they need. The table gives the bytes per entity, the nanoseconds per entity to encode and to
+// decode, and the largest error the quantization left on each field:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/BitpackBenchmark.cpp -pthread -o bench_bitpack
+//
+// Usage: BitpackBenchmark [entities per message] [messages]
+
+enum class BitpackMsgTypes : uint32_t
+{
+	WorldState,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<BitpackMsgTypes>;
+
+struct entity_state
+{
+	uint32_t nId;
+	float x, y, z;
+	float vx, vy, vz;
+	float qx, qy, qz, qw;
+	int32_t nHealth;
+	bool bAlive, bCrouched, bFiring;
+};
+
+// The ranges of the packed message, built once
+static const netmsg::net::int_range rangeId(0, 65535);
+static const netmsg::net::float_range rangePosition(-2000.0f, 2000.0f, 0.01f);
+static const netmsg::net::float_range rangeHeight(-100.0f, 500.0f, 0.01f);
+static const netmsg::net::float_range rangeVelocity(-50.0f, 50.0f, 0.01f);
+static const netmsg::net::int_range rangeHealth(0, 100);
+
+static void EncodePlain(const std::vector<entity_state>& vStates, bench_message& msg)
+{
+	for (const auto& s : vStates)
+	{
+		msg << s;
+	}
+	msg << uint32_t(vStates.size());
+}
+
+static void DecodePlain(bench_message& msg, std::vector<entity_state>& vStates)
+{
+	uint32_t nCount = 0;
+	msg >> nCount;
+	vStates.resize(nCount);
+	// The last entity pushed is the first one popped
+	for (uint32_t i = nCount; i-- > 0;)
+	{
+		msg >> vStates[i];
+	}
+}
+
+static void EncodePacked(const std::vector<entity_state>& vStates, netmsg::net::bit_writer& writer, bench_message& msg)
+{
+	writer.Clear();
+	writer.WriteInt(int64_t(vStates.size()), rangeId);
+	for (const auto& s : vStates)
+	{
+		writer.WriteInt(s.nId, rangeId);
+		writer.WriteFloat(s.x, rangePosition);
+		writer.WriteFloat(s.y, rangeHeight);
+		writer.WriteFloat(s.z, rangePosition);
+		writer.WriteFloat(s.vx, rangeVelocity);
+		writer.WriteFloat(s.vy, rangeVelocity);
+		writer.WriteFloat(s.vz, rangeVelocity);
+		writer.WriteQuaternion(s.qx, s.qy, s.qz, s.qw);
+		writer.WriteInt(s.nHealth, rangeHealth);
+		writer.WriteBool(s.bAlive);
+		writer.WriteBool(s.bCrouched);
+		writer.WriteBool(s.bFiring);
+	}
+	writer.PushTo(msg);
+}
+
+static bool DecodePacked(bench_message& msg, netmsg::net::bit_reader& reader, std::vector<entity_state>& vStates)
+{
+	if (!reader.PopFrom(msg))
+	{
+		return false;
+	}
+	vStates.resize(size_t(reader.ReadInt(rangeId)));
+	for (auto& s : vStates)
+	{
+		s.nId = uint32_t(reader.ReadInt(rangeId));
+		s.x = reader.ReadFloat(rangePosition);
+		s.y = reader.ReadFloat(rangeHeight);
+		s.z = reader.ReadFloat(rangePosition);
+		s.vx = reader.ReadFloat(rangeVelocity);
+		s.vy = reader.ReadFloat(rangeVelocity);
+		s.vz = reader.ReadFloat(rangeVelocity);
+		reader.ReadQuaternion(s.qx, s.qy, s.qz, s.qw);
+		s.nHealth = int32_t(reader.ReadInt(rangeHealth));
+		s.bAlive = reader.ReadBool();
+		s.bCrouched = reader.ReadBool();
+		s.bFiring = reader.ReadBool();
+	}
+	return reader.Ok();
+}
+
+struct run_result
+{
+	double dBytesPerEntity = 0.0;
+	double dEncodeNs = 0.0;
+	double dDecodeNs = 0.0;
+	double dPositionError = 0.0;
+	double dVelocityError = 0.0;
+	double dAngleError = 0.0;
+	bool bExact = true;
+};
+
+// Largest differences between what was sent and what came out, the angle between the two orientations in degrees
+static void Compare(const std::vector<entity_state>& vSent, const std::vector<entity_state>& vGot, run_result& r)
+{
+	for (size_t i = 0; i < vSent.size(); i++)
+	{
+		const entity_state& a = vSent[i];
+		const entity_state& b = vGot[i];
+		r.dPositionError = std::max({ r.dPositionError, double(std::abs(a.x - b.x)), double(std::abs(a.y - b.y)), double(std::abs(a.z - b.z)) });
+		r.dVelocityError = std::max({ r.dVelocityError, double(std::abs(a.vx - b.vx)), double(std::abs(a.vy - b.vy)), double(std::abs(a.vz - b.vz)) });
+		// From the chord between the two unit quaternions, acos of their dot product is too coarse near 1
+		double dSign = double(a.qx) * b.qx + double(a.qy) * b.qy + double(a.qz) * b.qz + double(a.qw) * b.qw < 0.0 ? -1.0 : 1.0;
+		double dx = a.qx - dSign * b.qx, dy = a.qy - dSign * b.qy, dz = a.qz - dSign * b.qz, dw = a.qw - dSign * b.qw;
+		double dChord = std::min(2.0, std::sqrt(dx * dx + dy * dy + dz * dz + dw * dw));
+		r.dAngleError = std::max(r.dAngleError, 4.0 * std::asin(dChord / 2.0) * 180.0 / 3.14159265358979);
+		r.bExact = r.bExact && a.nId == b.nId && a.nHealth == b.nHealth && a.bAlive == b.bAlive && a.bCrouched == b.bCrouched && a.bFiring == b.bFiring;
+	}
+}
+
+template <typename FEncode, typename FDecode>
+static run_result Run(const std::vector<entity_state>& vStates, size_t nMessages, FEncode&& fnEncode, FDecode&& fnDecode)
+{
+	run_result r;
+	bench_message msg;
+	std::vector<entity_state> vGot;
+	vGot.reserve(vStates.size());
+
+	double dEncode = 0.0, dDecode = 0.0;
+	for (size_t m = 0; m < nMessages; m++)
+	{
+		msg.body.clear();
+		msg.header.id = BitpackMsgTypes::WorldState;
+		auto t0 = bench_clock::now();
+		fnEncode(vStates, msg);
+		auto t1 = bench_clock::now();
+		r.dBytesPerEntity = double(msg.body.size()) / double(vStates.size());
+		fnDecode(msg, vGot);
+		auto t2 = bench_clock::now();
+		dEncode += std::chrono::duration<double, std::nano>(t1 - t0).count();
+		dDecode += std::chrono::duration<double, std::nano>(t2 - t1).count();
+	}
+
+	r.dEncodeNs = dEncode / double(nMessages * vStates.size());
+	r.dDecodeNs = dDecode / double(nMessages * vStates.size());
+	Compare(vStates, vGot, r);
+	return r;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nEntities = argc > 1 ? std::stoul(argv[1]) : 1000;
+	size_t nMessages = argc > 2 ? std::stoul(argv[2]) : 2000;
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> distPos(-2000.0f, 2000.0f);
+	std::uniform_real_distribution<float> distHeight(-100.0f, 500.0f);
+	std::uniform_real_distribution<float> distVel(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> distUnit(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> distHealth(0, 100);
+	std::uniform_int_distribution<int> distFlag(0, 1);
+
+	std::vector<entity_state> vStates(nEntities);
+	for (size_t i = 0; i < nEntities; i++)
+	{
+		entity_state& s = vStates[i];
+		s.nId = uint32_t(i);
+		s.x = distPos(rng);
+		s.y = distHeight(rng);
+		s.z = distPos(rng);
+		s.vx = distVel(rng);
+		s.vy = distVel(rng);
+		s.vz = distVel(rng);
+		float q[4] = { distUnit(rng), distUnit(rng), distUnit(rng), distUnit(rng) };
+		float fLength = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		s.qx = q[0] / fLength;
+		s.qy = q[1] / fLength;
+		s.qz = q[2] / fLength;
+		s.qw = q[3] / fLength;
+		s.nHealth = distHealth(rng);
+		s.bAlive = distFlag(rng) != 0;
+		s.bCrouched = distFlag(rng) != 0;
+		s.bFiring = distFlag(rng) != 0;
+	}
+
+	netmsg::net::bit_writer writer(nEntities * 32);
+	netmsg::net::bit_reader reader;
+
+	run_result plain = Run(vStates, nMessages, EncodePlain, DecodePlain);
+	run_result packed = Run(vStates, nMessages,
+		[&writer](const std::vector<entity_state>& v, bench_message& msg) { EncodePacked(v, writer, msg); },
+		[&reader](bench_message& msg, std::vector<entity_state>& v) { DecodePacked(msg, reader, v); });
+
+	std::cout << nEntities << " entities per message, " << nMessages << " messages, " << sizeof(entity_state) << " bytes per entity_state\n";
+	std::cout << std::left << std::setw(10) << "format" << std::setw(14) << "bytes/entity" << std::setw(12) << "ratio"
+		<< std::setw(14) << "encode ns" << std::setw(14) << "decode ns" << std::setw(14) << "max pos m" << std::setw(14) << "max vel m/s"
+		<< std::setw(14) << "max angle" << "exact fields\n";
+
+	auto fnPrint = [&plain](const char* sName, const run_result& r)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(10) << sName << std::setw(14) << r.dBytesPerEntity
+			<< std::setw(12) << plain.dBytesPerEntity / r.dBytesPerEntity << std::setw(14) << r.dEncodeNs << std::setw(14) << r.dDecodeNs
+			<< std::setprecision(4) << std::setw(14) << r.dPositionError << std::setw(14) << r.dVelocityError << std::setw(14) << r.dAngleError
+			<< (r.bExact ? "yes" : "NO") << "\n";
+	};
+
+	fnPrint("plain", plain);
+	fnPrint("packed", packed);
+	return 0;
+}
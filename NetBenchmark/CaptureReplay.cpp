@@ -0,0 +1,196 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <msg_net.h>
+
+// Capture and replay harness. A server records what its clients send with server_options::sCaptureFile, and the capture is
+// then fed back into the handlers of the server with ReplayCapture, either at its original pace or as fast as possible, to
+// measure a change of the handlers against the same traffic every time:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/CaptureReplay.cpp -pthread -o capture_replay
+//
+// Usage: CaptureReplay record <file> [clients] [seconds] [port]
+//        CaptureReplay replay <file> [original|fast] [rounds]
+//
+// The record mode drives the server with a synthetic mix of clients, a real server records its own traffic by setting the
+// capture file in its options, the replay side stays the same
+
+enum class ReplayMsgTypes : uint32_t
+{
+	ServerAccept,
+	Ping,
+	Chat,
+	MessageAll,
+};
+
+class ReplayServer : public netmsg::net::server_interface<ReplayMsgTypes>
+{
+public:
+	ReplayServer(uint16_t nPort, const netmsg::net::server_options& options) : netmsg::net::server_interface<ReplayMsgTypes>(nPort, options)
+	{
+
+	}
+
+	void Wake()
+	{
+		m_qMessagesIn.push_back({ {}, {} });
+	}
+
+	uint64_t nChecksum = 0;
+
+protected:
+	bool OnClientConnect(std::shared_ptr<netmsg::net::connection<ReplayMsgTypes>>) override
+	{
+		return true;
+	}
+
+	void OnClientValidated(std::shared_ptr<netmsg::net::connection<ReplayMsgTypes>> client) override
+	{
+		netmsg::net::message<ReplayMsgTypes> msg;
+		msg.header.id = ReplayMsgTypes::ServerAccept;
+		client->Send(msg);
+	}
+
+	// The handlers under test, they do a little bit of work on every body so a change to them shows in the replay numbers
+	void OnMessage(std::shared_ptr<netmsg::net::connection<ReplayMsgTypes>> client, netmsg::net::message<ReplayMsgTypes>& msg) override
+	{
+		if (!client)
+		{
+			return;
+		}
+
+		for (uint8_t b : msg.body)
+		{
+			nChecksum = nChecksum * 31 + b;
+		}
+
+		switch (msg.header.id)
+		{
+		case ReplayMsgTypes::Ping:
+			client->Send(msg);
+			break;
+		case ReplayMsgTypes::MessageAll:
+			MessageAllClients(msg, client);
+			break;
+		default:
+			break;
+		}
+	}
+};
+
+static int Record(const std::string& sFile, size_t nClients, size_t nSeconds, uint16_t nPort)
+{
+	netmsg::net::server_options options;
+	options.sCaptureFile = sFile;
+	options.bLogConnections = false;
+	options.socket.bNoDelay = true;
+	ReplayServer server(nPort, options);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]()
+		{
+			while (bRunning)
+			{
+				server.Update(-1, true);
+			}
+		});
+
+	// Every client sends a burst now and then, mostly small pings and chat lines with the odd broadcast, at its own pace
+	std::vector<std::thread> vClients;
+	for (size_t c = 0; c < nClients; c++)
+	{
+		vClients.emplace_back([&, c]()
+			{
+				netmsg::net::client_interface<ReplayMsgTypes> client;
+				client.Connect("127.0.0.1", nPort);
+				// Nothing can be sent before the handshake is over, the accept message tells us it is
+				client.Incoming().wait();
+				client.Incoming().clear();
+				std::mt19937 rng{ uint32_t(c) };
+				std::uniform_int_distribution<int> distKind(0, 99);
+				std::uniform_int_distribution<size_t> distSize(0, 512);
+				std::uniform_int_distribution<int> distPause(1, 50);
+
+				while (bRunning)
+				{
+					netmsg::net::message<ReplayMsgTypes> msg;
+					int nKind = distKind(rng);
+					msg.header.id = nKind < 60 ? ReplayMsgTypes::Ping : nKind < 97 ? ReplayMsgTypes::Chat : ReplayMsgTypes::MessageAll;
+					msg.body.resize(distSize(rng));
+					for (auto& b : msg.body)
+					{
+						b = uint8_t(rng());
+					}
+					msg.header.size = uint32_t(msg.body.size());
+					client.Send(msg);
+					client.Incoming().clear();
+					std::this_thread::sleep_for(std::chrono::milliseconds(distPause(rng)));
+				}
+				client.Disconnect();
+			});
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(nSeconds));
+	bRunning = false;
+	for (auto& t : vClients)
+	{
+		t.join();
+	}
+	server.Wake();
+	thrUpdate.join();
+	server.Stop();
+	return 0;
+}
+
+static int Replay(const std::string& sFile, netmsg::net::replay_speed speed, size_t nRounds)
+{
+	netmsg::net::server_options options;
+	options.bLogConnections = false;
+	// Port 0, the replay server is never started and does not need a known port
+	ReplayServer server(0, options);
+
+	std::cout << std::left << std::setw(8) << "round" << std::setw(12) << "messages" << std::setw(12) << "seconds"
+		<< std::setw(14) << "msg/s" << "handler ns/msg\n";
+	for (size_t r = 0; r < nRounds; r++)
+	{
+		netmsg::net::replay_stats stats = server.ReplayCapture(sFile, speed);
+		std::cout << std::left << std::fixed << std::setprecision(3) << std::setw(8) << r << std::setw(12) << stats.nMessages
+			<< std::setw(12) << stats.dSeconds << std::setw(14) << std::setprecision(0) << double(stats.nMessages) / stats.dSeconds
+			<< std::setprecision(1) << stats.dHandlerSeconds * 1e9 / double(std::max<size_t>(1, stats.nMessages)) << "\n";
+	}
+	std::cout << "checksum " << server.nChecksum << "\n";
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string sMode = argc > 1 ? argv[1] : "";
+	if (argc < 3 || (sMode != "record" && sMode != "replay"))
+	{
+		std::cerr << "Usage: CaptureReplay record <file> [clients] [seconds] [port]\n"
+			<< "       CaptureReplay replay <file> [original|fast] [rounds]\n";
+		return 1;
+	}
+
+	try
+	{
+		if (sMode == "record")
+		{
+			size_t nClients = argc > 3 ? std::stoul(argv[3]) : 32;
+			size_t nSeconds = argc > 4 ? std::stoul(argv[4]) : 5;
+			uint16_t nPort = argc > 5 ? uint16_t(std::stoul(argv[5])) : 60200;
+			return Record(argv[2], nClients, nSeconds, nPort);
+		}
+
+		netmsg::net::replay_speed speed = (argc > 3 && std::string(argv[3]) == "original") ?
+			netmsg::net::replay_speed::Original : netmsg::net::replay_speed::AsFastAsPossible;
+		size_t nRounds = argc > 4 ? std::stoul(argv[4]) : 3;
+		return Replay(argv[2], speed, nRounds);
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+}
@@ -0,0 +1,201 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <msg_net.h>
+
+// One game tick over a large world: every entity is moved by its velocity, the ones that moved far enough from what the
+// clients know are flagged, and the flagged ones are written into replication messages ready to be shared with every client.
+// The entity_store of the framework (a structure of arrays with SSE2 kernels) is run against the usual array of entity structs
+// doing the same work one entity at a time, and both write the same messages:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/EntityBenchmark.cpp -pthread -o bench_entities
+//
+// Usage: EntityBenchmark [entities] [ticks] [moving percent]
+
+enum class EntityMsgTypes : uint32_t
+{
+	WorldUpdate,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<EntityMsgTypes>;
+
+constexpr float fTickDelta = 1.0f / 60.0f;
+constexpr float fThreshold = 0.01f;
+constexpr size_t nChangesPerMessage = 4096;
+
+struct health
+{
+	int32_t nHealth = 100;
+};
+
+// The layout the store replaces, one struct per entity with everything in it
+struct aos_entity
+{
+	netmsg::net::entity_id id;
+	float x, y, z;
+	float vx, vy, vz;
+	float sx, sy, sz;
+	int32_t nHealth;
+	bool bDirty;
+};
+
+struct tick_times
+{
+	double dIntegrateMs = 0.0;
+	double dDirtyMs = 0.0;
+	double dWriteMs = 0.0;
+	size_t nChanges = 0;
+	size_t nMessages = 0;
+	size_t nBytes = 0;
+};
+
+static double Milliseconds(bench_clock::time_point tStart, bench_clock::time_point tEnd)
+{
+	return std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+}
+
+// Stands in for MessageAllClients, the messages are shared and only their size is looked at
+static void Publish(netmsg::net::shared_message<EntityMsgTypes> msg, tick_times& t)
+{
+	t.nMessages++;
+	t.nBytes += msg->body.size();
+}
+
+static tick_times TickStore(netmsg::net::entity_store<health>& store)
+{
+	tick_times t;
+	auto t0 = bench_clock::now();
+	store.Integrate(fTickDelta);
+	auto t1 = bench_clock::now();
+	t.nChanges = store.ComputeDirty(fThreshold);
+	auto t2 = bench_clock::now();
+	for (size_t nNext = 0; nNext < store.Size();)
+	{
+		netmsg::net::message_builder<EntityMsgTypes> builder(EntityMsgTypes::WorldUpdate, nChangesPerMessage * sizeof(netmsg::net::entity_change) + sizeof(uint32_t));
+		nNext = store.WriteChanges(builder.Message(), nChangesPerMessage, nNext);
+		Publish(std::move(builder), t);
+	}
+	auto t3 = bench_clock::now();
+	t.dIntegrateMs = Milliseconds(t0, t1);
+	t.dDirtyMs = Milliseconds(t1, t2);
+	t.dWriteMs = Milliseconds(t2, t3);
+	return t;
+}
+
+static tick_times TickStructs(std::vector<aos_entity>& vEntities)
+{
+	tick_times t;
+	auto t0 = bench_clock::now();
+	for (auto& e : vEntities)
+	{
+		e.x += e.vx * fTickDelta;
+		e.y += e.vy * fTickDelta;
+		e.z += e.vz * fTickDelta;
+	}
+	auto t1 = bench_clock::now();
+	for (auto& e : vEntities)
+	{
+		float dx = e.x - e.sx;
+		float dy = e.y - e.sy;
+		float dz = e.z - e.sz;
+		e.bDirty = e.bDirty || dx * dx + dy * dy + dz * dz > fThreshold * fThreshold;
+		t.nChanges += e.bDirty;
+	}
+	auto t2 = bench_clock::now();
+	for (size_t nNext = 0; nNext < vEntities.size();)
+	{
+		netmsg::net::message_builder<EntityMsgTypes> builder(EntityMsgTypes::WorldUpdate, nChangesPerMessage * sizeof(netmsg::net::entity_change) + sizeof(uint32_t));
+		uint32_t nCount = 0;
+		for (; nNext < vEntities.size() && nCount < nChangesPerMessage; nNext++)
+		{
+			aos_entity& e = vEntities[nNext];
+			if (e.bDirty)
+			{
+				builder << netmsg::net::entity_change{ e.id, e.x, e.y, e.z };
+				e.sx = e.x;
+				e.sy = e.y;
+				e.sz = e.z;
+				e.bDirty = false;
+				nCount++;
+			}
+		}
+		builder << nCount;
+		Publish(std::move(builder), t);
+	}
+	auto t3 = bench_clock::now();
+	t.dIntegrateMs = Milliseconds(t0, t1);
+	t.dDirtyMs = Milliseconds(t1, t2);
+	t.dWriteMs = Milliseconds(t2, t3);
+	return t;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nEntities = argc > 1 ? std::stoul(argv[1]) : 100000;
+	size_t nTicks = argc > 2 ? std::stoul(argv[2]) : 60;
+	int nMovingPercent = argc > 3 ? std::stoi(argv[3]) : 30;
+
+	// Most of a world stands still at any one time, the moving part walks at a few meters per second
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> distPos(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> distVel(-5.0f, 5.0f);
+	std::uniform_int_distribution<int> distMoving(0, 99);
+
+	netmsg::net::entity_store<health> store(nEntities);
+	std::vector<aos_entity> vEntities;
+	vEntities.reserve(nEntities);
+	for (size_t i = 0; i < nEntities; i++)
+	{
+		float x = distPos(rng), y = distPos(rng), z = distPos(rng);
+		bool bMoving = distMoving(rng) < nMovingPercent;
+		float vx = bMoving ? distVel(rng) : 0.0f, vy = bMoving ? distVel(rng) : 0.0f, vz = bMoving ? distVel(rng) : 0.0f;
+
+		auto id = store.Create(x, y, z);
+		store.SetVelocity(id, vx, vy, vz);
+		vEntities.push_back({ id, x, y, z, vx, vy, vz, x, y, z, 100, true });
+	}
+
+	// The first tick sends the whole world, it is left out of the averages
+	TickStore(store);
+	TickStructs(vEntities);
+
+	auto fnAverage = [nTicks](auto&& fnTick)
+	{
+		tick_times total;
+		for (size_t t = 0; t < nTicks; t++)
+		{
+			tick_times tick = fnTick();
+			total.dIntegrateMs += tick.dIntegrateMs / double(nTicks);
+			total.dDirtyMs += tick.dDirtyMs / double(nTicks);
+			total.dWriteMs += tick.dWriteMs / double(nTicks);
+			total.nChanges += tick.nChanges;
+			total.nMessages += tick.nMessages;
+			total.nBytes += tick.nBytes;
+		}
+		total.nChanges /= nTicks;
+		total.nMessages /= nTicks;
+		total.nBytes /= nTicks;
+		return total;
+	};
+
+	std::cout << nEntities << " entities, " << nMovingPercent << "% moving, " << nTicks << " ticks"
+#if defined(NETMSG_ENTITY_SSE2)
+		<< " (SSE2)"
+#endif
+		<< "\n";
+	std::cout << std::left << std::setw(16) << "layout" << std::setw(14) << "integrate ms" << std::setw(12) << "dirty ms"
+		<< std::setw(12) << "write ms" << std::setw(12) << "tick ms" << std::setw(12) << "changes" << "messages\n";
+
+	auto fnPrint = [](const char* sName, const tick_times& t)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(3) << std::setw(16) << sName << std::setw(14) << t.dIntegrateMs
+			<< std::setw(12) << t.dDirtyMs << std::setw(12) << t.dWriteMs << std::setw(12) << t.dIntegrateMs + t.dDirtyMs + t.dWriteMs
+			<< std::setw(12) << t.nChanges << t.nMessages << " (" << t.nBytes / 1024 << " KiB)\n";
+	};
+
+	fnPrint("entity_store", fnAverage([&]() { return TickStore(store); }));
+	fnPrint("struct array", fnAverage([&]() { return TickStructs(vEntities); }));
+	return 0;
+}
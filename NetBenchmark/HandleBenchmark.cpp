@@ -0,0 +1,172 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <msg_net.h>
+
+// Cost of carrying the sender along with every inbound message, a shared pointer of the connection (what owned_message used
+// to hold) against a connection_handle resolved by the consumer. Several producer threads stand in for the I/O threads: each
+// one keeps touching the reference count of its connections the way the completion handlers of a connection do, and pushes
+// the messages into an incoming queue. The consumers stand in for Update, one per queue, the way every shard of a sharded
+// server drains its own queue on its own thread; the producers are spread over them. Only the producers write the control
+// blocks in the handle case, in the shared pointer case the consumers write them too when each message goes away:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/HandleBenchmark.cpp -pthread -o bench_handles
+//
+// Usage: HandleBenchmark [messages per producer] [producers] [connections per producer] [rounds] [consumers]
+
+enum class HandleMsgTypes : uint32_t
+{
+	Move,
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+struct bench_connection
+{
+	uint32_t nID = 0;
+};
+
+// The inbound message as it was before the handles
+struct shared_owned_message
+{
+	std::shared_ptr<bench_connection> remote;
+	netmsg::net::message<HandleMsgTypes> msg;
+};
+
+struct bench_setup
+{
+	size_t nMessages = 0;
+	size_t nProducers = 0;
+	size_t nConnections = 0;
+	size_t nConsumers = 0;
+};
+
+// Runs the producers against the consumers and returns the nanoseconds per message, from the start of the producers to the
+// last message handled by any consumer. Producer p feeds the queue of consumer p % nConsumers
+template <typename Item, typename Wrap, typename Resolve>
+static double Run(const bench_setup& setup, const std::vector<std::vector<std::shared_ptr<bench_connection>>>& vConnections,
+	Wrap&& fnWrap, Resolve&& fnResolve, uint64_t& nChecksum)
+{
+	std::vector<netmsg::net::tsqueue<Item>> vQueues(setup.nConsumers);
+	std::atomic<bool> bGo = false;
+	std::vector<std::thread> vProducers;
+	for (size_t p = 0; p < setup.nProducers; p++)
+	{
+		vProducers.emplace_back([&, p]()
+			{
+				while (!bGo)
+				{
+					std::this_thread::yield();
+				}
+
+				const auto& vOwn = vConnections[p];
+				auto& qIn = vQueues[p % setup.nConsumers];
+				netmsg::net::message<HandleMsgTypes> msg;
+				msg.header.id = HandleMsgTypes::Move;
+				for (size_t i = 0; i < setup.nMessages; i++)
+				{
+					size_t c = i % vOwn.size();
+					// A read completes with a copy of the connection captured in its handler, and the next read captures
+					// another one, both on this thread
+					auto self = vOwn[c];
+					msg.header.size = uint32_t(i);
+					qIn.push_back(fnWrap(p, c, self, msg));
+				}
+			});
+	}
+
+	std::vector<uint64_t> vChecksums(setup.nConsumers, 0);
+	std::vector<std::thread> vConsumers;
+	for (size_t c = 0; c < setup.nConsumers; c++)
+	{
+		// The producers of this consumer are c, c + nConsumers, ...
+		size_t nExpected = setup.nMessages * ((setup.nProducers + setup.nConsumers - 1 - c) / setup.nConsumers);
+		vConsumers.emplace_back([&, c, nExpected]()
+			{
+				auto& qIn = vQueues[c];
+				uint64_t nSum = 0;
+				for (size_t n = 0; n < nExpected; n++)
+				{
+					qIn.wait();
+					Item item = qIn.pop_front();
+					const bench_connection* pConnection = fnResolve(item);
+					nSum += pConnection->nID + item.msg.header.size;
+				}
+				vChecksums[c] = nSum;
+			});
+	}
+
+	const size_t nTotal = setup.nMessages * setup.nProducers;
+	auto tStart = bench_clock::now();
+	bGo = true;
+	for (auto& t : vConsumers)
+	{
+		t.join();
+	}
+	double dNs = std::chrono::duration<double, std::nano>(bench_clock::now() - tStart).count() / double(nTotal);
+
+	for (auto& t : vProducers)
+	{
+		t.join();
+	}
+	for (uint64_t nSum : vChecksums)
+	{
+		nChecksum += nSum;
+	}
+	return dNs;
+}
+
+int main(int argc, char* argv[])
+{
+	bench_setup setup;
+	setup.nMessages = argc > 1 ? std::stoul(argv[1]) : 500000;
+	setup.nProducers = argc > 2 ? std::stoul(argv[2]) : 4;
+	setup.nConnections = argc > 3 ? std::stoul(argv[3]) : 16;
+	size_t nRounds = argc > 4 ? std::stoul(argv[4]) : 5;
+	setup.nConsumers = std::max<size_t>(1, std::min(argc > 5 ? std::stoul(argv[5]) : 2, setup.nProducers));
+
+	// The connections are spread over the producers like the sockets of a server over its I/O threads, every one of them
+	// also gets a handle in the table the consumer resolves from
+	netmsg::net::handle_table<bench_connection> table;
+	std::vector<std::vector<std::shared_ptr<bench_connection>>> vConnections(setup.nProducers);
+	std::vector<std::vector<netmsg::net::connection_handle>> vHandles(setup.nProducers);
+	uint32_t nID = 10000;
+	for (size_t p = 0; p < setup.nProducers; p++)
+	{
+		for (size_t c = 0; c < setup.nConnections; c++)
+		{
+			auto connection = std::make_shared<bench_connection>();
+			connection->nID = nID++;
+			vHandles[p].push_back(table.Acquire(connection));
+			vConnections[p].push_back(std::move(connection));
+		}
+	}
+
+	std::cout << setup.nProducers << " producers, " << setup.nConsumers << " consumers, " << setup.nConnections << " connections each, " << setup.nMessages
+		<< " messages each, " << nRounds << " rounds\n";
+	std::cout << std::left << std::setw(10) << "round" << std::setw(18) << "shared_ptr ns/msg" << "handle ns/msg\n";
+
+	uint64_t nSharedChecksum = 0;
+	uint64_t nHandleChecksum = 0;
+	for (size_t r = 0; r < nRounds; r++)
+	{
+		double dShared = Run<shared_owned_message>(setup, vConnections,
+			[](size_t, size_t, const std::shared_ptr<bench_connection>& self, const netmsg::net::message<HandleMsgTypes>& msg)
+			{
+				return shared_owned_message{ self, msg };
+			},
+			[](const shared_owned_message& item) { return item.remote.get(); }, nSharedChecksum);
+
+		double dHandle = Run<netmsg::net::owned_message<HandleMsgTypes>>(setup, vConnections,
+			[&vHandles](size_t p, size_t c, const std::shared_ptr<bench_connection>&, const netmsg::net::message<HandleMsgTypes>& msg)
+			{
+				return netmsg::net::owned_message<HandleMsgTypes>{ vHandles[p][c], msg };
+			},
+			[&table](const netmsg::net::owned_message<HandleMsgTypes>& item) { return table.Resolve(item.remote).get(); }, nHandleChecksum);
+
+		std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(10) << r << std::setw(18) << dShared << dHandle << "\n";
+	}
+
+	std::cout << "checksums " << (nSharedChecksum == nHandleChecksum ? "match" : "differ") << "\n";
+	return 0;
+}
@@ -0,0 +1,242 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <ctime>
+#include <msg_net.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// End-to-end loopback benchmark for the I/O backend build modes. The same source is compiled twice, once as it is (epoll on
+// Linux) and once with NETMSG_USE_IO_URING defined, then both outputs can be compared row by row as every scenario is
+// printed with the backend name in front of it:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/IoBackendBenchmark.cpp -pthread -o bench_epoll
+//   g++ -std=c++17 -O2 -DNETMSG_USE_IO_URING -I NetCommon -I <asio>/include NetBenchmark/IoBackendBenchmark.cpp -pthread -luring -o bench_uring
+//
+// Usage: IoBackendBenchmark [messages per scenario] [port]
+
+enum class BenchMsgTypes : uint32_t
+{
+	ServerAccept,
+	Echo,
+};
+
+// The server just bounces every echo message back to its sender, which makes the round trip measure the socket read, the
+// incoming queue, the message handler, the outgoing queue and the socket write of both ends
+class BenchServer : public netmsg::net::server_interface<BenchMsgTypes>
+{
+public:
+	BenchServer(uint16_t nPort, const netmsg::net::server_options& options) : netmsg::net::server_interface<BenchMsgTypes>(nPort, options)
+	{
+
+	}
+
+	// Pushes an empty message with no owner, it wakes up the update thread blocked on the incoming queue so it can finish
+	void Wake()
+	{
+		m_qMessagesIn.push_back({ {}, {} });
+	}
+
+protected:
+	bool OnClientConnect(std::shared_ptr<netmsg::net::connection<BenchMsgTypes>>) override
+	{
+		return true;
+	}
+
+	void OnClientValidated(std::shared_ptr<netmsg::net::connection<BenchMsgTypes>> client) override
+	{
+		netmsg::net::message<BenchMsgTypes> msg;
+		msg.header.id = BenchMsgTypes::ServerAccept;
+		client->Send(msg);
+	}
+
+	void OnMessage(std::shared_ptr<netmsg::net::connection<BenchMsgTypes>> client, netmsg::net::message<BenchMsgTypes>& msg) override
+	{
+		if (client && msg.header.id == BenchMsgTypes::Echo)
+		{
+			client->Send(msg);
+		}
+	}
+};
+
+class BenchClient : public netmsg::net::client_interface<BenchMsgTypes>
+{
+public:
+	// The send time is pushed last so it is the first thing pulled out when the echo comes back, the payload in front of it is
+	// just filler to reach the requested message size
+	void SendEcho(size_t nPayload)
+	{
+		netmsg::net::message<BenchMsgTypes> msg;
+		msg.header.id = BenchMsgTypes::Echo;
+		msg.body.resize(nPayload);
+		msg << uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+		Send(msg);
+	}
+};
+
+// Both ends disable Nagle, otherwise the separate header and body writes would measure the delayed acknowledgement timer 
+// instead of the I/O backend
+static netmsg::net::socket_options BenchSocketOptions()
+{
+	netmsg::net::socket_options options;
+	options.bNoDelay = true;
+	return options;
+}
+
+// Process CPU time (user + system) in microseconds, it includes both the server and the client threads as the benchmark runs
+// both ends of the loopback inside this same process
+static double ProcessCpuMicroseconds()
+{
+#if defined(__linux__) || defined(__APPLE__)
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#else
+	return double(std::clock()) * 1e6 / CLOCKS_PER_SEC;
+#endif
+}
+
+struct ScenarioResult
+{
+	double dMessagesPerSecond = 0.0;
+	double dMegabytesPerSecond = 0.0;
+	double dP50Micro = 0.0;
+	double dP99Micro = 0.0;
+	double dCpuMicroPerMessage = 0.0;
+};
+
+// Each connection runs a closed loop keeping a small window of echoes in flight, every returning echo records its round trip
+// and releases the next one
+static ScenarioResult RunScenario(uint16_t nPort, size_t nConnections, size_t nPayload, size_t nMessages)
+{
+	const size_t nWindow = 8;
+	const size_t nPerConnection = std::max<size_t>(1, nMessages / nConnections);
+
+	std::vector<std::unique_ptr<BenchClient>> vClients;
+	for (size_t i = 0; i < nConnections; i++)
+	{
+		vClients.push_back(std::make_unique<BenchClient>());
+		vClients.back()->Connect("127.0.0.1", nPort, BenchSocketOptions());
+	}
+
+	// We wait for every client to pass the validation before starting the clock, the handshake is not part of the measurement
+	for (auto& client : vClients)
+	{
+		client->Incoming().wait();
+		client->Incoming().pop_front();
+	}
+
+	std::vector<std::vector<uint64_t>> vLatencies(nConnections);
+	std::vector<std::thread> vThreads;
+
+	double dCpuStart = ProcessCpuMicroseconds();
+	auto tStart = std::chrono::steady_clock::now();
+
+	for (size_t c = 0; c < nConnections; c++)
+	{
+		vThreads.emplace_back([&, c]()
+			{
+				BenchClient& client = *vClients[c];
+				std::vector<uint64_t>& vLat = vLatencies[c];
+				vLat.reserve(nPerConnection);
+
+				size_t nSent = 0;
+				for (; nSent < std::min(nWindow, nPerConnection); nSent++)
+				{
+					client.SendEcho(nPayload);
+				}
+
+				while (vLat.size() < nPerConnection)
+				{
+					client.Incoming().wait();
+					auto msg = client.Incoming().pop_front().msg;
+
+					uint64_t nThen = 0;
+					msg >> nThen;
+					vLat.push_back(uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) - nThen);
+
+					if (nSent < nPerConnection)
+					{
+						client.SendEcho(nPayload);
+						nSent++;
+					}
+				}
+			});
+	}
+
+	for (auto& t : vThreads)
+	{
+		t.join();
+	}
+
+	auto tEnd = std::chrono::steady_clock::now();
+	double dCpuEnd = ProcessCpuMicroseconds();
+
+	std::vector<uint64_t> vAll;
+	for (auto& v : vLatencies)
+	{
+		vAll.insert(vAll.end(), v.begin(), v.end());
+	}
+	std::sort(vAll.begin(), vAll.end());
+
+	// steady_clock ticks are converted into microseconds through its own period so the numbers are right on any platform
+	const double dTickMicro = 1e6 * double(std::chrono::steady_clock::period::num) / double(std::chrono::steady_clock::period::den);
+	const double dSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+
+	ScenarioResult result;
+	result.dMessagesPerSecond = double(vAll.size()) / dSeconds;
+	result.dMegabytesPerSecond = result.dMessagesPerSecond * double(nPayload + sizeof(uint64_t) + sizeof(netmsg::net::message_header<BenchMsgTypes>)) * 2.0 / (1024.0 * 1024.0);
+	result.dP50Micro = double(vAll[vAll.size() / 2]) * dTickMicro;
+	result.dP99Micro = double(vAll[std::min(vAll.size() - 1, vAll.size() * 99 / 100)]) * dTickMicro;
+	result.dCpuMicroPerMessage = (dCpuEnd - dCpuStart) / double(vAll.size());
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nMessages = argc > 1 ? std::stoul(argv[1]) : 100000;
+	uint16_t nPort = argc > 2 ? uint16_t(std::stoul(argv[2])) : 60100;
+
+	netmsg::net::server_options options;
+	options.socket = BenchSocketOptions();
+	BenchServer server(nPort, options);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]()
+		{
+			while (bRunning)
+			{
+				server.Update(-1, true);
+			}
+		});
+
+	const size_t vConnections[] = { 1, 8, 64 };
+	const size_t vPayloads[] = { 16, 256, 4096, 65536 };
+
+	std::cout << std::left << std::setw(10) << "backend" << std::setw(8) << "conns" << std::setw(8) << "bytes"
+		<< std::setw(14) << "msg/s" << std::setw(12) << "MB/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+		<< "cpu us/msg\n";
+
+	for (size_t nConnections : vConnections)
+	{
+		for (size_t nPayload : vPayloads)
+		{
+			ScenarioResult r = RunScenario(nPort, nConnections, nPayload, nMessages);
+			std::cout << std::left << std::fixed << std::setprecision(2)
+				<< std::setw(10) << netmsg::net::IoBackendName() << std::setw(8) << nConnections << std::setw(8) << nPayload
+				<< std::setw(14) << r.dMessagesPerSecond << std::setw(12) << r.dMegabytesPerSecond
+				<< std::setw(12) << r.dP50Micro << std::setw(12) << r.dP99Micro << r.dCpuMicroPerMessage << "\n";
+		}
+	}
+
+	bRunning = false;
+	server.Wake();
+	thrUpdate.join();
+	server.Stop();
+	return 0;
+}
@@ -0,0 +1,264 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <msg_net.h>
+
+// Bandwidth of a server replicating a moving world to a crowd of bots, and what each bot sees of it. Every bot plays one of
+// the entities, gets a replication message per tick with the entities scheduled for it and keeps the last position it got
+// for each of them, as a client drawing the world would. The quality a player perceives is the angle between where an entity
+// is drawn and where it really is, the error in meters divided by the distance, so it is measured in milliradians over every
+// pair of bot and entity in range on every tick. The level of detail schedule of net_lod.h is run against sending everything
+// in range on every tick, against the same schedule without the phases (all the entities of a band on the same tick) and
+// against lowering the rate of the whole world instead:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/LodBenchmark.cpp -pthread -o bench_lod
+//
+// Usage: LodBenchmark [entities] [bots] [ticks]
+
+enum class LodMsgTypes : uint32_t
+{
+	WorldUpdate,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<LodMsgTypes>;
+using bench_world = netmsg::net::entity_store<>;
+
+constexpr float fTickDelta = 1.0f / 30.0f;
+constexpr float fWorldHalf = 500.0f;
+constexpr float fRange = 200.0f;
+
+// Angular errors in buckets of 0.1 milliradian, the last bucket takes everything above 100
+struct error_histogram
+{
+	std::vector<uint64_t> vBuckets = std::vector<uint64_t>(1001, 0);
+	uint64_t nSamples = 0;
+	double dSum = 0.0;
+
+	void Add(double dMilliradians)
+	{
+		vBuckets[std::min<size_t>(size_t(dMilliradians * 10.0), vBuckets.size() - 1)]++;
+		nSamples++;
+		dSum += dMilliradians;
+	}
+
+	double Percentile(double dFraction) const
+	{
+		uint64_t nTarget = uint64_t(dFraction * double(nSamples));
+		uint64_t nSeen = 0;
+		for (size_t b = 0; b < vBuckets.size(); b++)
+		{
+			nSeen += vBuckets[b];
+			if (nSeen > nTarget)
+			{
+				return double(b + 1) / 10.0;
+			}
+		}
+		return double(vBuckets.size()) / 10.0;
+	}
+};
+
+struct run_result
+{
+	double dKiBPerTick = 0.0;
+	double dPeakKiB = 0.0;
+	double dScheduleMs = 0.0;
+	error_histogram errors;
+};
+
+// Where every bot believes the entities are, indexed by bot then by entity. A bot forgets the entities that leave its range
+// and only draws one again once it has received it, like a client despawning what the server no longer tells it about
+struct bot_views
+{
+	std::vector<float> vX, vZ;
+	std::vector<uint8_t> vKnown;
+};
+
+// The entities walk on the ground and turn back at the edges of the world
+static void Walk(bench_world& world)
+{
+	world.Integrate(fTickDelta);
+	float* px = world.PositionX();
+	float* pz = world.PositionZ();
+	float* vx = world.VelocityX();
+	float* vz = world.VelocityZ();
+	for (size_t i = 0; i < world.Size(); i++)
+	{
+		if (std::abs(px[i]) > fWorldHalf) vx[i] = -vx[i];
+		if (std::abs(pz[i]) > fWorldHalf) vz[i] = -vz[i];
+	}
+}
+
+static bench_world MakeWorld(size_t nEntities)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> distPos(-fWorldHalf, fWorldHalf);
+	std::uniform_real_distribution<float> distVel(-5.0f, 5.0f);
+
+	bench_world world(nEntities);
+	for (size_t i = 0; i < nEntities; i++)
+	{
+		auto id = world.Create(distPos(rng), 0.0f, distPos(rng));
+		world.SetVelocity(id, distVel(rng), 0.0f, distVel(rng));
+	}
+	return world;
+}
+
+// fnSchedule fills the places of the entities to send to a bot on a tick, the rest is the same for every run
+template <typename F>
+static run_result Run(size_t nEntities, size_t nBots, size_t nTicks, F&& fnSchedule)
+{
+	bench_world world = MakeWorld(nEntities);
+
+	// The bots start with the whole world, as if they had just received a full snapshot
+	bot_views views;
+	views.vX.resize(nBots * nEntities);
+	views.vZ.resize(nBots * nEntities);
+	views.vKnown.resize(nBots * nEntities, 1);
+	for (size_t b = 0; b < nBots; b++)
+	{
+		std::copy(world.PositionX(), world.PositionX() + nEntities, views.vX.begin() + b * nEntities);
+		std::copy(world.PositionZ(), world.PositionZ() + nEntities, views.vZ.begin() + b * nEntities);
+	}
+
+	run_result result;
+	std::vector<uint32_t> vDue;
+	bench_message msg;
+	double dTotalBytes = 0.0;
+
+	for (uint64_t nTick = 1; nTick <= nTicks; nTick++)
+	{
+		Walk(world);
+		const float* px = world.PositionX();
+		const float* pz = world.PositionZ();
+
+		double dTickBytes = 0.0;
+		for (size_t b = 0; b < nBots; b++)
+		{
+			// Bot b plays entity b
+			float x = px[b], z = pz[b];
+
+			vDue.clear();
+			auto t0 = bench_clock::now();
+			fnSchedule(world, uint32_t(b), x, z, nTick, vDue);
+			result.dScheduleMs += std::chrono::duration<double, std::milli>(bench_clock::now() - t0).count();
+
+			msg.body.clear();
+			msg.header.id = LodMsgTypes::WorldUpdate;
+			world.WriteSelected(msg, vDue.data(), vDue.size());
+			dTickBytes += double(sizeof(msg.header) + msg.size());
+
+			float* pViewX = views.vX.data() + b * nEntities;
+			float* pViewZ = views.vZ.data() + b * nEntities;
+			uint8_t* pKnown = views.vKnown.data() + b * nEntities;
+			bench_world::ReadChanges(msg, [&](const netmsg::net::entity_change& change)
+				{
+					pViewX[change.id.nIndex] = change.x;
+					pViewZ[change.id.nIndex] = change.z;
+					pKnown[change.id.nIndex] = 1;
+				});
+
+			// What the player sees of every other entity in range, after this tick
+			for (size_t i = 0; i < nEntities; i++)
+			{
+				float dx = px[i] - x, dz = pz[i] - z;
+				float fDistance = std::sqrt(dx * dx + dz * dz);
+				if (fDistance > fRange)
+				{
+					pKnown[i] = 0;
+					continue;
+				}
+				if (i == b || fDistance < 1.0f || !pKnown[i])
+				{
+					continue;
+				}
+				float ex = pViewX[i] - px[i], ez = pViewZ[i] - pz[i];
+				result.errors.Add(1000.0 * std::sqrt(double(ex * ex + ez * ez)) / double(fDistance));
+			}
+		}
+
+		dTotalBytes += dTickBytes;
+		result.dPeakKiB = std::max(result.dPeakKiB, dTickBytes / 1024.0);
+	}
+
+	result.dKiBPerTick = dTotalBytes / double(nTicks) / 1024.0;
+	result.dScheduleMs /= double(nTicks);
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nEntities = argc > 1 ? std::stoul(argv[1]) : 10000;
+	size_t nBots = argc > 2 ? std::stoul(argv[2]) : 100;
+	size_t nTicks = argc > 3 ? std::stoul(argv[3]) : 300;
+
+	netmsg::net::replication_lod lod({ { 25.0f, 1 }, { 50.0f, 2 }, { 100.0f, 4 }, { fRange, 8 } });
+
+	// Everything in range, at the full rate or at a lower rate for the whole world
+	auto fnUniform = [](uint32_t nInterval)
+	{
+		return [nInterval](bench_world& world, uint32_t nBot, float x, float z, uint64_t nTick, std::vector<uint32_t>& vDue)
+		{
+			const float* px = world.PositionX();
+			const float* pz = world.PositionZ();
+			for (size_t i = 0; i < world.Size(); i++)
+			{
+				float dx = px[i] - x, dz = pz[i] - z;
+				if (dx * dx + dz * dz <= fRange * fRange && netmsg::net::replication_lod::Due(nTick, nBot, world.Entity(i), nInterval))
+				{
+					vDue.push_back(uint32_t(i));
+				}
+			}
+		};
+	};
+
+	auto fnLod = [&lod](bench_world& world, uint32_t nBot, float x, float z, uint64_t nTick, std::vector<uint32_t>& vDue)
+	{
+		lod.Schedule(world, nBot, x, 0.0f, z, nTick, vDue);
+	};
+
+	// The same bands with every entity of a band on the same tick
+	auto fnLodNoPhase = [&lod](bench_world& world, uint32_t, float x, float z, uint64_t nTick, std::vector<uint32_t>& vDue)
+	{
+		const float* px = world.PositionX();
+		const float* pz = world.PositionZ();
+		for (size_t i = 0; i < world.Size(); i++)
+		{
+			float dx = px[i] - x, dz = pz[i] - z;
+			uint32_t nInterval = lod.Interval(dx * dx + dz * dz);
+			if (nInterval != 0 && nTick % nInterval == 0)
+			{
+				vDue.push_back(uint32_t(i));
+			}
+		}
+	};
+
+	std::cout << nEntities << " entities, " << nBots << " bots, " << nTicks << " ticks at " << std::lround(1.0f / fTickDelta) << " Hz, range "
+		<< fRange << " m, bands";
+	for (const auto& band : lod.Bands())
+	{
+		std::cout << " " << band.fDistance << "m/" << band.nInterval;
+	}
+	std::cout << "\n";
+	std::cout << std::left << std::setw(18) << "schedule" << std::setw(14) << "KiB/tick" << std::setw(14) << "peak KiB"
+		<< std::setw(12) << "saved" << std::setw(14) << "mean mrad" << std::setw(14) << "p99 mrad" << std::setw(14) << "p99.9 mrad"
+		<< "schedule ms\n";
+
+	run_result full = Run(nEntities, nBots, nTicks, fnUniform(1));
+	auto fnPrint = [&full](const char* sName, const run_result& r)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(18) << sName << std::setw(14) << r.dKiBPerTick
+			<< std::setw(14) << r.dPeakKiB << std::setw(12) << (std::to_string(int(100.0 * (1.0 - r.dKiBPerTick / full.dKiBPerTick))) + "%")
+			<< std::setw(14) << r.errors.dSum / double(r.errors.nSamples) << std::setw(14) << r.errors.Percentile(0.99)
+			<< std::setw(14) << r.errors.Percentile(0.999) << r.dScheduleMs << "\n";
+	};
+
+	fnPrint("full rate", full);
+	fnPrint("lod", Run(nEntities, nBots, nTicks, fnLod));
+	fnPrint("lod, no phases", Run(nEntities, nBots, nTicks, fnLodNoPhase));
+	fnPrint("every 2nd tick", Run(nEntities, nBots, nTicks, fnUniform(2)));
+	fnPrint("every 3rd tick", Run(nEntities, nBots, nTicks, fnUniform(3)));
+	fnPrint("every 4th tick", Run(nEntities, nBots, nTicks, fnUniform(4)));
+	return 0;
+}
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <msg_net.h>
+
+// Dispatch cost of the message router against the path it replaces, a virtual OnMessage with a switch on the identifier and
+// the payload pulled out of the body field by field with operator>>. Both sides receive the same random mix of messages, a
+// fresh copy of them every round as Update hands each handler a message of its own, and only the dispatch loop is timed:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/RouterBenchmark.cpp -pthread -o bench_router
+//
+// Usage: RouterBenchmark [messages] [rounds]
+
+enum class RouterMsgTypes : uint32_t
+{
+	Move,
+	Look,
+	Fire,
+	Chat,
+	Emote,
+	Use,
+	Jump,
+	Leave,
+};
+
+struct move_payload
+{
+	float x, y, z;
+	uint32_t nTick;
+};
+
+struct look_payload
+{
+	float fYaw, fPitch;
+};
+
+struct fire_payload
+{
+	uint32_t nWeapon;
+	float vDirection[3];
+};
+
+struct chat_payload
+{
+	char sText[64];
+};
+
+struct use_payload
+{
+	uint64_t nEntity;
+};
+
+using router_client = std::shared_ptr<netmsg::net::connection<RouterMsgTypes>>;
+using bench_clock = std::chrono::steady_clock;
+
+// What the handlers do with the payloads, the same for both paths so the difference is the dispatch and the decoding
+struct handler_sink
+{
+	double dSum = 0.0;
+	uint64_t nCount = 0;
+};
+
+class switch_handler
+{
+public:
+	virtual ~switch_handler() = default;
+	virtual void OnMessage(router_client client, netmsg::net::message<RouterMsgTypes>& msg) = 0;
+};
+
+class switch_server : public switch_handler
+{
+public:
+	handler_sink sink;
+
+	void OnMessage(router_client, netmsg::net::message<RouterMsgTypes>& msg) override
+	{
+		switch (msg.header.id)
+		{
+		case RouterMsgTypes::Move:
+		{
+			float x, y, z;
+			uint32_t nTick;
+			msg >> nTick >> z >> y >> x;
+			sink.dSum += x + y + z + nTick;
+		}
+		break;
+		case RouterMsgTypes::Look:
+		{
+			float fYaw, fPitch;
+			msg >> fPitch >> fYaw;
+			sink.dSum += fYaw - fPitch;
+		}
+		break;
+		case RouterMsgTypes::Fire:
+		{
+			fire_payload fire;
+			msg >> fire;
+			sink.dSum += fire.nWeapon + fire.vDirection[0];
+		}
+		break;
+		case RouterMsgTypes::Chat:
+		{
+			chat_payload chat;
+			msg >> chat;
+			sink.dSum += chat.sText[0];
+		}
+		break;
+		case RouterMsgTypes::Use:
+		{
+			uint64_t nEntity;
+			msg >> nEntity;
+			sink.dSum += double(nEntity);
+		}
+		break;
+		case RouterMsgTypes::Emote:
+		case RouterMsgTypes::Jump:
+		case RouterMsgTypes::Leave:
+			sink.nCount++;
+			break;
+		}
+	}
+};
+
+static void RegisterRoutes(netmsg::net::message_router<RouterMsgTypes>& router, handler_sink& sink)
+{
+	router.On<RouterMsgTypes::Move, move_payload>([&sink](router_client&, const move_payload& move) { sink.dSum += move.x + move.y + move.z + move.nTick; });
+	router.On<RouterMsgTypes::Look, look_payload>([&sink](router_client&, const look_payload& look) { sink.dSum += look.fYaw - look.fPitch; });
+	router.On<RouterMsgTypes::Fire, fire_payload>([&sink](router_client&, const fire_payload& fire) { sink.dSum += fire.nWeapon + fire.vDirection[0]; });
+	router.On<RouterMsgTypes::Chat, chat_payload>([&sink](router_client&, const chat_payload& chat) { sink.dSum += chat.sText[0]; });
+	router.On<RouterMsgTypes::Use, use_payload>([&sink](router_client&, const use_payload& use) { sink.dSum += double(use.nEntity); });
+	router.On<RouterMsgTypes::Emote>([&sink](router_client&) { sink.nCount++; });
+	router.On<RouterMsgTypes::Jump>([&sink](router_client&) { sink.nCount++; });
+	router.On<RouterMsgTypes::Leave>([&sink](router_client&) { sink.nCount++; });
+}
+
+// Movement dominates the traffic of a game, the rest is spread over the other messages
+static std::vector<netmsg::net::message<RouterMsgTypes>> MakeTraffic(size_t nMessages)
+{
+	using router = netmsg::net::message_router<RouterMsgTypes>;
+	std::mt19937 rng{ 7 };
+	std::uniform_int_distribution<int> distKind(0, 99);
+	std::uniform_real_distribution<float> distValue(-100.0f, 100.0f);
+
+	std::vector<netmsg::net::message<RouterMsgTypes>> vMessages;
+	vMessages.reserve(nMessages);
+	for (size_t i = 0; i < nMessages; i++)
+	{
+		int nKind = distKind(rng);
+		if (nKind < 50) vMessages.push_back(router::Encode<RouterMsgTypes::Move>(move_payload{ distValue(rng), distValue(rng), distValue(rng), uint32_t(i) }));
+		else if (nKind < 75) vMessages.push_back(router::Encode<RouterMsgTypes::Look>(look_payload{ distValue(rng), distValue(rng) }));
+		else if (nKind < 85) vMessages.push_back(router::Encode<RouterMsgTypes::Fire>(fire_payload{ uint32_t(nKind), { distValue(rng), 0.0f, 1.0f } }));
+		else if (nKind < 88) vMessages.push_back(router::Encode<RouterMsgTypes::Chat>(chat_payload{ "hello" }));
+		else if (nKind < 93) vMessages.push_back(router::Encode<RouterMsgTypes::Use>(use_payload{ uint64_t(i) }));
+		else
+		{
+			netmsg::net::message<RouterMsgTypes> msg;
+			msg.header.id = nKind < 96 ? RouterMsgTypes::Emote : nKind < 99 ? RouterMsgTypes::Jump : RouterMsgTypes::Leave;
+			vMessages.push_back(msg);
+		}
+	}
+	return vMessages;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nMessages = argc > 1 ? std::stoul(argv[1]) : 1000000;
+	size_t nRounds = argc > 2 ? std::stoul(argv[2]) : 5;
+
+	const auto vTraffic = MakeTraffic(nMessages);
+	router_client client;
+
+	switch_server server;
+	// Called through the base like Update does, the compiler cannot see which OnMessage it is
+	switch_handler* pHandler = &server;
+
+	handler_sink sink;
+	netmsg::net::message_router<RouterMsgTypes> router;
+	RegisterRoutes(router, sink);
+
+	std::cout << nMessages << " messages, " << nRounds << " rounds\n";
+	std::cout << std::left << std::setw(10) << "round" << std::setw(16) << "switch ns/msg" << "router ns/msg\n";
+	for (size_t r = 0; r < nRounds; r++)
+	{
+		auto vMessages = vTraffic;
+		auto tStart = bench_clock::now();
+		for (auto& msg : vMessages)
+		{
+			pHandler->OnMessage(client, msg);
+		}
+		double dSwitch = std::chrono::duration<double, std::nano>(bench_clock::now() - tStart).count() / double(nMessages);
+
+		vMessages = vTraffic;
+		tStart = bench_clock::now();
+		for (auto& msg : vMessages)
+		{
+			router.Dispatch(client, msg);
+		}
+		double dRouter = std::chrono::duration<double, std::nano>(bench_clock::now() - tStart).count() / double(nMessages);
+
+		std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(10) << r << std::setw(16) << dSwitch << dRouter << "\n";
+	}
+
+	// Both paths must have seen the same payloads
+	std::cout << "checksums " << std::setprecision(1) << server.sink.dSum << " / " << sink.dSum << ", "
+		<< server.sink.nCount << " / " << sink.nCount << ", malformed " << router.GetMalformed() << "\n";
+	return 0;
+}
@@ -0,0 +1,257 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <msg_net.h>
+
+#include <csignal>
+#include <sys/wait.h>
+
+// A co-located process talking to the server over the shared memory channel of net_shm.h against the same process talking to
+// it over loopback TCP. The program forks: the child plays the server with a TCP echo server and a shared memory echo channel,
+// the parent plays the gateway or the bot and measures both. Latency is a ping pong with one message in flight, throughput
+// keeps a window of messages in flight:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/ShmBenchmark.cpp -pthread -o bench_shm
+//
+// Usage: ShmBenchmark [messages per scenario] [port]
+
+enum class ShmMsgTypes : uint32_t
+{
+	ServerAccept,
+	Echo,
+	Quit,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<ShmMsgTypes>;
+
+static const char* sChannelName = "/netmsg_shm_benchmark";
+
+class EchoServer : public netmsg::net::server_interface<ShmMsgTypes>
+{
+public:
+	EchoServer(uint16_t nPort, const netmsg::net::server_options& options) : netmsg::net::server_interface<ShmMsgTypes>(nPort, options)
+	{
+
+	}
+
+	// Pushes an empty message with no owner, it wakes up the update thread blocked on the incoming queue so it can finish
+	void Wake()
+	{
+		m_qMessagesIn.push_back({ {}, {} });
+	}
+
+protected:
+	bool OnClientConnect(std::shared_ptr<netmsg::net::connection<ShmMsgTypes>>) override
+	{
+		return true;
+	}
+
+	void OnClientValidated(std::shared_ptr<netmsg::net::connection<ShmMsgTypes>> client) override
+	{
+		bench_message msg;
+		msg.header.id = ShmMsgTypes::ServerAccept;
+		client->Send(msg);
+	}
+
+	void OnMessage(std::shared_ptr<netmsg::net::connection<ShmMsgTypes>> client, bench_message& msg) override
+	{
+		if (client && msg.header.id == ShmMsgTypes::Echo)
+		{
+			client->Send(std::move(msg));
+		}
+	}
+};
+
+// Both ends disable Nagle, otherwise the round trips would measure the delayed acknowledgement timer
+static netmsg::net::socket_options BenchSocketOptions()
+{
+	netmsg::net::socket_options options;
+	options.bNoDelay = true;
+	return options;
+}
+
+// The server process, it echoes on both transports until the parent says it is done over the channel
+static int RunServer(uint16_t nPort)
+{
+	netmsg::net::server_options options;
+	options.socket = BenchSocketOptions();
+	EchoServer server(nPort, options);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]()
+		{
+			while (bRunning)
+			{
+				server.Update(-1, true);
+			}
+		});
+
+	{
+		netmsg::net::shm_connection<ShmMsgTypes> channel(netmsg::net::shm_role::Create, sChannelName);
+		while (true)
+		{
+			channel.Incoming().wait();
+			bench_message msg = channel.Incoming().pop_front().msg;
+			if (msg.header.id == ShmMsgTypes::Quit)
+			{
+				break;
+			}
+			channel.Send(std::move(msg));
+		}
+	}
+
+	bRunning = false;
+	server.Wake();
+	thrUpdate.join();
+	server.Stop();
+	return 0;
+}
+
+struct scenario_result
+{
+	double dMessagesPerSecond = 0.0;
+	double dMegabytesPerSecond = 0.0;
+	double dP50Micro = 0.0;
+	double dP99Micro = 0.0;
+};
+
+// Keeps nWindow echoes in flight and records the round trip of each one. The send time is the last thing in the body, the
+// payload in front of it is filler. Send and Incoming are all the loop needs, which the client and the channel both have
+template <typename Transport>
+static scenario_result RunScenario(Transport& transport, size_t nPayload, size_t nWindow, size_t nMessages)
+{
+	auto fnSend = [&]()
+	{
+		netmsg::net::message_builder<ShmMsgTypes> builder(ShmMsgTypes::Echo, nPayload + sizeof(uint64_t));
+		builder.Message().body.resize(nPayload);
+		builder << uint64_t(bench_clock::now().time_since_epoch().count());
+		transport.Send(std::move(builder));
+	};
+
+	std::vector<uint64_t> vLatencies;
+	vLatencies.reserve(nMessages);
+
+	auto tStart = bench_clock::now();
+	size_t nSent = 0;
+	for (; nSent < std::min(nWindow, nMessages); nSent++)
+	{
+		fnSend();
+	}
+
+	while (vLatencies.size() < nMessages)
+	{
+		transport.Incoming().wait();
+		bench_message msg = transport.Incoming().pop_front().msg;
+
+		uint64_t nThen = 0;
+		msg >> nThen;
+		vLatencies.push_back(uint64_t(bench_clock::now().time_since_epoch().count()) - nThen);
+
+		if (nSent < nMessages)
+		{
+			fnSend();
+			nSent++;
+		}
+	}
+	auto tEnd = bench_clock::now();
+
+	std::sort(vLatencies.begin(), vLatencies.end());
+	const double dTickMicro = 1e6 * double(bench_clock::period::num) / double(bench_clock::period::den);
+	const double dSeconds = std::chrono::duration<double>(tEnd - tStart).count();
+
+	scenario_result result;
+	result.dMessagesPerSecond = double(nMessages) / dSeconds;
+	result.dMegabytesPerSecond = result.dMessagesPerSecond * double(nPayload + sizeof(uint64_t)) * 2.0 / (1024.0 * 1024.0);
+	result.dP50Micro = double(vLatencies[vLatencies.size() / 2]) * dTickMicro;
+	result.dP99Micro = double(vLatencies[std::min(vLatencies.size() - 1, vLatencies.size() * 99 / 100)]) * dTickMicro;
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nMessages = argc > 1 ? std::stoul(argv[1]) : 50000;
+	uint16_t nPort = argc > 2 ? uint16_t(std::stoul(argv[2])) : 60300;
+
+	// The fork comes before any thread is started, the child begins with a clean process
+	pid_t nServer = fork();
+	if (nServer < 0)
+	{
+		std::cerr << "fork failed\n";
+		return 1;
+	}
+	if (nServer == 0)
+	{
+		_exit(RunServer(nPort));
+	}
+
+	// The server needs a moment to create the channel and to listen, we try until it is there
+	std::unique_ptr<netmsg::net::shm_connection<ShmMsgTypes>> channel;
+	netmsg::net::client_interface<ShmMsgTypes> client;
+	for (int nTry = 0; nTry < 200 && !channel; nTry++)
+	{
+		try
+		{
+			channel = std::make_unique<netmsg::net::shm_connection<ShmMsgTypes>>(netmsg::net::shm_role::Open, sChannelName);
+		}
+		catch (const std::exception&)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	bool bConnected = false;
+	for (int nTry = 0; nTry < 200 && !bConnected; nTry++)
+	{
+		bConnected = client.Connect("127.0.0.1", nPort, BenchSocketOptions());
+		if (bConnected)
+		{
+			// The validation handshake is not part of the measurement
+			client.Incoming().wait();
+			client.Incoming().pop_front();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	if (!channel || !bConnected)
+	{
+		std::cerr << "server did not come up\n";
+		kill(nServer, SIGKILL);
+		waitpid(nServer, nullptr, 0);
+		return 1;
+	}
+
+	const size_t vPayloads[] = { 16, 256, 4096, 65536 };
+	const size_t vWindows[] = { 1, 32 };
+
+	std::cout << nMessages << " messages per scenario\n";
+	std::cout << std::left << std::setw(12) << "transport" << std::setw(8) << "window" << std::setw(8) << "bytes"
+		<< std::setw(14) << "msg/s" << std::setw(12) << "MB/s" << std::setw(12) << "p50 us" << "p99 us\n";
+
+	auto fnPrint = [](const char* sName, size_t nWindow, size_t nPayload, const scenario_result& r)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(12) << sName << std::setw(8) << nWindow
+			<< std::setw(8) << nPayload << std::setw(14) << r.dMessagesPerSecond << std::setw(12) << r.dMegabytesPerSecond
+			<< std::setw(12) << r.dP50Micro << r.dP99Micro << "\n";
+	};
+
+	for (size_t nWindow : vWindows)
+	{
+		for (size_t nPayload : vPayloads)
+		{
+			fnPrint("shm", nWindow, nPayload, RunScenario(*channel, nPayload, nWindow, nMessages));
+			fnPrint("tcp", nWindow, nPayload, RunScenario(client, nPayload, nWindow, nMessages));
+		}
+	}
+
+	bench_message quit;
+	quit.header.id = ShmMsgTypes::Quit;
+	channel->Send(quit);
+	client.Disconnect();
+	waitpid(nServer, nullptr, 0);
+	return 0;
+}
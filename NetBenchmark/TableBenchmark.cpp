@@ -0,0 +1,298 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <msg_net.h>
+
+// A zone description with its inventory, a few hundred items each with a name and a handful of tags, sent as a plain message
+// body and as a table body of net_table.h. The plain body is what handlers do today: every field is pushed with operator <<
+// and the handler pops all of them back into structs with operator >>, strings and vectors allocated on the way, before it
+// can look at anything. The table body is read where it arrived through the accessors below (the code a schema compiler
+// would generate), after the verifier has checked it. The table is read whole, then for a single field of a single item,
+// which is what most handlers of such messages actually need, with and without the verifier:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/TableBenchmark.cpp -pthread -o bench_tables
+//
+// Usage: TableBenchmark [items per zone] [messages]
+
+enum class TableMsgTypes : uint32_t
+{
+	ZoneDescription,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<TableMsgTypes>;
+
+// The structs a handler decodes the plain body into
+struct item_desc
+{
+	uint32_t nId = 0;
+	uint16_t nCount = 0;
+	float fWeight = 0.0f;
+	std::string sName;
+	std::vector<uint16_t> vTags;
+};
+
+struct zone_desc
+{
+	uint32_t nId = 0;
+	std::string sName;
+	std::vector<float> vBounds;
+	std::vector<item_desc> vItems;
+};
+
+// Accessors over the table body, one struct per table
+struct item_table
+{
+	netmsg::net::table_view t;
+
+	enum : uint32_t { Id, Count, Weight, Name, Tags, Slots };
+
+	uint32_t ItemId() const { return t.Scalar<uint32_t>(Id); }
+	uint16_t ItemCount() const { return t.Scalar<uint16_t>(Count); }
+	float ItemWeight() const { return t.Scalar<float>(Weight); }
+	std::string_view ItemName() const { return t.String(Name); }
+	netmsg::net::vector_view<uint16_t> ItemTags() const { return t.Vector<uint16_t>(Tags); }
+
+	static bool Verify(netmsg::net::table_verifier& v, netmsg::net::table_view t)
+	{
+		return v.VerifyTable(t) && v.VerifyScalar<uint32_t>(t, Id) && v.VerifyScalar<uint16_t>(t, Count) && v.VerifyScalar<float>(t, Weight)
+			&& v.VerifyString(t, Name) && v.VerifyVector<uint16_t>(t, Tags);
+	}
+};
+
+struct zone_table
+{
+	netmsg::net::table_view t;
+
+	enum : uint32_t { Id, Name, Bounds, Items, Slots };
+
+	uint32_t ZoneId() const { return t.Scalar<uint32_t>(Id); }
+	std::string_view ZoneName() const { return t.String(Name); }
+	netmsg::net::vector_view<float> ZoneBounds() const { return t.Vector<float>(Bounds); }
+	netmsg::net::table_vector_view ZoneItems() const { return t.Tables(Items); }
+
+	static bool Verify(netmsg::net::table_verifier& v, netmsg::net::table_view t)
+	{
+		return v.VerifyTable(t) && v.VerifyScalar<uint32_t>(t, Id) && v.VerifyString(t, Name) && v.VerifyVector<float>(t, Bounds)
+			&& v.VerifyChildren<item_table>(t, Items);
+	}
+};
+
+// Strings and vectors go in as their elements then their size, so the size pops first
+template <typename S>
+static void PushVector(bench_message& msg, const S* pData, size_t nCount)
+{
+	size_t nAt = msg.body.size();
+	msg.body.resize(nAt + nCount * sizeof(S));
+	std::memcpy(msg.body.data() + nAt, pData, nCount * sizeof(S));
+	msg << uint32_t(nCount);
+}
+
+template <typename S>
+static void PopVector(bench_message& msg, S* pData, size_t nCount)
+{
+	size_t nAt = msg.body.size() - nCount * sizeof(S);
+	std::memcpy(pData, msg.body.data() + nAt, nCount * sizeof(S));
+	msg.body.resize(nAt);
+	msg.header.size = msg.size();
+}
+
+// The items go in backwards so they pop out in order, each one field by field the way handlers are written today
+static void EncodePlain(const zone_desc& zone, bench_message& msg)
+{
+	for (size_t i = zone.vItems.size(); i-- > 0;)
+	{
+		const item_desc& item = zone.vItems[i];
+		PushVector(msg, item.vTags.data(), item.vTags.size());
+		PushVector(msg, item.sName.data(), item.sName.size());
+		msg << item.fWeight << item.nCount << item.nId;
+	}
+	msg << uint32_t(zone.vItems.size());
+	PushVector(msg, zone.vBounds.data(), zone.vBounds.size());
+	PushVector(msg, zone.sName.data(), zone.sName.size());
+	msg << zone.nId;
+}
+
+static void DecodePlain(bench_message& msg, zone_desc& zone)
+{
+	uint32_t nSize = 0;
+	msg >> zone.nId;
+	msg >> nSize;
+	zone.sName.resize(nSize);
+	PopVector(msg, &zone.sName[0], nSize);
+	msg >> nSize;
+	zone.vBounds.resize(nSize);
+	PopVector(msg, zone.vBounds.data(), nSize);
+	msg >> nSize;
+	zone.vItems.resize(nSize);
+	for (auto& item : zone.vItems)
+	{
+		msg >> item.nId >> item.nCount >> item.fWeight;
+		msg >> nSize;
+		item.sName.resize(nSize);
+		PopVector(msg, &item.sName[0], nSize);
+		msg >> nSize;
+		item.vTags.resize(nSize);
+		PopVector(msg, item.vTags.data(), nSize);
+	}
+}
+
+static void EncodeTable(const zone_desc& zone, netmsg::net::table_builder& builder, std::vector<uint32_t>& vItems, bench_message& msg)
+{
+	vItems.clear();
+	for (const auto& item : zone.vItems)
+	{
+		uint32_t nName = builder.CreateString(item.sName);
+		uint32_t nTags = builder.CreateVector(item.vTags);
+		builder.StartTable(item_table::Slots);
+		builder.AddScalar(item_table::Id, item.nId);
+		builder.AddScalar(item_table::Count, item.nCount);
+		builder.AddScalar(item_table::Weight, item.fWeight);
+		builder.AddReference(item_table::Name, nName);
+		builder.AddReference(item_table::Tags, nTags);
+		vItems.push_back(builder.EndTable());
+	}
+	uint32_t nItems = builder.CreateTableVector(vItems);
+	uint32_t nBounds = builder.CreateVector(zone.vBounds);
+	uint32_t nName = builder.CreateString(zone.sName);
+	builder.StartTable(zone_table::Slots);
+	builder.AddScalar(zone_table::Id, zone.nId);
+	builder.AddReference(zone_table::Name, nName);
+	builder.AddReference(zone_table::Bounds, nBounds);
+	builder.AddReference(zone_table::Items, nItems);
+	builder.Finish(builder.EndTable(), msg);
+}
+
+// Touches every field, so the compiler cannot leave any read out
+static uint64_t SumPlain(const zone_desc& zone)
+{
+	uint64_t nSum = zone.nId + zone.sName.size() + uint64_t(zone.vBounds[0]);
+	for (const auto& item : zone.vItems)
+	{
+		nSum += item.nId + item.nCount + uint64_t(item.fWeight) + item.sName.size() + item.vTags[0];
+	}
+	return nSum;
+}
+
+static uint64_t SumTable(const zone_table& zone)
+{
+	uint64_t nSum = zone.ZoneId() + zone.ZoneName().size() + uint64_t(zone.ZoneBounds()[0]);
+	auto vItems = zone.ZoneItems();
+	for (uint32_t i = 0; i < vItems.size(); i++)
+	{
+		item_table item{ vItems[i] };
+		nSum += item.ItemId() + item.ItemCount() + uint64_t(item.ItemWeight()) + item.ItemName().size() + item.ItemTags()[0];
+	}
+	return nSum;
+}
+
+struct run_result
+{
+	double dEncodeNs = 0.0;
+	double dReadNs = 0.0;
+	uint64_t nCheck = 0;
+	size_t nBytes = 0;
+};
+
+// Encodes nMessages copies, then times the read of every one of them, the way a server handles a stream of received bodies
+template <typename FEncode, typename FRead>
+static run_result Run(size_t nMessages, FEncode&& fnEncode, FRead&& fnRead)
+{
+	run_result r;
+	std::vector<bench_message> vMessages(nMessages);
+
+	auto t0 = bench_clock::now();
+	for (auto& msg : vMessages)
+	{
+		msg.header.id = TableMsgTypes::ZoneDescription;
+		fnEncode(msg);
+	}
+	auto t1 = bench_clock::now();
+	r.nBytes = vMessages[0].body.size();
+	for (auto& msg : vMessages)
+	{
+		r.nCheck += fnRead(msg);
+	}
+	auto t2 = bench_clock::now();
+
+	r.dEncodeNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / double(nMessages);
+	r.dReadNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / double(nMessages);
+	return r;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nItems = argc > 1 ? std::stoul(argv[1]) : 256;
+	size_t nMessages = argc > 2 ? std::stoul(argv[2]) : 2000;
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> distLetter('a', 'z');
+	std::uniform_int_distribution<int> distLength(6, 16);
+	std::uniform_int_distribution<int> distSmall(0, 999);
+
+	zone_desc zone;
+	zone.nId = 17;
+	zone.sName = "Northern harbor";
+	zone.vBounds = { -500.0f, 0.0f, -500.0f, 500.0f, 200.0f, 500.0f };
+	for (size_t i = 0; i < nItems; i++)
+	{
+		item_desc item;
+		item.nId = uint32_t(1000 + i);
+		item.nCount = uint16_t(distSmall(rng));
+		item.fWeight = float(distSmall(rng)) / 10.0f;
+		for (int c = distLength(rng); c > 0; c--)
+		{
+			item.sName.push_back(char(distLetter(rng)));
+		}
+		item.vTags = { uint16_t(distSmall(rng)), uint16_t(distSmall(rng)), uint16_t(distSmall(rng)), uint16_t(distSmall(rng)) };
+		zone.vItems.push_back(std::move(item));
+	}
+	const uint32_t nProbe = uint32_t(nItems / 2);
+
+	netmsg::net::table_builder builder(nItems * 64);
+	std::vector<uint32_t> vItemOffsets;
+	auto fnEncodeTable = [&](bench_message& msg) { EncodeTable(zone, builder, vItemOffsets, msg); };
+	auto fnEncodePlain = [&](bench_message& msg) { EncodePlain(zone, msg); };
+
+	std::cout << nItems << " items per zone, " << nMessages << " messages\n";
+	std::cout << std::left << std::setw(30) << "read" << std::setw(10) << "bytes" << std::setw(14) << "encode ns" << "read ns\n";
+	auto fnPrint = [](const char* sName, const run_result& r)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(30) << sName << std::setw(10) << r.nBytes
+			<< std::setw(14) << r.dEncodeNs << r.dReadNs << "\n";
+	};
+
+	fnPrint("plain, decode all", Run(nMessages, fnEncodePlain, [](bench_message& msg)
+		{
+			zone_desc decoded;
+			DecodePlain(msg, decoded);
+			return SumPlain(decoded);
+		}));
+	fnPrint("plain, decode for one item", Run(nMessages, fnEncodePlain, [nProbe](bench_message& msg)
+		{
+			zone_desc decoded;
+			DecodePlain(msg, decoded);
+			return uint64_t(decoded.vItems[nProbe].nCount);
+		}));
+	fnPrint("table, verify + read all", Run(nMessages, fnEncodeTable, [](bench_message& msg)
+		{
+			netmsg::net::table_verifier verifier(msg);
+			return verifier.VerifyRoot<zone_table>() ? SumTable(zone_table{ netmsg::net::table_view::Root(msg) }) : 0;
+		}));
+	fnPrint("table, verify + read one", Run(nMessages, fnEncodeTable, [nProbe](bench_message& msg)
+		{
+			netmsg::net::table_verifier verifier(msg);
+			if (!verifier.VerifyRoot<zone_table>())
+			{
+				return uint64_t(0);
+			}
+			return uint64_t(item_table{ zone_table{ netmsg::net::table_view::Root(msg) }.ZoneItems()[nProbe] }.ItemCount());
+		}));
+	fnPrint("table, trusted read one", Run(nMessages, fnEncodeTable, [nProbe](bench_message& msg)
+		{
+			return uint64_t(item_table{ zone_table{ netmsg::net::table_view::Root(msg) }.ZoneItems()[nProbe] }.ItemCount());
+		}));
+	return 0;
+}
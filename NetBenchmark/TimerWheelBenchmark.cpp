@@ -0,0 +1,177 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <msg_net.h>
+
+// Timer churn benchmark, the pattern of a busy server where every connection keeps moving its deadlines (a heartbeat or an idle
+// timeout pushed back on activity, a handshake deadline cancelled once validated). The same churn is run on the timing wheel
+// of the framework and on one asio::steady_timer per connection, which is what the connections used before the wheel:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/TimerWheelBenchmark.cpp -pthread -o bench_timers
+//
+// Usage: TimerWheelBenchmark [timers] [rounds]
+
+using bench_clock = std::chrono::steady_clock;
+
+static double NanosecondsPer(bench_clock::time_point tStart, bench_clock::time_point tEnd, size_t nOperations)
+{
+	return std::chrono::duration<double, std::nano>(tEnd - tStart).count() / double(nOperations);
+}
+
+struct ChurnResult
+{
+	double dScheduleNs = 0.0;
+	double dRescheduleNs = 0.0;
+	double dCancelNs = 0.0;
+	double dExpireNs = 0.0;
+	size_t nFired = 0;
+};
+
+static void OnWheelTimer(netmsg::net::wheel_timer& timer)
+{
+	(*static_cast<size_t*>(timer.pOwner))++;
+}
+
+// The wheel is driven by hand with Advance, so the measurement is the data structure and not the sleeping of the tick timer
+static ChurnResult RunWheel(const std::vector<uint32_t>& vDelays, size_t nRounds)
+{
+	asio::io_context context;
+	netmsg::net::timing_wheel wheel(context);
+	std::vector<netmsg::net::wheel_timer> vTimers(vDelays.size());
+
+	ChurnResult result;
+	for (auto& t : vTimers)
+	{
+		t.fnCallback = &OnWheelTimer;
+		t.pOwner = &result.nFired;
+	}
+
+	auto tStart = bench_clock::now();
+	for (size_t i = 0; i < vTimers.size(); i++)
+	{
+		wheel.Schedule(vTimers[i], std::chrono::milliseconds(vDelays[i]));
+	}
+	auto tEnd = bench_clock::now();
+	result.dScheduleNs = NanosecondsPer(tStart, tEnd, vTimers.size());
+
+	tStart = bench_clock::now();
+	for (size_t r = 0; r < nRounds; r++)
+	{
+		for (size_t i = 0; i < vTimers.size(); i++)
+		{
+			wheel.Schedule(vTimers[i], std::chrono::milliseconds(vDelays[(i + r + 1) % vDelays.size()]));
+		}
+	}
+	tEnd = bench_clock::now();
+	result.dRescheduleNs = NanosecondsPer(tStart, tEnd, vTimers.size() * nRounds);
+
+	// Half of the timers are cancelled, the other half is left to expire
+	tStart = bench_clock::now();
+	for (size_t i = 0; i < vTimers.size(); i += 2)
+	{
+		wheel.Cancel(vTimers[i]);
+	}
+	tEnd = bench_clock::now();
+	result.dCancelNs = NanosecondsPer(tStart, tEnd, (vTimers.size() + 1) / 2);
+
+	size_t nExpiring = wheel.Size();
+	tStart = bench_clock::now();
+	while (wheel.Size() > 0)
+	{
+		wheel.Advance(1);
+	}
+	tEnd = bench_clock::now();
+	result.dExpireNs = NanosecondsPer(tStart, tEnd, std::max<size_t>(1, nExpiring));
+	return result;
+}
+
+// Every asio timer operation goes through the timer queue of the context (a heap) and every cancellation or expiry goes
+// through a completion handler, the run() calls are counted in the operation they complete
+static ChurnResult RunSteadyTimers(const std::vector<uint32_t>& vDelays, size_t nRounds)
+{
+	asio::io_context context;
+	std::vector<std::unique_ptr<asio::steady_timer>> vTimers;
+	for (size_t i = 0; i < vDelays.size(); i++)
+	{
+		vTimers.push_back(std::make_unique<asio::steady_timer>(context));
+	}
+
+	ChurnResult result;
+	auto fnHandler = [&result](std::error_code ec)
+	{
+		if (!ec)
+		{
+			result.nFired++;
+		}
+	};
+
+	auto tStart = bench_clock::now();
+	for (size_t i = 0; i < vTimers.size(); i++)
+	{
+		vTimers[i]->expires_after(std::chrono::milliseconds(vDelays[i]));
+		vTimers[i]->async_wait(fnHandler);
+	}
+	auto tEnd = bench_clock::now();
+	result.dScheduleNs = NanosecondsPer(tStart, tEnd, vTimers.size());
+
+	// Moving a deadline cancels the pending wait, which has to run its handler, and starts a new one
+	tStart = bench_clock::now();
+	for (size_t r = 0; r < nRounds; r++)
+	{
+		for (size_t i = 0; i < vTimers.size(); i++)
+		{
+			vTimers[i]->expires_after(std::chrono::milliseconds(vDelays[(i + r + 1) % vDelays.size()]));
+			vTimers[i]->async_wait(fnHandler);
+		}
+		context.poll();
+	}
+	tEnd = bench_clock::now();
+	result.dRescheduleNs = NanosecondsPer(tStart, tEnd, vTimers.size() * nRounds);
+
+	tStart = bench_clock::now();
+	for (size_t i = 0; i < vTimers.size(); i += 2)
+	{
+		vTimers[i]->cancel();
+	}
+	context.poll();
+	tEnd = bench_clock::now();
+	result.dCancelNs = NanosecondsPer(tStart, tEnd, (vTimers.size() + 1) / 2);
+
+	// The asio timers expire on the real clock, so this part includes the time spent waiting for the last deadline and is only
+	// printed for reference. The few short timers that already expired while rescheduling are counted as fired too
+	tStart = bench_clock::now();
+	context.run();
+	tEnd = bench_clock::now();
+	result.dExpireNs = NanosecondsPer(tStart, tEnd, std::max<size_t>(1, vTimers.size() / 2));
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nTimers = argc > 1 ? std::stoul(argv[1]) : 100000;
+	size_t nRounds = argc > 2 ? std::stoul(argv[2]) : 10;
+
+	// Deadlines spread like the ones of a server, from short handshake timeouts to heartbeats of a few seconds
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<uint32_t> dist(10, 5000);
+	std::vector<uint32_t> vDelays(nTimers);
+	for (auto& d : vDelays)
+	{
+		d = dist(rng);
+	}
+
+	std::cout << nTimers << " timers, " << nRounds << " reschedule rounds\n";
+	std::cout << std::left << std::setw(14) << "timers" << std::setw(14) << "schedule ns" << std::setw(16) << "reschedule ns"
+		<< std::setw(12) << "cancel ns" << std::setw(12) << "expire ns" << "fired\n";
+
+	auto fnPrint = [](const char* sName, const ChurnResult& r)
+	{
+		std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(14) << sName << std::setw(14) << r.dScheduleNs
+			<< std::setw(16) << r.dRescheduleNs << std::setw(12) << r.dCancelNs << std::setw(12) << r.dExpireNs << r.nFired << "\n";
+	};
+
+	fnPrint("timing_wheel", RunWheel(vDelays, nRounds));
+	fnPrint("steady_timer", RunSteadyTimers(vDelays, nRounds));
+	return 0;
+}
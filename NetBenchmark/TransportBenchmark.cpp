@@ -0,0 +1,214 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <ctime>
+#include <msg_net.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// The same echo server and clients run on every transport of net_transport.h, inside this one process. TCP pays for the
+// whole kernel network stack, a Unix domain socket only for the system calls and the copies through the kernel, and the
+// in-process loopback for none of it, so the loopback rows are what the framework itself costs (the queues, the handlers,
+// the allocations) and the difference with the other rows is what the kernel adds:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetBenchmark/TransportBenchmark.cpp -pthread -o bench_transports
+//
+// Usage: TransportBenchmark [messages per scenario] [port]
+
+enum class TransportMsgTypes : uint32_t
+{
+	ServerAccept,
+	Echo,
+};
+
+using bench_clock = std::chrono::steady_clock;
+using bench_message = netmsg::net::message<TransportMsgTypes>;
+
+template <typename Transport>
+class EchoServer : public netmsg::net::server_interface<TransportMsgTypes, Transport>
+{
+public:
+	EchoServer(const typename Transport::address& address, const netmsg::net::server_options& options)
+		: netmsg::net::server_interface<TransportMsgTypes, Transport>(address, options)
+	{
+
+	}
+
+	// Pushes an empty message with no owner, it wakes up the update thread blocked on the incoming queue so it can finish
+	void Wake()
+	{
+		this->m_qMessagesIn.push_back({ {}, {} });
+	}
+
+protected:
+	bool OnClientConnect(std::shared_ptr<netmsg::net::connection<TransportMsgTypes, Transport>>) override
+	{
+		return true;
+	}
+
+	void OnClientValidated(std::shared_ptr<netmsg::net::connection<TransportMsgTypes, Transport>> client) override
+	{
+		bench_message msg;
+		msg.header.id = TransportMsgTypes::ServerAccept;
+		client->Send(msg);
+	}
+
+	void OnMessage(std::shared_ptr<netmsg::net::connection<TransportMsgTypes, Transport>> client, bench_message& msg) override
+	{
+		if (client && msg.header.id == TransportMsgTypes::Echo)
+		{
+			client->Send(std::move(msg));
+		}
+	}
+};
+
+// Nagle only exists for TCP, the other transports ignore the option
+static netmsg::net::socket_options BenchSocketOptions()
+{
+	netmsg::net::socket_options options;
+	options.bNoDelay = true;
+	return options;
+}
+
+// Process CPU time (user + system) in microseconds, it includes both the server and the client threads
+static double ProcessCpuMicroseconds()
+{
+#if defined(__linux__) || defined(__APPLE__)
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#else
+	return double(std::clock()) * 1e6 / CLOCKS_PER_SEC;
+#endif
+}
+
+struct scenario_result
+{
+	double dMessagesPerSecond = 0.0;
+	double dP50Micro = 0.0;
+	double dP99Micro = 0.0;
+	double dCpuMicroPerMessage = 0.0;
+};
+
+// One client keeps nWindow echoes in flight, every returning echo records its round trip and releases the next one. The send
+// time is the last thing in the body, the payload in front of it is filler
+template <typename Transport>
+static scenario_result RunScenario(netmsg::net::client_interface<TransportMsgTypes, Transport>& client, size_t nPayload, size_t nWindow, size_t nMessages)
+{
+	auto fnSend = [&]()
+	{
+		netmsg::net::message_builder<TransportMsgTypes> builder(TransportMsgTypes::Echo, nPayload + sizeof(uint64_t));
+		builder.Message().body.resize(nPayload);
+		builder << uint64_t(bench_clock::now().time_since_epoch().count());
+		client.Send(std::move(builder));
+	};
+
+	std::vector<uint64_t> vLatencies;
+	vLatencies.reserve(nMessages);
+
+	double dCpuStart = ProcessCpuMicroseconds();
+	auto tStart = bench_clock::now();
+	size_t nSent = 0;
+	for (; nSent < std::min(nWindow, nMessages); nSent++)
+	{
+		fnSend();
+	}
+
+	while (vLatencies.size() < nMessages)
+	{
+		client.Incoming().wait();
+		bench_message msg = client.Incoming().pop_front().msg;
+
+		uint64_t nThen = 0;
+		msg >> nThen;
+		vLatencies.push_back(uint64_t(bench_clock::now().time_since_epoch().count()) - nThen);
+
+		if (nSent < nMessages)
+		{
+			fnSend();
+			nSent++;
+		}
+	}
+	auto tEnd = bench_clock::now();
+	double dCpuEnd = ProcessCpuMicroseconds();
+
+	std::sort(vLatencies.begin(), vLatencies.end());
+	const double dTickMicro = 1e6 * double(bench_clock::period::num) / double(bench_clock::period::den);
+
+	scenario_result result;
+	result.dMessagesPerSecond = double(nMessages) / std::chrono::duration<double>(tEnd - tStart).count();
+	result.dP50Micro = double(vLatencies[vLatencies.size() / 2]) * dTickMicro;
+	result.dP99Micro = double(vLatencies[std::min(vLatencies.size() - 1, vLatencies.size() * 99 / 100)]) * dTickMicro;
+	result.dCpuMicroPerMessage = (dCpuEnd - dCpuStart) / double(nMessages);
+	return result;
+}
+
+// Starts a server on the transport, connects one client to it and runs every scenario
+template <typename Transport>
+static void RunTransport(const typename Transport::address& address, const std::string& sHost, uint16_t nPort, size_t nMessages)
+{
+	netmsg::net::server_options options;
+	options.socket = BenchSocketOptions();
+	options.bLogConnections = false;
+	EchoServer<Transport> server(address, options);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]()
+		{
+			while (bRunning)
+			{
+				server.Update(-1, true);
+			}
+		});
+
+	{
+		netmsg::net::client_interface<TransportMsgTypes, Transport> client;
+		client.Connect(sHost, nPort, BenchSocketOptions());
+		// The validation handshake is not part of the measurement
+		client.Incoming().wait();
+		client.Incoming().pop_front();
+
+		const size_t vPayloads[] = { 16, 1024, 65536 };
+		const size_t vWindows[] = { 1, 32 };
+		for (size_t nWindow : vWindows)
+		{
+			for (size_t nPayload : vPayloads)
+			{
+				scenario_result r = RunScenario(client, nPayload, nWindow, nMessages);
+				std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(12) << Transport::Name() << std::setw(8) << nWindow
+					<< std::setw(8) << nPayload << std::setw(14) << r.dMessagesPerSecond << std::setw(12) << r.dP50Micro
+					<< std::setw(12) << r.dP99Micro << r.dCpuMicroPerMessage << "\n";
+			}
+		}
+	}
+
+	bRunning = false;
+	server.Wake();
+	thrUpdate.join();
+	server.Stop();
+}
+
+int main(int argc, char* argv[])
+{
+	size_t nMessages = argc > 1 ? std::stoul(argv[1]) : 50000;
+	uint16_t nPort = argc > 2 ? uint16_t(std::stoul(argv[2])) : 60400;
+
+	netmsg::net::logger::SetLevel(netmsg::net::log_level::Warning);
+
+	std::cout << nMessages << " messages per scenario\n";
+	std::cout << std::left << std::setw(12) << "transport" << std::setw(8) << "window" << std::setw(8) << "bytes"
+		<< std::setw(14) << "msg/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << "cpu us/msg\n";
+
+	RunTransport<netmsg::net::tcp_transport>(nPort, "127.0.0.1", nPort, nMessages);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+	const std::string sPath = "/tmp/netmsg_transport_benchmark.sock";
+	RunTransport<netmsg::net::unix_transport>(sPath, sPath, 0, nMessages);
+#endif
+	RunTransport<netmsg::net::loopback_transport>("transport_benchmark", "transport_benchmark", 0, nMessages);
+	return 0;
+}
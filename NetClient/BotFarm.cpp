@@ -0,0 +1,305 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <random>
+#include <atomic>
+#include <msg_net.h>
+
+// Headless load generator, thousands of simulated players against a running server from a single machine. The bots do not own
+// a context or a thread each like an interactive client does, they share a few contexts and a single incoming queue, so the
+// limit is the amount of sockets and not the amount of threads:
+//
+//   g++ -std=c++17 -O2 -I NetCommon -I <asio>/include NetClient/BotFarm.cpp -pthread -o botfarm
+//
+// Usage: BotFarm [host] [port] [bots] [contexts] [seconds] [messages/s per bot] [mix] [state bytes]
+//
+// The mix gives the weight of every kind of message, "ping=70,broadcast=5,state=25" by default. A ping is echoed back by the
+// server and measures the round trip, a broadcast asks the server to message every other client and a state message is a
+// blob of the given size the server just reads, the same as players spamming their position. SimpleServer logs every ping
+// and broadcast on its console, which becomes its bottleneck long before the network does
+
+// Same ids as SimpleServer, the state message comes after them so the server just ignores it
+enum class CustomMsgTypes : uint32_t
+{
+	ServerAccept,
+	ServerDeny,
+	ServerPing,
+	MessageAll,
+	ServerMessage,
+	ClientState,
+};
+
+using bot = netmsg::net::client_interface<CustomMsgTypes>;
+using bot_clock = std::chrono::steady_clock;
+
+struct bot_mix
+{
+	uint32_t nPing = 70;
+	uint32_t nBroadcast = 5;
+	uint32_t nState = 25;
+
+	// Parses "kind=weight" pairs separated by commas, the kinds left out get a weight of 0
+	static bot_mix Parse(const std::string& sMix)
+	{
+		bot_mix mix{ 0, 0, 0 };
+		std::stringstream ss(sMix);
+		std::string sItem;
+		while (std::getline(ss, sItem, ','))
+		{
+			size_t nEqual = sItem.find('=');
+			if (nEqual == std::string::npos)
+			{
+				throw std::invalid_argument("Bad mix entry: " + sItem);
+			}
+
+			std::string sKind = sItem.substr(0, nEqual);
+			uint32_t nWeight = uint32_t(std::stoul(sItem.substr(nEqual + 1)));
+			if (sKind == "ping") mix.nPing = nWeight;
+			else if (sKind == "broadcast") mix.nBroadcast = nWeight;
+			else if (sKind == "state") mix.nState = nWeight;
+			else throw std::invalid_argument("Unknown message kind: " + sKind);
+		}
+
+		if (mix.Total() == 0)
+		{
+			throw std::invalid_argument("The mix has no weight");
+		}
+		return mix;
+	}
+
+	uint32_t Total() const
+	{
+		return nPing + nBroadcast + nState;
+	}
+};
+
+// Counters of the receiving thread, only read by the main thread once it is done
+struct bot_results
+{
+	std::vector<uint64_t> vRoundTrips;
+	uint64_t nBroadcastsReceived = 0;
+	uint64_t nDenied = 0;
+};
+
+static double Percentile(const std::vector<uint64_t>& vSorted, double dPercent)
+{
+	if (vSorted.empty())
+	{
+		return 0.0;
+	}
+	size_t nIndex = std::min(vSorted.size() - 1, size_t(double(vSorted.size()) * dPercent / 100.0));
+	return double(vSorted[nIndex]) / 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		std::string sHost = argc > 1 ? argv[1] : "127.0.0.1";
+		uint16_t nPort = argc > 2 ? uint16_t(std::stoul(argv[2])) : 60000;
+		size_t nBots = argc > 3 ? std::stoul(argv[3]) : 1000;
+		size_t nContexts = std::max<size_t>(1, argc > 4 ? std::stoul(argv[4]) : 4);
+		size_t nSeconds = argc > 5 ? std::stoul(argv[5]) : 10;
+		double dRate = argc > 6 ? std::stod(argv[6]) : 1.0;
+		bot_mix mix = argc > 7 ? bot_mix::Parse(argv[7]) : bot_mix();
+		size_t nStateBytes = argc > 8 ? std::stoul(argv[8]) : 64;
+
+		// The queue is declared before the contexts, connections still finishing on a context thread write into it
+		netmsg::net::tsqueue<netmsg::net::owned_message<CustomMsgTypes>> qIn;
+
+		// Every context gets a work guard so its thread keeps running while its bots are still connecting
+		std::vector<std::unique_ptr<asio::io_context>> vContexts;
+		std::vector<asio::executor_work_guard<asio::io_context::executor_type>> vGuards;
+		std::vector<std::thread> vThreads;
+		for (size_t i = 0; i < nContexts; i++)
+		{
+			vContexts.push_back(std::make_unique<asio::io_context>());
+			vGuards.push_back(asio::make_work_guard(*vContexts.back()));
+		}
+		for (size_t i = 0; i < nContexts; i++)
+		{
+			vThreads.emplace_back([&context = *vContexts[i]]() { context.run(); });
+		}
+
+		// The receiving thread handles the messages of every bot, a ping comes back with the time it was sent
+		std::atomic<bool> bReceiving = true;
+		std::atomic<size_t> nAccepted = 0;
+		bot_results results;
+		std::thread thrReceive([&]()
+			{
+				while (bReceiving)
+				{
+					qIn.wait();
+					while (!qIn.empty())
+					{
+						auto msg = qIn.pop_front().msg;
+						switch (msg.header.id)
+						{
+						case CustomMsgTypes::ServerAccept:
+							nAccepted++;
+							break;
+						case CustomMsgTypes::ServerDeny:
+							results.nDenied++;
+							nAccepted++;
+							break;
+						case CustomMsgTypes::ServerPing:
+						{
+							uint64_t nSent = 0;
+							msg >> nSent;
+							results.vRoundTrips.push_back(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+								bot_clock::now().time_since_epoch()).count()) - nSent);
+						}
+						break;
+						case CustomMsgTypes::ServerMessage:
+							results.nBroadcastsReceived++;
+							break;
+						default:
+							break;
+						}
+					}
+				}
+			});
+
+		netmsg::net::socket_options options;
+		options.bNoDelay = true;
+
+		std::cout << "Connecting " << nBots << " bots to " << sHost << ":" << nPort << " on " << nContexts << " contexts\n";
+		std::vector<std::unique_ptr<bot>> vBots;
+		vBots.reserve(nBots);
+		for (size_t i = 0; i < nBots; i++)
+		{
+			vBots.push_back(std::make_unique<bot>(*vContexts[i % nContexts], qIn));
+			vBots.back()->Connect(sHost, nPort, options);
+		}
+
+		// Nothing can be sent before the handshake is over, we wait for every bot to be accepted or for the handshakes to give up
+		auto tConnect = bot_clock::now();
+		while (nAccepted < nBots && bot_clock::now() - tConnect < std::chrono::seconds(30))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		size_t nConnected = 0;
+		for (auto& b : vBots)
+		{
+			nConnected += b->IsConnected() ? 1 : 0;
+		}
+		std::cout << nConnected << " bots connected in " << std::fixed << std::setprecision(2)
+			<< std::chrono::duration<double>(bot_clock::now() - tConnect).count() << "s\n";
+
+		// A single driver sends on a global schedule rather than a thread per bot. Every millisecond it catches up with the
+		// amount of messages the farm should have sent so far, taking the bots in turn
+		std::mt19937 rng{ 42 };
+		std::uniform_int_distribution<uint32_t> distKind(0, mix.Total() - 1);
+		std::vector<uint8_t> vState(nStateBytes, 0x5A);
+		uint64_t nPingsSent = 0, nBroadcastsSent = 0, nStatesSent = 0;
+		const double dTotalRate = dRate * double(nBots);
+		size_t nNextBot = 0;
+		uint64_t nSent = 0;
+
+		auto tStart = bot_clock::now();
+		auto tEnd = tStart + std::chrono::seconds(nSeconds);
+		while (bot_clock::now() < tEnd && nBots > 0)
+		{
+			uint64_t nTarget = uint64_t(std::chrono::duration<double>(bot_clock::now() - tStart).count() * dTotalRate);
+			for (; nSent < nTarget; nSent++)
+			{
+				bot& b = *vBots[nNextBot];
+				nNextBot = (nNextBot + 1) % nBots;
+
+				netmsg::net::message<CustomMsgTypes> msg;
+				uint32_t nKind = distKind(rng);
+				if (nKind < mix.nPing)
+				{
+					msg.header.id = CustomMsgTypes::ServerPing;
+					msg << uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(bot_clock::now().time_since_epoch()).count());
+					nPingsSent++;
+				}
+				else if (nKind < mix.nPing + mix.nBroadcast)
+				{
+					msg.header.id = CustomMsgTypes::MessageAll;
+					nBroadcastsSent++;
+				}
+				else
+				{
+					msg.header.id = CustomMsgTypes::ClientState;
+					msg.body = vState;
+					msg.header.size = uint32_t(msg.body.size());
+					nStatesSent++;
+				}
+				b.Send(msg);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		double dSeconds = std::chrono::duration<double>(bot_clock::now() - tStart).count();
+
+		// The echoes still in flight are given a moment to come back before the receiving thread is stopped
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		bReceiving = false;
+		qIn.push_back({ {}, {} });
+		thrReceive.join();
+
+		// The bots are closed first, then the contexts run out of work once the sockets are done with
+		vBots.clear();
+		vGuards.clear();
+		for (auto& t : vThreads)
+		{
+			t.join();
+		}
+
+		std::sort(results.vRoundTrips.begin(), results.vRoundTrips.end());
+		std::cout << "\nSent over " << std::setprecision(2) << dSeconds << "s: " << nPingsSent << " pings, " << nBroadcastsSent
+			<< " broadcasts, " << nStatesSent << " state messages (" << std::setprecision(0) << double(nSent) / dSeconds << " msg/s)\n";
+		std::cout << "Server echoed " << results.vRoundTrips.size() << " pings (" << double(results.vRoundTrips.size()) / dSeconds
+			<< " msg/s) and delivered " << results.nBroadcastsReceived << " broadcasts (" << double(results.nBroadcastsReceived) / dSeconds
+			<< " msg/s)";
+		if (results.nDenied > 0)
+		{
+			std::cout << ", " << results.nDenied << " bots denied";
+		}
+		std::cout << "\n\n" << std::left << std::setw(12) << "rtt us" << std::setw(12) << "p50" << std::setw(12) << "p90"
+			<< std::setw(12) << "p99" << std::setw(12) << "p99.9" << "max\n";
+		std::cout << std::left << std::setprecision(1) << std::setw(12) << "" << std::setw(12) << Percentile(results.vRoundTrips, 50.0)
+			<< std::setw(12) << Percentile(results.vRoundTrips, 90.0) << std::setw(12) << Percentile(results.vRoundTrips, 99.0)
+			<< std::setw(12) << Percentile(results.vRoundTrips, 99.9) << Percentile(results.vRoundTrips, 100.0) << "\n";
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -15,14 +15,11 @@ class CustomClient : public netmsg::net::client_interface<CustomMsgTypes>
 public:
 	void PingServer()
 	{
-		netmsg::net::message<CustomMsgTypes> msg;
-		msg.header.id = CustomMsgTypes::ServerPing;
-
-		// grabs a time point from the chrono library, then we will send this time to the server, it will be then be received and the latency will be registered in an additional process on the server
-		std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
-		// time added to the message
-		msg << timeNow;
-		Send(msg);
+		// grabs a time point from the chrono library, then we will send this time to the server, it will be then be received and the latency will be registered in an additional process on the server. 
+		// the steady clock is used as the system clock can jump while the ping is in flight
+		std::chrono::steady_clock::time_point timeNow = std::chrono::steady_clock::now();
+		// the message is built in place with the time added to it, and handed over to the connection without a copy
+		Send(netmsg::net::message_builder<CustomMsgTypes>(CustomMsgTypes::ServerPing, sizeof(timeNow)) << timeNow);
 	}
 
 	void MessageAll()
@@ -36,7 +33,10 @@ public:
 int main()
 {
 	CustomClient c;
-	c.Connect("127.0.0.1", 60000);
+	// the framework probes the round trip every second on its own, the ping key shows both measurements
+	netmsg::net::socket_options options;
+	options.tPing = std::chrono::milliseconds(1000);
+	c.Connect("127.0.0.1", 60000, options);
 
 	// windows specific approach to use asynchronous key states checked constantly on the loop for  the client to trigger functions which will interact with the server or even to other clients too
 	bool key[3] = { false, false, false };
@@ -79,10 +79,12 @@ int main()
 				case CustomMsgTypes::ServerPing:
 				{
 					// using the PingServer function, it substracts the time registered on the clients side and creates a new one to measure the latency between server/client, casted on a double primitive type for readbility
-					std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
-					std::chrono::system_clock::time_point timeThen;
+					std::chrono::steady_clock::time_point timeNow = std::chrono::steady_clock::now();
+					std::chrono::steady_clock::time_point timeThen;
 					msg >> timeThen;
-					std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() << "\n";
+					netmsg::net::rtt_stats rtt = c.GetRtt();
+					std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() << " (smoothed "
+						<< rtt.tSmoothed.count() / 1e6 << " +/- " << rtt.tVariance.count() / 1e6 << ")\n";
 				}
 				break;
 
@@ -5,5 +5,28 @@
 #include "net_client.h"
 #include "net_server.h"
 #include "net_connection.h"
+#include "net_pool.h"
+#include "net_session.h"
+#include "net_shard.h"
+#include "net_timer.h"
+#include "net_ratelimit.h"
+#include "net_capture.h"
+#include "net_relay.h"
+#include "net_channel.h"
+#include "net_jitter.h"
+#include "net_rtt.h"
+#include "net_stream.h"
+#include "net_router.h"
+#include "net_trace.h"
+#include "net_log.h"
+#include "net_handle.h"
+#include "net_entity.h"
+#include "net_shm.h"
+#include "net_transport.h"
+#include "net_loopback.h"
+#include "net_lod.h"
+#include "net_bitpack.h"
+#include "net_table.h"
+#include "net_batch.h"
 
 
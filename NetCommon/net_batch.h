@@ -0,0 +1,226 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_transport.h"
+
+#include <array>
+#include <unordered_map>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// The messages of one identifier drained by one Update, kept as parallel arrays: the sender of each message, the
+		// message itself and its trace. A handler of the batch walks them as plain arrays, in the order they arrived
+		template <typename T, typename Connection = connection<T>>
+		class message_batch
+		{
+		public:
+			T Id() const
+			{
+				return m_id;
+			}
+
+			size_t size() const
+			{
+				return m_vMessages.size();
+			}
+
+			bool empty() const
+			{
+				return m_vMessages.empty();
+			}
+
+			std::shared_ptr<Connection>& Client(size_t i)
+			{
+				return m_vClients[i];
+			}
+
+			message<T>& Message(size_t i)
+			{
+				return m_vMessages[i];
+			}
+
+			// Trace of a sampled message, 0 for the others
+			uint64_t Trace(size_t i) const
+			{
+				return m_vTraces[i];
+			}
+
+			std::shared_ptr<Connection>* Clients()
+			{
+				return m_vClients.data();
+			}
+
+			message<T>* Messages()
+			{
+				return m_vMessages.data();
+			}
+
+		private:
+			void Push(const std::shared_ptr<Connection>& client, message<T>&& msg, uint64_t nTrace)
+			{
+				m_vClients.push_back(client);
+				m_vMessages.push_back(std::move(msg));
+				m_vTraces.push_back(nTrace);
+			}
+
+			// The arrays keep their capacity, a batch of the same identifier next tick does not allocate them again
+			void Clear()
+			{
+				m_vClients.clear();
+				m_vMessages.clear();
+				m_vTraces.clear();
+			}
+
+		private:
+			T m_id{};
+			std::vector<std::shared_ptr<Connection>> m_vClients;
+			std::vector<message<T>> m_vMessages;
+			std::vector<uint64_t> m_vTraces;
+
+			template <typename U, typename V>
+			friend class message_batcher;
+		};
+
+		// Groups the messages drained by Update by identifier (server_options::bBatchMessages). The batches are handed out in
+		// the order their identifier first showed up during the drain. The batches of the identifiers below nDenseIds are kept 
+		// from one Update to the next with their capacity, so a steady mix of messages stops allocating after the first few 
+		// ticks. The identifiers above, which a client can pick among billions, only get a batch for the Update they show up 
+		// in, so the memory of the batcher is bounded by the dense table and by what one Update drains. It belongs to the 
+		// thread running Update
+		template <typename T, typename Connection = connection<T>>
+		class message_batcher
+		{
+		public:
+			void Push(const std::shared_ptr<Connection>& client, message<T>&& msg, uint64_t nTrace = 0)
+			{
+				using U = typename detail::id_integer<T>::type;
+				U nKey = U(msg.header.id);
+				size_t nDense = size_t(typename std::make_unsigned<U>::type(nKey));
+				uint32_t nIndex = nNoBatch;
+				if (nDense < nDenseIds)
+				{
+					nIndex = m_vDense[nDense];
+					if (nIndex == nNoBatch)
+					{
+						nIndex = uint32_t(m_vBatches.size());
+						m_vDense[nDense] = nIndex;
+						m_vBatches.emplace_back();
+						m_vBatches.back().m_id = msg.header.id;
+					}
+				}
+				else
+				{
+					auto it = m_mapSparse.find(nKey);
+					if (it != m_mapSparse.end())
+					{
+						nIndex = it->second;
+					}
+					else
+					{
+						nIndex = uint32_t(m_vSparse.size()) | nSparse;
+						m_mapSparse.emplace(nKey, nIndex);
+						m_vSparse.emplace_back();
+						m_vSparse.back().m_id = msg.header.id;
+					}
+				}
+
+				message_batch<T, Connection>& batch = Batch(nIndex);
+				if (batch.empty())
+				{
+					m_vActive.push_back(nIndex);
+				}
+				batch.Push(client, std::move(msg), nTrace);
+			}
+
+			bool empty() const
+			{
+				return m_vActive.empty();
+			}
+
+			// Hands every batch filled since the last call to fn, then empties them. fn must not push
+			template <typename F>
+			void Dispatch(F&& fn)
+			{
+				for (uint32_t nIndex : m_vActive)
+				{
+					fn(Batch(nIndex));
+				}
+				for (uint32_t nIndex : m_vActive)
+				{
+					if (!(nIndex & nSparse))
+					{
+						m_vBatches[nIndex].Clear();
+					}
+				}
+				m_vActive.clear();
+				m_vSparse.clear();
+				m_mapSparse.clear();
+			}
+
+		private:
+			message_batch<T, Connection>& Batch(uint32_t nIndex)
+			{
+				return (nIndex & nSparse) ? m_vSparse[nIndex & ~nSparse] : m_vBatches[nIndex];
+			}
+
+			// The identifiers below nDenseIds, all of them for the usual small enumeration, find their batch with one lookup in
+			// a table as in message_router, the others go through the map of the current Update. Their indices have the top 
+			// bit set
+			static constexpr size_t nDenseIds = 256;
+			static constexpr uint32_t nNoBatch = std::numeric_limits<uint32_t>::max();
+			static constexpr uint32_t nSparse = 0x80000000u;
+
+			// Every dense identifier seen so far has a batch, most of them are empty between two Updates
+			std::vector<message_batch<T, Connection>> m_vBatches;
+			std::array<uint32_t, nDenseIds> m_vDense = MakeDense();
+			// Batches of the other identifiers, dropped at the end of every Dispatch
+			std::vector<message_batch<T, Connection>> m_vSparse;
+			std::unordered_map<typename detail::id_integer<T>::type, uint32_t> m_mapSparse;
+			std::vector<uint32_t> m_vActive;
+
+			static std::array<uint32_t, nDenseIds> MakeDense()
+			{
+				std::array<uint32_t, nDenseIds> vDense;
+				vDense.fill(nNoBatch);
+				return vDense;
+			}
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
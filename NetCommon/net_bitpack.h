@@ -0,0 +1,434 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <cmath>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Bits needed to tell nValues values apart, 1 at least
+		inline uint32_t BitsFor(uint64_t nValues)
+		{
+			uint32_t nBits = 1;
+			while (nBits < 64 && (uint64_t(1) << nBits) < nValues)
+			{
+				nBits++;
+			}
+			return nBits;
+		}
+
+		// A float quantized over [fMin, fMax] in steps of fPrecision at most. The ranges are built once (usually as static
+		// constants next to the message they describe) and given to every Write and Read, so the amount of bits and the
+		// scales are not worked out again for every value. 32 bits at most, a finer precision is capped
+		struct float_range
+		{
+			float fMin = 0.0f;
+			float fMax = 1.0f;
+			uint32_t nBits = 1;
+			uint32_t nSteps = 1;
+			float fToSteps = 1.0f;
+			float fFromSteps = 1.0f;
+
+			float_range() = default;
+
+			float_range(float fMinimum, float fMaximum, float fPrecision)
+				: fMin(fMinimum), fMax(fMaximum)
+			{
+				double dSteps = std::ceil(double(fMax - fMin) / double(fPrecision));
+				nBits = std::min<uint32_t>(32, BitsFor(uint64_t(std::min(dSteps, 4294967295.0)) + 1));
+				nSteps = nBits == 32 ? 0xFFFFFFFFu : (1u << nBits) - 1;
+				fToSteps = float(double(nSteps) / double(fMax - fMin));
+				fFromSteps = float(double(fMax - fMin) / double(nSteps));
+			}
+		};
+
+		// An integer known to stay within [nMin, nMax], written as its distance from nMin. The distance is written in 32 bits
+		// at most, a range any wider than that cannot be packed and is refused when it is built
+		struct int_range
+		{
+			int64_t nMin = 0;
+			int64_t nMax = 1;
+			uint64_t nSpan = 1;
+			uint32_t nBits = 1;
+
+			int_range() = default;
+
+			int_range(int64_t nMinimum, int64_t nMaximum)
+				: nMin(nMinimum), nMax(nMaximum), nSpan(uint64_t(nMaximum) - uint64_t(nMinimum))
+			{
+				if (nMaximum < nMinimum || nSpan > 0xFFFFFFFFu)
+				{
+					throw std::runtime_error("Integer ranges must have their maximum above their minimum and span 32 bits at most");
+				}
+				nBits = BitsFor(nSpan + 1);
+			}
+		};
+
+		// Writes values into a stream of bits, every value taking only the bits its range needs: a bool is one bit, a health
+		// between 0 and 100 is seven, a coordinate over a kilometer to the centimeter is seventeen instead of the thirty two
+		// of a float. The bits go into a 64 bit scratch word and out to the bytes 32 at a time, in little endian order
+		// whatever the machine, so both ends agree.
+		//
+		// The bytes end up in a message with PushTo, as one block the way operator << pushes any other value, and bit_reader
+		// pops the block back with PopFrom. The writer keeps its buffer between messages, Clear it and use it again
+		class bit_writer
+		{
+		public:
+			bit_writer(size_t nReserveBytes = 256)
+			{
+				m_vBytes.resize(std::max<size_t>(nReserveBytes, 8));
+			}
+
+			void Clear()
+			{
+				m_nBytes = 0;
+				m_nScratch = 0;
+				m_nScratchBits = 0;
+			}
+
+			// Bits written so far
+			size_t Bits() const
+			{
+				return m_nBytes * 8 + m_nScratchBits;
+			}
+
+			// The lowest nBits of nValue, 32 at most
+			void WriteBits(uint32_t nValue, uint32_t nBits)
+			{
+				// Worked on in locals, the stores into the bytes could alias the members and would have them reloaded
+				uint64_t nScratch = m_nScratch | ((uint64_t(nValue) & (0xFFFFFFFFull >> (32 - nBits))) << m_nScratchBits);
+				uint32_t nScratchBits = m_nScratchBits + nBits;
+				if (nScratchBits >= 32)
+				{
+					uint32_t nWord = uint32_t(nScratch);
+					size_t nBytes = m_nBytes;
+					if (nBytes + 4 > m_vBytes.size())
+					{
+						m_vBytes.resize(m_vBytes.size() * 2);
+					}
+					uint8_t* pOut = m_vBytes.data() + nBytes;
+					pOut[0] = uint8_t(nWord);
+					pOut[1] = uint8_t(nWord >> 8);
+					pOut[2] = uint8_t(nWord >> 16);
+					pOut[3] = uint8_t(nWord >> 24);
+					m_nBytes = nBytes + 4;
+					nScratch >>= 32;
+					nScratchBits -= 32;
+				}
+				m_nScratch = nScratch;
+				m_nScratchBits = nScratchBits;
+			}
+
+			void WriteBool(bool bValue)
+			{
+				WriteBits(bValue ? 1u : 0u, 1);
+			}
+
+			// Values out of the range are clamped to it
+			void WriteInt(int64_t nValue, const int_range& range)
+			{
+				nValue = std::min(std::max(nValue, range.nMin), range.nMax);
+				WriteBits(uint32_t(uint64_t(nValue) - uint64_t(range.nMin)), range.nBits);
+			}
+
+			// Rounded to the nearest step, values out of the range are clamped to it
+			void WriteFloat(float fValue, const float_range& range)
+			{
+				float fSteps = (fValue - range.fMin) * range.fToSteps + 0.5f;
+				uint32_t nSteps = 0;
+				if (fSteps >= float(range.nSteps))
+				{
+					nSteps = range.nSteps;
+				}
+				else if (fSteps > 0.0f)
+				{
+					nSteps = uint32_t(fSteps);
+				}
+				WriteBits(nSteps, range.nBits);
+			}
+
+			// A unit quaternion as its three smallest components. The largest one is left out, the reader works it out again
+			// from the length being 1, and its sign is made positive by negating the whole quaternion (q and -q are the same
+			// rotation). The other three lie within +-1/sqrt(2), written with nBits each plus two bits telling which one was
+			// left out: 32 bits in all at the default 10, for an error of about two tenths of a degree at most
+			void WriteQuaternion(float x, float y, float z, float w, uint32_t nBits = 10)
+			{
+				float q[4] = { x, y, z, w };
+				uint32_t nLargest = 0;
+				for (uint32_t i = 1; i < 4; i++)
+				{
+					if (std::abs(q[i]) > std::abs(q[nLargest]))
+					{
+						nLargest = i;
+					}
+				}
+				float fSign = q[nLargest] < 0.0f ? -1.0f : 1.0f;
+
+				const float_range& range = QuaternionRange(m_quaternion, nBits);
+				WriteBits(nLargest, 2);
+				for (uint32_t i = 0; i < 4; i++)
+				{
+					if (i != nLargest)
+					{
+						WriteFloat(q[i] * fSign, range);
+					}
+				}
+			}
+
+			// The bytes written, once the writing is done: the last byte is padded, anything written after it starts on a
+			// new byte the reader does not know about
+			const uint8_t* Data()
+			{
+				Flush();
+				return m_vBytes.data();
+			}
+
+			size_t Size()
+			{
+				Flush();
+				return m_nBytes;
+			}
+
+			// Pushes what was written into the message as one block: the bytes, then their amount on top so the block pops
+			// off the way it went on. The writer can be cleared afterwards
+			template <typename T>
+			void PushTo(message<T>& msg)
+			{
+				Flush();
+				uint32_t nBytes = uint32_t(m_nBytes);
+				msg.body.insert(msg.body.end(), m_vBytes.begin(), m_vBytes.begin() + m_nBytes);
+				msg << nBytes;
+			}
+
+			// Shared with bit_reader, the components other than the largest of a unit quaternion stay within +-1/sqrt(2). The
+			// range is kept in the writer or the reader and only built again when the amount of bits changes
+			static const float_range& QuaternionRange(float_range& cached, uint32_t nBits)
+			{
+				if (cached.nBits != nBits)
+				{
+					const float fLimit = 0.70710678f;
+					cached = float_range(-fLimit, fLimit, 2.0f * fLimit / float((1u << nBits) - 1));
+				}
+				return cached;
+			}
+
+		private:
+			// The bits left in the scratch word go out as whole bytes, the last one padded with zeroes
+			void Flush()
+			{
+				while (m_nScratchBits > 0)
+				{
+					if (m_nBytes == m_vBytes.size())
+					{
+						m_vBytes.resize(m_vBytes.size() * 2);
+					}
+					m_vBytes[m_nBytes++] = uint8_t(m_nScratch);
+					m_nScratch >>= 8;
+					m_nScratchBits = m_nScratchBits > 8 ? m_nScratchBits - 8 : 0;
+				}
+				m_nScratch = 0;
+			}
+
+		private:
+			// Sized ahead and filled up to m_nBytes, growing the vector for every word would cost more than the packing
+			std::vector<uint8_t> m_vBytes;
+			size_t m_nBytes = 0;
+			uint64_t m_nScratch = 0;
+			uint32_t m_nScratchBits = 0;
+			float_range m_quaternion;
+		};
+
+		// Reads back what a bit_writer wrote, with the same ranges in the same order. Reading past the end of the bits is
+		// not an error on the spot: the values read are 0 and Ok turns false, so a message handler reads everything it
+		// expects and checks once at the end whether the message was long enough
+		class bit_reader
+		{
+		public:
+			bit_reader() = default;
+
+			bit_reader(const uint8_t* pData, size_t nBytes)
+			{
+				Reset(pData, nBytes);
+			}
+
+			void Reset(const uint8_t* pData, size_t nBytes)
+			{
+				m_pData = pData;
+				m_nBytes = nBytes;
+				m_nNext = 0;
+				m_nScratch = 0;
+				m_nScratchBits = 0;
+				m_bOverflow = false;
+			}
+
+			// Pops a block pushed by bit_writer::PushTo off the message and reads from it. The reader keeps its own copy of the
+			// block, the message can go on being popped. Returns false, with nothing popped, when the top of the message is
+			// not a block
+			template <typename T>
+			bool PopFrom(message<T>& msg)
+			{
+				uint32_t nBytes = 0;
+				if (msg.body.size() < sizeof(nBytes))
+				{
+					Reset(nullptr, 0);
+					m_bOverflow = true;
+					return false;
+				}
+				std::memcpy(&nBytes, msg.body.data() + msg.body.size() - sizeof(nBytes), sizeof(nBytes));
+				if (size_t(nBytes) + sizeof(nBytes) > msg.body.size())
+				{
+					Reset(nullptr, 0);
+					m_bOverflow = true;
+					return false;
+				}
+
+				size_t nStart = msg.body.size() - sizeof(nBytes) - nBytes;
+				m_vOwned.assign(msg.body.begin() + nStart, msg.body.begin() + nStart + nBytes);
+				msg.body.resize(nStart);
+				msg.header.size = msg.size();
+				Reset(m_vOwned.data(), m_vOwned.size());
+				return true;
+			}
+
+			// False once a read went past the end of the bits
+			bool Ok() const
+			{
+				return !m_bOverflow;
+			}
+
+			uint32_t ReadBits(uint32_t nBits)
+			{
+				if (m_nScratchBits < nBits)
+				{
+					Refill();
+					if (m_nScratchBits < nBits)
+					{
+						m_bOverflow = true;
+						m_nScratch = 0;
+						m_nScratchBits = 0;
+						return 0;
+					}
+				}
+
+				uint32_t nValue = uint32_t(m_nScratch);
+				if (nBits < 32)
+				{
+					nValue &= (1u << nBits) - 1;
+				}
+				m_nScratch >>= nBits;
+				m_nScratchBits -= nBits;
+				return nValue;
+			}
+
+			bool ReadBool()
+			{
+				return ReadBits(1) != 0;
+			}
+
+			// A corrupt stream can hold more than the range in its bits, the value is clamped to the range all the same
+			int64_t ReadInt(const int_range& range)
+			{
+				uint64_t nSteps = std::min<uint64_t>(ReadBits(range.nBits), range.nSpan);
+				return int64_t(uint64_t(range.nMin) + nSteps);
+			}
+
+			float ReadFloat(const float_range& range)
+			{
+				uint32_t nSteps = ReadBits(range.nBits);
+				// The last step is the top of the range exactly, not the sum of the rounded steps
+				return nSteps == range.nSteps ? range.fMax : range.fMin + float(nSteps) * range.fFromSteps;
+			}
+
+			void ReadQuaternion(float& x, float& y, float& z, float& w, uint32_t nBits = 10)
+			{
+				const float_range& range = bit_writer::QuaternionRange(m_quaternion, nBits);
+				uint32_t nLargest = ReadBits(2);
+				float q[4];
+				float fSum = 0.0f;
+				for (uint32_t i = 0; i < 4; i++)
+				{
+					if (i != nLargest)
+					{
+						q[i] = ReadFloat(range);
+						fSum += q[i] * q[i];
+					}
+				}
+				q[nLargest] = std::sqrt(std::max(0.0f, 1.0f - fSum));
+				x = q[0];
+				y = q[1];
+				z = q[2];
+				w = q[3];
+			}
+
+		private:
+			// Tops the scratch word up with the next bytes, four at a time while there are four left
+			void Refill()
+			{
+				while (m_nScratchBits <= 56 && m_nNext < m_nBytes)
+				{
+					if (m_nScratchBits <= 32 && m_nNext + 4 <= m_nBytes)
+					{
+						uint32_t nWord = uint32_t(m_pData[m_nNext]) | (uint32_t(m_pData[m_nNext + 1]) << 8)
+							| (uint32_t(m_pData[m_nNext + 2]) << 16) | (uint32_t(m_pData[m_nNext + 3]) << 24);
+						m_nScratch |= uint64_t(nWord) << m_nScratchBits;
+						m_nScratchBits += 32;
+						m_nNext += 4;
+					}
+					else
+					{
+						m_nScratch |= uint64_t(m_pData[m_nNext]) << m_nScratchBits;
+						m_nScratchBits += 8;
+						m_nNext++;
+					}
+				}
+			}
+
+		private:
+			const uint8_t* m_pData = nullptr;
+			size_t m_nBytes = 0;
+			size_t m_nNext = 0;
+			uint64_t m_nScratch = 0;
+			uint32_t m_nScratchBits = 0;
+			bool m_bOverflow = false;
+			std::vector<uint8_t> m_vOwned;
+			float_range m_quaternion;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
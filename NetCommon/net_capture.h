@@ -0,0 +1,335 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Layout of a capture file. Everything is written in the byte order of the machine and every record starts on an 8 byte 
+		// boundary, so the file can be mapped in memory and the records read in place without any parsing. A capture is meant 
+		// to be replayed on the same kind of machine it was recorded on
+		struct capture_file_header
+		{
+			char sMagic[8] = { 'N', 'M', 'C', 'A', 'P', '0', '1', '\0' };
+			// Wall clock time of the first record in nanoseconds since the epoch, only there for the humans reading the file
+			uint64_t nStartTime = 0;
+			// Size in bytes of the message identifier type of the server that recorded the capture
+			uint32_t nIdSize = 0;
+			uint32_t nReserved = 0;
+		};
+
+		// Each record is followed by the body of the message, padded to the next 8 byte boundary
+		struct capture_record
+		{
+			// Nanoseconds since the start of the capture, taken when the message was fully read from the socket
+			uint64_t nTime = 0;
+			uint32_t nClientID = 0;
+			uint32_t nSize = 0;
+			uint64_t nId = 0;
+		};
+
+		inline size_t CapturePadding(size_t nSize)
+		{
+			return (8 - (nSize & 7)) & 7;
+		}
+
+		// Appends the incoming messages of a server to a capture file. The context thread only copies the record into a memory 
+		// buffer, a writer thread of its own swaps the buffer out and writes it to the file, so a slow disk never stalls the 
+		// sockets. The writer is shared by all the connections of a server and can be appended to from several threads
+		class capture_writer
+		{
+		public:
+			capture_writer(const std::string& sFile, uint32_t nIdSize)
+			{
+				m_pFile = std::fopen(sFile.c_str(), "wb");
+				if (!m_pFile)
+				{
+					throw std::runtime_error("Cannot open capture file " + sFile);
+				}
+
+				capture_file_header header;
+				header.nStartTime = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+				header.nIdSize = nIdSize;
+				std::fwrite(&header, sizeof(header), 1, m_pFile);
+
+				m_vPending.reserve(nFlushSize);
+				m_thrWriter = std::thread([this]() { WriterThread(); });
+			}
+
+			capture_writer(const capture_writer&) = delete;
+			capture_writer& operator=(const capture_writer&) = delete;
+
+			~capture_writer()
+			{
+				{
+					std::scoped_lock lock(m_muxPending);
+					m_bStop = true;
+				}
+				m_cvPending.notify_one();
+				m_thrWriter.join();
+				std::fclose(m_pFile);
+			}
+
+			template <typename T>
+			void Append(uint32_t nClientID, const message<T>& msg)
+			{
+				capture_record record;
+				record.nTime = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_tStart).count());
+				record.nClientID = nClientID;
+				record.nSize = uint32_t(msg.body.size());
+				record.nId = uint64_t(typename detail::id_integer<T>::type(msg.header.id));
+
+				static const uint8_t vZero[8] = {};
+				bool bFlush = false;
+				{
+					std::scoped_lock lock(m_muxPending);
+					const uint8_t* pRecord = reinterpret_cast<const uint8_t*>(&record);
+					m_vPending.insert(m_vPending.end(), pRecord, pRecord + sizeof(record));
+					m_vPending.insert(m_vPending.end(), msg.body.begin(), msg.body.end());
+					m_vPending.insert(m_vPending.end(), vZero, vZero + CapturePadding(msg.body.size()));
+					m_nRecords++;
+					bFlush = m_vPending.size() >= nFlushSize;
+				}
+				if (bFlush)
+				{
+					m_cvPending.notify_one();
+				}
+			}
+
+			uint64_t RecordCount() const
+			{
+				return m_nRecords;
+			}
+
+		private:
+			// The buffer is written out when it is big enough or every 100ms, whichever comes first
+			void WriterThread()
+			{
+				std::vector<uint8_t> vWriting;
+				vWriting.reserve(nFlushSize);
+
+				std::unique_lock<std::mutex> lock(m_muxPending);
+				while (true)
+				{
+					m_cvPending.wait_for(lock, std::chrono::milliseconds(100), [this]() { return m_bStop || m_vPending.size() >= nFlushSize; });
+					std::swap(m_vPending, vWriting);
+					bool bStop = m_bStop;
+
+					lock.unlock();
+					if (!vWriting.empty())
+					{
+						std::fwrite(vWriting.data(), 1, vWriting.size(), m_pFile);
+						std::fflush(m_pFile);
+						vWriting.clear();
+					}
+					if (bStop)
+					{
+						return;
+					}
+					lock.lock();
+				}
+			}
+
+		private:
+			static constexpr size_t nFlushSize = 1 << 20;
+
+			std::FILE* m_pFile = nullptr;
+			std::chrono::steady_clock::time_point m_tStart = std::chrono::steady_clock::now();
+			std::mutex m_muxPending;
+			std::condition_variable m_cvPending;
+			std::vector<uint8_t> m_vPending;
+			std::atomic<uint64_t> m_nRecords = 0;
+			bool m_bStop = false;
+			std::thread m_thrWriter;
+		};
+
+		// One record of a capture as it lies in the file
+		struct capture_view
+		{
+			const capture_record* pRecord = nullptr;
+			const uint8_t* pBody = nullptr;
+
+			template <typename T>
+			message<T> ToMessage() const
+			{
+				message<T> msg;
+				msg.header.id = static_cast<T>(typename detail::id_integer<T>::type(pRecord->nId));
+				msg.body.assign(pBody, pBody + pRecord->nSize);
+				msg.header.size = pRecord->nSize;
+				return msg;
+			}
+		};
+
+		// Reads a capture file in place. On Linux and macOS the file is mapped in memory, elsewhere it is loaded in one go. A 
+		// record cut short at the end of the file (the server was killed while capturing) ends the capture
+		class capture_reader
+		{
+		public:
+			capture_reader(const std::string& sFile)
+			{
+#if defined(__linux__) || defined(__APPLE__)
+				int nFile = ::open(sFile.c_str(), O_RDONLY);
+				if (nFile < 0)
+				{
+					throw std::runtime_error("Cannot open capture file " + sFile);
+				}
+				struct stat info;
+				if (::fstat(nFile, &info) == 0 && info.st_size > 0)
+				{
+					void* pMap = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, nFile, 0);
+					if (pMap != MAP_FAILED)
+					{
+						m_pData = static_cast<const uint8_t*>(pMap);
+						m_nSize = size_t(info.st_size);
+					}
+				}
+				::close(nFile);
+#else
+				std::FILE* pFile = std::fopen(sFile.c_str(), "rb");
+				if (!pFile)
+				{
+					throw std::runtime_error("Cannot open capture file " + sFile);
+				}
+				uint8_t vChunk[65536];
+				size_t nRead = 0;
+				while ((nRead = std::fread(vChunk, 1, sizeof(vChunk), pFile)) > 0)
+				{
+					m_vData.insert(m_vData.end(), vChunk, vChunk + nRead);
+				}
+				std::fclose(pFile);
+				m_pData = m_vData.data();
+				m_nSize = m_vData.size();
+#endif
+
+				capture_file_header expected;
+				if (m_nSize < sizeof(capture_file_header) || std::memcmp(m_pData, expected.sMagic, sizeof(expected.sMagic)) != 0)
+				{
+					Unmap();
+					throw std::runtime_error("Not a capture file " + sFile);
+				}
+				m_nOffset = sizeof(capture_file_header);
+			}
+
+			capture_reader(const capture_reader&) = delete;
+			capture_reader& operator=(const capture_reader&) = delete;
+
+			~capture_reader()
+			{
+				Unmap();
+			}
+
+			const capture_file_header& Header() const
+			{
+				return *reinterpret_cast<const capture_file_header*>(m_pData);
+			}
+
+			// Moves to the next record, false at the end of the capture
+			bool Next(capture_view& view)
+			{
+				if (m_nSize - m_nOffset < sizeof(capture_record))
+				{
+					return false;
+				}
+				const capture_record* pRecord = reinterpret_cast<const capture_record*>(m_pData + m_nOffset);
+				size_t nLength = sizeof(capture_record) + pRecord->nSize + CapturePadding(pRecord->nSize);
+				if (m_nSize - m_nOffset < nLength)
+				{
+					return false;
+				}
+
+				view.pRecord = pRecord;
+				view.pBody = m_pData + m_nOffset + sizeof(capture_record);
+				m_nOffset += nLength;
+				return true;
+			}
+
+			void Rewind()
+			{
+				m_nOffset = sizeof(capture_file_header);
+			}
+
+		private:
+			void Unmap()
+			{
+#if defined(__linux__) || defined(__APPLE__)
+				if (m_pData)
+				{
+					::munmap(const_cast<uint8_t*>(m_pData), m_nSize);
+				}
+#endif
+				m_pData = nullptr;
+				m_nSize = 0;
+			}
+
+		private:
+			const uint8_t* m_pData = nullptr;
+			size_t m_nSize = 0;
+			size_t m_nOffset = 0;
+#if !(defined(__linux__) || defined(__APPLE__))
+			std::vector<uint8_t> m_vData;
+#endif
+		};
+
+		// Pace of a replay, either the timing of the original traffic or as fast as the handlers can take it
+		enum class replay_speed
+		{
+			Original,
+			AsFastAsPossible,
+		};
+
+		struct replay_stats
+		{
+			size_t nMessages = 0;
+			double dSeconds = 0.0;
+			// Part of the time spent inside OnMessage
+			double dHandlerSeconds = 0.0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_connection.h"
+
+#include <unordered_map>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Channels of a server (guild chat, a party, the members of an instance), each of them a dense array of its subscribers 
+		// so a publish only walks the connections that are in it. A subscriber is removed by swapping the last one into its 
+		// place, every connection remembers its slot in each of its channels for that. The registry belongs to the thread 
+		// running Update, like the deque of connections
+		template <typename T, typename Connection = connection<T>>
+		class channel_registry
+		{
+		public:
+			// False if the client was already in the channel
+			bool Subscribe(uint64_t nChannel, const std::shared_ptr<Connection>& client)
+			{
+				auto& vSlots = m_mapMemberships[client.get()];
+				for (auto& slot : vSlots)
+				{
+					if (slot.first == nChannel)
+					{
+						return false;
+					}
+				}
+
+				auto& vMembers = m_mapChannels[nChannel];
+				vSlots.push_back({ nChannel, vMembers.size() });
+				vMembers.push_back(client);
+				return true;
+			}
+
+			bool Unsubscribe(uint64_t nChannel, const Connection* client)
+			{
+				auto it = m_mapChannels.find(nChannel);
+				if (it == m_mapChannels.end())
+				{
+					return false;
+				}
+				size_t nSlot = FindSlot(client, nChannel);
+				if (nSlot == npos)
+				{
+					return false;
+				}
+				Remove(it, nSlot);
+				return true;
+			}
+
+			void UnsubscribeAll(const Connection* client)
+			{
+				auto it = m_mapMemberships.find(client);
+				if (it == m_mapMemberships.end())
+				{
+					return;
+				}
+
+				// Copied out first, removing a member edits the slots of the client
+				auto vSlots = it->second;
+				for (auto& slot : vSlots)
+				{
+					Remove(m_mapChannels.find(slot.first), slot.second);
+				}
+			}
+
+			// Sends one shared message to every subscriber and returns how many it was sent to. The members are checked on 
+			// the way: a connection superseded by a resumed session hands its slot over to its successor, and a closed 
+			// connection leaves the channel unless bKeepClosed is set (its session may still be resumed and must keep 
+			// receiving)
+			size_t Publish(uint64_t nChannel, const shared_message<T>& msg, const Connection* pIgnoreClient, bool bKeepClosed)
+			{
+				auto it = m_mapChannels.find(nChannel);
+				if (it == m_mapChannels.end())
+				{
+					return 0;
+				}
+
+				size_t nSent = 0;
+				size_t i = 0;
+				while (it != m_mapChannels.end() && i < it->second.size())
+				{
+					Connection* client = it->second[i].get();
+					if (client->IsSuperseded())
+					{
+						auto successor = client->GetSuccessor();
+						if (successor && FindSlot(successor.get(), nChannel) == npos)
+						{
+							Replace(nChannel, i, successor);
+						}
+						else
+						{
+							it = Remove(it, i);
+						}
+						continue;
+					}
+
+					if (!client->IsConnected() && !client->IsReplay() && !bKeepClosed)
+					{
+						it = Remove(it, i);
+						continue;
+					}
+
+					if (client != pIgnoreClient)
+					{
+						client->Send(msg);
+						nSent++;
+					}
+					i++;
+				}
+				return nSent;
+			}
+
+			size_t ChannelSize(uint64_t nChannel) const
+			{
+				auto it = m_mapChannels.find(nChannel);
+				return it != m_mapChannels.end() ? it->second.size() : 0;
+			}
+
+			void Clear()
+			{
+				m_mapChannels.clear();
+				m_mapMemberships.clear();
+			}
+
+		private:
+			using channel_map = std::unordered_map<uint64_t, std::vector<std::shared_ptr<Connection>>>;
+			static constexpr size_t npos = size_t(-1);
+
+			size_t FindSlot(const Connection* client, uint64_t nChannel) const
+			{
+				auto it = m_mapMemberships.find(client);
+				if (it != m_mapMemberships.end())
+				{
+					for (auto& slot : it->second)
+					{
+						if (slot.first == nChannel)
+						{
+							return slot.second;
+						}
+					}
+				}
+				return npos;
+			}
+
+			void SetSlot(const Connection* client, uint64_t nChannel, size_t nSlot)
+			{
+				for (auto& slot : m_mapMemberships[client])
+				{
+					if (slot.first == nChannel)
+					{
+						slot.second = nSlot;
+						return;
+					}
+				}
+			}
+
+			void DropSlot(const Connection* client, uint64_t nChannel)
+			{
+				auto it = m_mapMemberships.find(client);
+				if (it == m_mapMemberships.end())
+				{
+					return;
+				}
+				auto& vSlots = it->second;
+				vSlots.erase(std::remove_if(vSlots.begin(), vSlots.end(),
+					[nChannel](const std::pair<uint64_t, size_t>& slot) { return slot.first == nChannel; }), vSlots.end());
+				if (vSlots.empty())
+				{
+					m_mapMemberships.erase(it);
+				}
+			}
+
+			// Swaps the last member into the slot, the channel is dropped with its last member and the end iterator is then 
+			// returned
+			typename channel_map::iterator Remove(typename channel_map::iterator it, size_t nSlot)
+			{
+				auto& vMembers = it->second;
+				DropSlot(vMembers[nSlot].get(), it->first);
+				if (nSlot != vMembers.size() - 1)
+				{
+					vMembers[nSlot] = std::move(vMembers.back());
+					SetSlot(vMembers[nSlot].get(), it->first, nSlot);
+				}
+				vMembers.pop_back();
+
+				if (vMembers.empty())
+				{
+					m_mapChannels.erase(it);
+					return m_mapChannels.end();
+				}
+				return it;
+			}
+
+			void Replace(uint64_t nChannel, size_t nSlot, const std::shared_ptr<Connection>& client)
+			{
+				auto& vMembers = m_mapChannels[nChannel];
+				DropSlot(vMembers[nSlot].get(), nChannel);
+				vMembers[nSlot] = client;
+				m_mapMemberships[client.get()].push_back({ nChannel, nSlot });
+			}
+
+		private:
+			channel_map m_mapChannels;
+			// Slot of each connection in each of its channels, a connection is in a handful of channels at most
+			std::unordered_map<const Connection*, std::vector<std::pair<uint64_t, size_t>>> m_mapMemberships;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
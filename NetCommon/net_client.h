@@ -1,16 +1,27 @@
 #pragma once
 #include "net_common.h"
+#include "net_connection.h"
 
 namespace netmsg
 {
 	namespace net
 	{
-		template<typename T>
+		// The transport (net_transport.h) has to be the one of the server, TCP unless told otherwise
+		template<typename T, typename Transport = tcp_transport>
 		class client_interface
 		{
 		public:
 			// Constructor will just associate the socket with the ASIO context
-			client_interface()
+			client_interface() : m_pOwnContext(std::make_unique<asio::io_context>()), m_context(*m_pOwnContext), m_qMessagesIn(m_qOwnMessagesIn)
+			{
+
+			}
+
+			// Client running on a context shared with many other clients (a load generator simulating thousands of players on a 
+			// few threads). The caller runs the context and owns the queue that receives the messages of all these clients, both 
+			// must outlive the client. The client has no thread of its own, its connection has no heartbeat nor idle timeout 
+			// and a reconnection always starts a new session
+			client_interface(asio::io_context& context, tsqueue<owned_message<T>>& qIn) : m_context(context), m_qMessagesIn(qIn)
 			{
 
 			}
@@ -21,29 +32,72 @@ namespace netmsg
 				Disconnect();
 			}
 
-			// Connects to server with the hostname/ip and port number
-			bool Connect(const std::string& host, const uint16_t port)
+			// Connects to server with the hostname/ip and port number, starting a brand new session
+			bool Connect(const std::string& host, const uint16_t port, const socket_options& options = socket_options())
+			{
+				Disconnect();
+				m_resumeState = session_resume();
+				return OpenConnection(host, port, options);
+			}
+
+			// Transports without ports (a Unix domain socket path, the name of an in-process loopback) only need the address
+			bool Connect(const std::string& sAddress, const socket_options& options = socket_options())
+			{
+				static_assert(!std::is_same_v<Transport, tcp_transport>, "A TCP connection needs a port");
+				return Connect(sAddress, 0, options);
+			}
+
+			// Connects again after the connection dropped, presenting the ticket of the previous session. If the server still 
+			// holds the session the client keeps its identifier and only receives the messages it missed, otherwise it is validated 
+			// as a new client. IsResumed tells which one happened once the first message arrives
+			bool Reconnect(const std::string& host, const uint16_t port, const socket_options& options = socket_options())
+			{
+				Disconnect();
+				return OpenConnection(host, port, options);
+			}
+
+			bool IsResumed() const
 			{
+				return m_connection && m_connection->IsResumed();
+			}
+
+		private:
+			bool OpenConnection(const std::string& host, const uint16_t port, const socket_options& options)
+			{
+				// The context was stopped by the previous disconnection, it is made ready to run again
+				if (m_pOwnContext)
+				{
+					m_context.restart();
+				}
+
 				try
 				{
-					// Resolves the hostname/ip into tangible physical address, the resolver can take an URL, ip address or 
-					// string and uses it to convert the data into the connection
-					asio::ip::tcp::resolver resolver(m_context);
-					// The resolver will be used to create the endpoints of the client connection which will use the host 
-					// physical address and will also use the port number used to connect to it
-					asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
+					// Resolves the hostname/ip into tangible physical address, the endpoints of the client connection are made of 
+					// the host physical address and the port number used to connect to it
+					typename Transport::endpoints endpoints = Transport::Resolve(m_context, host, port);
 
 					// Creates the connection, in this instance we know that the connection is a client, the pointer is 
 					// unique in this context, so as previously stated on the server declaration, it would not be able to have 
 					// more than one pointer to the incoming and outgoing queues.
-					m_connection = std::make_unique<connection<T>>(
-						connection<T>::owner::client,
+					m_connection = std::make_shared<connection<T, Transport>>(
+						connection<T, Transport>::owner::client,
 						m_context,
-						asio::ip::tcp::socket(m_context),
-						m_qMessagesIn);
+						typename Transport::socket(m_context),
+						m_qMessagesIn,
+						m_pOwnContext ? &m_timerWheel : nullptr);
+					m_connection->SetResumeState(m_resumeState);
 
 					// If the endpoint connection works, the connection object will proceed to connect using the endpoint
-					m_connection->ConnectToServer(endpoints);
+					m_connection->ConnectToServer(endpoints, options);
+					if (!m_pOwnContext)
+					{
+						return true;
+					}
+					// The wheel only ticks when the connection has something to time
+					if (options.tHeartbeat.count() > 0 || options.tIdleTimeout.count() > 0 || options.tPing.count() > 0)
+					{
+						m_timerWheel.Start();
+					}
 					// Thread used for the ASIO context to work
 					thrContext = std::thread([this]()
 						{
@@ -53,15 +107,27 @@ namespace netmsg
 				// ASIO comes with a wide setup for different error which will be useful in any kind of scenario as they are prety self explanatory
 				catch (std::exception& e)
 				{
-					std::cerr << "Client Exception: " << e.what() << "/n";
+					NETMSG_LOG_ERROR("Client Exception: " << e.what());
 					return false;
 				}
 				return true;
 			}
 
+		public:
 			// Disconnects the client from the server
 			void Disconnect()
 			{
+				// On a shared context the connection is closed and let go, its pending handlers keep it alive until they have run
+				if (!m_pOwnContext)
+				{
+					if (m_connection)
+					{
+						m_connection->Disconnect();
+						m_connection.reset();
+					}
+					return;
+				}
+
 				if (IsConnected())
 				{
 					m_connection->Disconnect();
@@ -74,8 +140,19 @@ namespace netmsg
 				{
 					thrContext.join();
 				}
+				// The close and the aborted operations of the socket are still queued in the context and they all point to the 
+				// connection, so they are run here on this thread before the connection object is destroyed
+				if (m_connection)
+				{
+					// The ticket is kept for a later reconnection
+					m_resumeState = m_connection->GetResumeState();
+					m_context.restart();
+					m_connection->Disconnect();
+					m_timerWheel.Stop();
+					m_context.run();
+				}
 				// Destroys the connection object
-				m_connection.release();
+				m_connection.reset();
 			}
 
 			// Function will check if the client is connected to a server
@@ -91,6 +168,32 @@ namespace netmsg
 				}
 			}
 
+			// Round trip to the server and offset of its clock, see connection::GetRtt
+			rtt_stats GetRtt() const
+			{
+				return m_connection ? m_connection->GetRtt() : rtt_stats();
+			}
+
+			// Probes the round trip now, on a shared context this is the only way to measure it
+			void Ping()
+			{
+				if (IsConnected())
+				{
+					m_connection->Ping();
+				}
+			}
+
+			// Sends a payload of any size in pieces, see connection::SendStream. Returns 0 when not connected
+			uint32_t SendStream(T streamId, std::vector<uint8_t> vData)
+			{
+				return IsConnected() ? m_connection->SendStream(streamId, std::move(vData)) : 0;
+			}
+
+			uint32_t SendStream(T streamId, stream_source fnSource, uint64_t nTotal = 0)
+			{
+				return IsConnected() ? m_connection->SendStream(streamId, std::move(fnSource), nTotal) : 0;
+			}
+
 			void Send(const message<T>& msg)
 			{
 				if (IsConnected())
@@ -99,6 +202,22 @@ namespace netmsg
 				}
 			}
 
+			void Send(message<T>&& msg)
+			{
+				if (IsConnected())
+				{
+					m_connection->Send(std::move(msg));
+				}
+			}
+
+			void Send(message_builder<T>&& builder)
+			{
+				if (IsConnected())
+				{
+					m_connection->Send(std::move(builder));
+				}
+			}
+
 			// The client application will need access to the queue so we make a function to make it public
 			tsqueue<owned_message<T>>& Incoming()
 			{
@@ -106,18 +225,24 @@ namespace netmsg
 			}
 
 		protected:
-			// The client will own the ASIO context
-			asio::io_context m_context;
+			// The client will own the ASIO context, unless it runs on a shared one
+			std::unique_ptr<asio::io_context> m_pOwnContext;
+			asio::io_context& m_context;
+			// Drives the heartbeat and the idle timeout of the connection
+			timing_wheel m_timerWheel{ m_context };
 			// The client ASIO context requires a thread to work on its own to execute its work commands
 			std::thread thrContext;
 			/*// client socket which will be connected to the server
 			asio::ip::tcp::socket m_socket;*/
 			// Single instance for the connection abject which will handle the data transfer
-			std::unique_ptr<connection<T>> m_connection;
+			std::shared_ptr<connection<T, Transport>> m_connection;
+			// Ticket of the last session, presented by Reconnect
+			session_resume m_resumeState;
 
 		private:
-			// Thread-safe queue of incoming messages from the server
-			tsqueue<owned_message<T>> m_qMessagesIn;
+			// Thread-safe queue of incoming messages from the server, or the one shared by all the clients of a shared context
+			tsqueue<owned_message<T>> m_qOwnMessagesIn;
+			tsqueue<owned_message<T>>& m_qMessagesIn;
 		};
 	}
 }
@@ -10,13 +10,68 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <iterator>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #ifdef _WIN32
 #define _WIN32_WINNT 0x0A00
 #endif
 
+// Optional io_uring build mode for Linux, by defining NETMSG_USE_IO_URING before including the framework (or on the compiler 
+// command line) ASIO will route all of the socket I/O through io_uring instead of the default epoll reactor. The program must 
+// be linked against liburing and requires an ASIO version of 1.21 or newer
+#if defined(NETMSG_USE_IO_URING) && defined(__linux__)
+#define ASIO_HAS_IO_URING
+#define ASIO_DISABLE_EPOLL
+#endif
+
 #define ASIO_STANDALONE
 #include <asio.hpp>
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 
+namespace netmsg
+{
+	namespace net
+	{
+		// Reports which I/O backend ASIO was compiled with, so the server and the benchmarks can tell which build mode is in use
+		inline const char* IoBackendName()
+		{
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+			return "io_uring";
+#elif defined(ASIO_HAS_EPOLL)
+			return "epoll";
+#elif defined(ASIO_HAS_KQUEUE)
+			return "kqueue";
+#elif defined(ASIO_HAS_IOCP)
+			return "iocp";
+#else
+			return "select";
+#endif
+		}
+
+		// Pins a thread to a single processor core, used by the sharded server so each shard keeps its caches and its network 
+		// interrupts on the same core. It returns false when the platform does not support it, the thread keeps running anywhere
+		inline bool PinThreadToCore(std::thread& thread, size_t nCore)
+		{
+#if defined(__linux__)
+			cpu_set_t cpuset;
+			CPU_ZERO(&cpuset);
+			CPU_SET(int(nCore % CPU_SETSIZE), &cpuset);
+			return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset) == 0;
+#elif defined(_WIN32)
+			return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << (nCore % (sizeof(DWORD_PTR) * 8))) != 0;
+#else
+			return false;
+#endif
+		}
+	}
+}
+
@@ -3,19 +3,27 @@
 #include "net_common.h"
 #include "net_tsqueue.h"
 #include "net_message.h"
+#include "net_session.h"
+#include "net_timer.h"
+#include "net_ratelimit.h"
+#include "net_capture.h"
+#include "net_relay.h"
+#include "net_rtt.h"
+#include "net_stream.h"
+#include "net_trace.h"
+#include "net_log.h"
+#include "net_transport.h"
 
 namespace netmsg
 {
 	namespace net
 	{
-		//Forward declaration of a server interface
-		template<typename T>
-		class server_interface;
-
 		// The "enable shared from this" will allow us to create a pointer to this object within this object, it also allow us to 
-		// make it a shared pointer rather than a raw one
-		template <typename T>
-		class connection : public std::enable_shared_from_this<connection<T>>
+		// make it a shared pointer rather than a raw one. Every handler given to ASIO holds one of those pointers, so a connection 
+		// lives until its last operation has completed, whoever let go of it first
+		// The transport (net_transport.h) is the kind of socket the connection runs on, TCP unless told otherwise
+		template <typename T, typename Transport>
+		class connection : public std::enable_shared_from_this<connection<T, Transport>>
 		{
 		public:
 
@@ -31,10 +39,23 @@ namespace netmsg
 			// or the server interface. As the context and the incoming messages are references, the definition is imperative. The 
 			// body of the connection will assign the ownership, the reason why it is not defined in the constructor header or 
 			// listing is because we want to explicitly separate the critical and non critical information
-			connection(owner parent, asio::io_context& asioContext, asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn) : m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+			// The timing wheel is the one of the context, shared by every connection running on it, and it drives the deadlines 
+			// of the connection. Without a wheel the connection simply has no deadlines
+			connection(owner parent, asio::io_context& asioContext, typename Transport::socket socket, tsqueue<owned_message<T>>& qIn, timing_wheel* pWheel = nullptr) 
+				: m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn), m_pWheel(pWheel)
 			{
 				m_nOwnerType = parent;
 
+				m_timerHandshake.fnCallback = &connection::OnHandshakeTimer;
+				m_timerIdle.fnCallback = &connection::OnIdleTimer;
+				m_timerHeartbeat.fnCallback = &connection::OnHeartbeatTimer;
+				m_timerThrottle.fnCallback = &connection::OnThrottleTimer;
+				m_timerPing.fnCallback = &connection::OnPingTimer;
+				for (wheel_timer* t : { &m_timerHandshake, &m_timerIdle, &m_timerHeartbeat, &m_timerThrottle, &m_timerPing })
+				{
+					t->pOwner = this;
+				}
+
 				// Construct validates which conection ownership is being created
 				if (m_nOwnerType == owner::server)
 				{
@@ -56,6 +77,15 @@ namespace netmsg
 
 			virtual ~connection()
 			{
+				// A server connection can only be destroyed once its timers are disarmed as the wheel keeps it alive, the wheel of a 
+				// client connection belongs to its client interface which outlives it
+				for (wheel_timer* t : { &m_timerHandshake, &m_timerIdle, &m_timerHeartbeat, &m_timerThrottle, &m_timerPing })
+				{
+					if (t->IsArmed())
+					{
+						m_pWheel->Cancel(*t);
+					}
+				}
 			};
 
 			// ID getter
@@ -68,16 +98,28 @@ namespace netmsg
 
 			// This function will assign an id to the connection, the implementation on the server class is designed so the ID 
 			// number changes every time a connection is detected 
-			void ConnectToClient(netmsg::net::server_interface<T>* server, uint32_t uid = 0)
+			void ConnectToClient(netmsg::net::server_interface<T, Transport>* server, uint32_t uid = 0)
 			{
 				if (m_nOwnerType == owner::server)
 				{
 					if (m_socket.is_open())
 					{
 						id = uid;	
+						m_socketOptions = server->m_options.socket;
+						m_pCapture = server->m_pCapture.get();
+						m_pTracer = server->m_pTracer.get();
+						if (server->m_options.inbound.IsEnabled())
+						{
+							m_pLimits = &server->m_options.inbound;
+							m_bucketInbound = token_bucket(m_pLimits->connection.dRate, m_pLimits->connection.dBurst);
+						}
 						//Used in previous version
 						//ReadHeader();
 
+						// The server counts this connection as a pending handshake until the ticket is written or the 
+						// handshake fails, a client not completing it in time is dropped so half-open sockets do not pile up
+						BeginHandshake(server);
+
 						// When the client attempts to connect to the server we will make it go through some validation, the 
 						// handshake data must be written out before the client can have a direct valid interaction with the server
 						WriteValidation();
@@ -89,17 +131,20 @@ namespace netmsg
 				}
 			}
 			// Only called by clients
-			void ConnectToServer(const asio::ip::tcp::resolver::results_type& endpoints)
+			void ConnectToServer(const typename Transport::endpoints& endpoints, const socket_options& options = socket_options())
 			{
 				// This function can only be used by clients, which is checked right at the beginning
 				if (m_nOwnerType == owner::client)
 				{
 					// Makes ASIO a request to connect to endpoints, then the ASIO context is primed waiting for messages from the server
-					asio::async_connect(m_socket, endpoints,
-						[this](std::error_code ec, asio::ip::tcp::endpoint endpoint)
+					Transport::AsyncConnect(m_socket, endpoints,
+						[this, self = this->shared_from_this(), options](std::error_code ec)
 						{
 							if (!ec)
 							{
+								Transport::ApplyOptions(m_socket, options);
+								m_socketOptions = options;
+
 								// Used in previous version
 								// ReadHeader();
 
@@ -108,6 +153,39 @@ namespace netmsg
 						});
 				}
 			}
+			// Server to server link of a relay, both of its ends belong to a server. The accepting end starts right away and the
+			// dialing end once it is connected. Each end challenges the other with the nonce of its hello, see OnRelayReceived
+			void ConnectToPeer(netmsg::net::server_interface<T, Transport>* server, const typename Transport::endpoints* pEndpoints = nullptr)
+			{
+				m_pPeerServer = server;
+				m_socketOptions = server->m_options.socket;
+				if (!pEndpoints)
+				{
+					StartPeer();
+					return;
+				}
+
+				Transport::AsyncConnect(m_socket, *pEndpoints,
+					[this, self = this->shared_from_this()](std::error_code ec)
+					{
+						if (!ec)
+						{
+							StartPeer();
+						}
+					});
+			}
+
+			// Node of the server at the other end of a relay link, known once it has answered the challenge
+			bool IsPeerKnown() const
+			{
+				return m_bPeerKnown;
+			}
+
+			uint32_t GetPeerNode() const
+			{
+				return m_nPeerNode;
+			}
+
 			// Called by both client and server
 			void Disconnect()
 			{
@@ -115,7 +193,7 @@ namespace netmsg
 				if (IsConnected())
 				{
 					asio::post(m_asioContext,
-						[this]()
+						[this, self = this->shared_from_this()]()
 						{
 							m_socket.close();
 						});
@@ -127,27 +205,196 @@ namespace netmsg
 				return m_socket.is_open();
 			}
 
+			// A connection is superseded when its client comes back on a new connection and resumes the session, it is then 
+			// dropped by the server without calling OnClientDisconnect as the client never really left
+			bool IsSuperseded() const
+			{
+				return m_bSuperseded;
+			}
+
+			// A connection standing in for a recorded client while ReplayCapture runs. It never had a socket, the server sends 
+			// to it (the messages go nowhere) instead of taking it for a client that left
+			bool IsReplay() const
+			{
+				return m_bReplay;
+			}
+
+			// Messages of this client discarded by the inbound rate limits
+			uint64_t GetDroppedMessages() const
+			{
+				return m_nDroppedMessages;
+			}
+
+			// Round trip time, its variance and the clock offset of the peer, measured by the probes of this end
+			rtt_stats GetRtt() const
+			{
+				return m_rtt.Stats();
+			}
+
+			// Sends a single round trip probe, on top of the periodic ones if any. Nothing is sent before the handshake is over
+			void Ping()
+			{
+				asio::post(m_asioContext,
+					[this, self = this->shared_from_this()]()
+					{
+						if (m_bProbing && IsConnected())
+						{
+							SendPing();
+						}
+					});
+			}
+
+			// Connection that took over the session of a superseded one
+			std::shared_ptr<connection> GetSuccessor() const
+			{
+				return m_bSuperseded ? m_wpSuccessor.lock() : nullptr;
+			}
+
+			// True when the last handshake resumed a previous session instead of starting a new one
+			bool IsResumed() const
+			{
+				return m_ticket.nResumed != 0;
+			}
+
+			// Client side, the ticket of the current session and how far the client got into it, a new connection presents it 
+			// to resume the session
+			session_resume GetResumeState() const
+			{
+				return { m_ticket.nToken, m_ticket.nSecret, m_nMessagesReceived };
+			}
+
+			void SetResumeState(const session_resume& resume)
+			{
+				m_handshakeReply.nResumeToken = resume.nToken;
+				m_handshakeReply.nResumeSecret = resume.nSecret;
+				m_handshakeReply.nLastReceived = resume.nReceived;
+				m_nMessagesReceived = resume.nReceived;
+			}
+
 		public:
 			void Send(const message<T>& msg)
 			{
+				Send(std::make_shared<const message<T>>(msg));
+			}
+
+			// The message is moved into the outgoing queue, its body is never copied on the way to the socket
+			void Send(message<T>&& msg)
+			{
+				Send(std::make_shared<const message<T>>(std::move(msg)));
+			}
+
+			// A message built in place, see message_builder
+			void Send(message_builder<T>&& builder)
+			{
+				Send(std::move(builder).Share());
+			}
+
+			// Sends a message shared with other connections, nothing is copied
+			void Send(shared_message<T> msg)
+			{
+				// A message sent by the handler of a traced message belongs to the same trace
+				uint64_t nTrace = message_tracer::Current();
+				uint64_t nSendTime = nTrace ? message_tracer::Clock() : 0;
+
 				// The context is already waiting for incoming messages, but we will use the post function on it for it to 
 				// asynchronously check on the messages content, as the process is working randomly when the client or the 
 				// server are interacting, then we need to previously check on the message queue even before its being written, 
 				// a simple boolean will allow us to check on the content and prime the context into writing messages if needed
 				asio::post(m_asioContext,
-					[this, msg]()
+					[this, self = this->shared_from_this(), msg = std::move(msg), nTrace, nSendTime]()
 					{
-						bool bWritingMessage = !m_qMessagesOut.empty();
-						m_qMessagesOut.push_back(msg);
+						// Messages still reaching a superseded connection belong to the connection that resumed its session
+						if (m_bSuperseded)
+						{
+							if (auto successor = m_wpSuccessor.lock())
+							{
+								successor->Send(msg);
+							}
+							return;
+						}
+
+						if (m_socketOptions.nMaxMessageSize > 0 && msg->body.size() > m_socketOptions.nMaxMessageSize)
+						{
+							NETMSG_LOG_WARNING("[" << id << "] Message Too Large (" << msg->body.size() << " bytes), use a stream");
+							return;
+						}
+
+						// A copy is retained by the session so it can be replayed if the client has to reconnect
+						if (m_pSession)
+						{
+							m_pSession->Retain(msg);
+						}
+
+						// A closed connection only keeps its session up to date, there is nothing to write to
+						if (!m_socket.is_open())
+						{
+							return;
+						}
 
-						if (!bWritingMessage)
+						if (nTrace && m_pTracer)
 						{
-							WriteHeader();
+							m_mapTracedOut[msg.get()] = { nTrace, ++m_nTracedSends };
+							m_pTracer->RecordSend(nTrace, trace_stage::SendQueued, id, msg->header.id, m_nTracedSends, nSendTime);
 						}
+						QueueOutgoing(msg);
 					});
 			}
 
+			// Sends a payload of any size as a stream of pieces, see net_stream.h. The source is called on the context thread 
+			// for one piece at a time, and the next piece is only queued once the previous one is written, so the messages sent 
+			// in the meantime go out between the pieces instead of waiting for the whole stream. Streams are sent one after the 
+			// other. The pieces already queued are numbered and kept by the session window like any message, so a resumed client 
+			// gets the ones it missed, but the rest of a stream cut by a disconnection is not produced on the new connection, the 
+			// stream is lost and has to be sent again. Returns the number of the stream, which the receiver finds in the trailer 
+			// of every piece
+			uint32_t SendStream(T streamId, stream_source fnSource, uint64_t nTotal = 0)
+			{
+				uint32_t nStream = ++m_nLastStream;
+				asio::post(m_asioContext,
+					[this, self = this->shared_from_this(), streamId, fnSource = std::move(fnSource), nTotal, nStream]() mutable
+					{
+						if (!m_socket.is_open() || m_bSuperseded)
+						{
+							return;
+						}
+						m_deqStreamsOut.push_back({ nStream, streamId, 0, nTotal, std::move(fnSource) });
+						QueueStreamChunk();
+					});
+				return nStream;
+			}
+
+			// Streams a payload already in memory, the buffer is moved into the stream and released once the last piece is queued
+			uint32_t SendStream(T streamId, std::vector<uint8_t> vData)
+			{
+				auto pData = std::make_shared<std::vector<uint8_t>>(std::move(vData));
+				size_t nTotal = pData->size();
+				return SendStream(streamId,
+					[pData, nOffset = size_t(0)](uint8_t* pChunk, size_t nSize) mutable
+					{
+						size_t nCopy = std::min(nSize, pData->size() - nOffset);
+						std::memcpy(pChunk, pData->data() + nOffset, nCopy);
+						nOffset += nCopy;
+						return nCopy;
+					}, nTotal);
+			}
+
 		private:
+			// Only called from the context thread
+			void QueueOutgoing(const message<T>& msg)
+			{
+				QueueOutgoing(std::make_shared<const message<T>>(msg));
+			}
+
+			void QueueOutgoing(shared_message<T> msg)
+			{
+				bool bWritingMessage = !m_qMessagesOut.empty();
+				m_qMessagesOut.push_back(std::move(msg));
+
+				if (!bWritingMessage)
+				{
+					WriteHeader();
+				}
+			}
 
 			// Asynchronous task which will prime the context to read a message header
 			void ReadHeader()
@@ -157,12 +404,33 @@ namespace netmsg
 				// the temporary data, so this connection type has declared a message type for temporal information
 				asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
 					// The lambda function declared is used to provide the work to do when the function is called
-					[this](std::error_code ec, std::size_t length)
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 					{
 						
 						if (!ec)
 						{
-							if (m_msgTemporaryIn.header.size > 0)
+							// Anything read counts as a sign of life for the idle timeout
+							if (m_pWheel)
+							{
+								m_nLastReadTick = m_pWheel->Now();
+							}
+
+							// The trace of a sampled message starts once its header is in, the body is still on its way
+							if (m_pTracer && !IsControlId(m_msgTemporaryIn.header.id))
+							{
+								m_nTraceIn = m_pTracer->Sample(m_nTraceCounter);
+								if (m_nTraceIn)
+								{
+									m_pTracer->Record(m_nTraceIn, trace_stage::HeaderRead, id, m_msgTemporaryIn.header.id);
+								}
+							}
+
+							if (m_socketOptions.nMaxMessageSize > 0 && m_msgTemporaryIn.header.size > m_socketOptions.nMaxMessageSize)
+							{
+								NETMSG_LOG_WARNING("[" << id << "] Message Too Large (" << m_msgTemporaryIn.header.size << " bytes)");
+								m_socket.close();
+							}
+							else if (m_msgTemporaryIn.header.size > 0)
 							{
 								// We instantiated the message size to change if it contains information, in this case 
 								// the temporary message type will change its size by checking the incoming message size
@@ -182,7 +450,7 @@ namespace netmsg
 							// If theres errors in the connection, we will manually close the socket in the code, which will be 
 							// later identified by the messageClient function declared previously, the function is declared to 
 							// tidy up the deque of connections
-							std::cout << "[" << id << "] Read Header Fail\n";
+							NETMSG_LOG_DEBUG("[" << id << "] Read Header Fail");
 							m_socket.close();
 						}
 					});
@@ -194,7 +462,7 @@ namespace netmsg
 				// The asynchronous function is called after the header is confirmed to contain information, then the ASIO context will 
 				// allow us to read the body data by using the temporal assigned message
 				asio::async_read(m_socket, asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
-					[this](std::error_code ec, std::size_t length)
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
@@ -205,7 +473,7 @@ namespace netmsg
 							// If theres errors in the connection, we will manually close the socket in the code, which will be later 
 							// identified by the messageClient function declared previously, the function is declared to tidy up the 
 							// deque of connections
-							std::cout << "[" << id << "] Read Body Fail\n";
+							NETMSG_LOG_DEBUG("[" << id << "] Read Body Fail");
 							m_socket.close();
 						}
 					});
@@ -214,15 +482,25 @@ namespace netmsg
 			// Asynchronous task which will prime the context to write a message header
 			void WriteHeader()
 			{
+				if (!m_mapTracedOut.empty())
+				{
+					TraceWrite(trace_stage::WriteStart, false);
+				}
+
 				// This asynchronous function will sit and wait for messages when written, it will use the socket as a parameter, 
 				// it will take the messages queue output in order y using the header, and finally it will help itself by checking 
 				// on the size of the message header previously declared.
-				asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
-					[this](std::error_code ec, std::size_t length)
+				asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front()->header, sizeof(message_header<T>)),
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							if (m_qMessagesOut.front().body.size() > 0)
+							if (m_pWheel)
+							{
+								m_nLastWriteTick = m_pWheel->Now();
+							}
+
+							if (m_qMessagesOut.front()->body.size() > 0)
 							{
 								// If the body vector of the message contains anything, then it will prime the context into reading 
 								// whatever information is in it, 
@@ -232,11 +510,7 @@ namespace netmsg
 							{
 								// if the message is done with the body, then it will get rid of it, but it will also call itself 
 								// again in case theres more messages in the queue
-								m_qMessagesOut.pop_front();
-								if (!m_qMessagesOut.empty())
-								{
-									WriteHeader();
-								}
+								OnMessageWritten();
 							}
 						}
 						else
@@ -244,7 +518,7 @@ namespace netmsg
 							// If theres errors in the connection, we will manually close the socket in the code, which will be later 
 							// identified by the messageClient function declared previously, the function is declared to tidy up the 
 							// deque of connections
-							std::cout << "[" << id << "] Write Header Fail\n";
+							NETMSG_LOG_DEBUG("[" << id << "] Write Header Fail");
 							m_socket.close();
 						};
 					});
@@ -253,41 +527,170 @@ namespace netmsg
 			// Asynchronous task which will prime the context to write a message body
 			void WriteBody()
 			{
-				asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
-					[this](std::error_code ec, std::size_t length)
+				asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front()->body.data(), m_qMessagesOut.front()->body.size()),
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
-							m_qMessagesOut.pop_front();
-
-							if (!m_qMessagesOut.empty())
-							{
-								WriteHeader();
-							};
+							OnMessageWritten();
 						}
 						else
 						{
 							// If theres errors in the connection, we will manually close the socket in the code, which will be later 
 							// identified by the messageClient function declared previously, the function is declared to tidy up the 
 							// deque of connections
-							std::cout << "[" << id << "] Write Body Fail\n";
+							NETMSG_LOG_DEBUG("[" << id << "] Write Body Fail");
 							m_socket.close();
 						}
 					});
 			}
 
+			void OnMessageWritten()
+			{
+				if (!m_mapTracedOut.empty())
+				{
+					TraceWrite(trace_stage::WriteDone, true);
+				}
+
+				bool bChunk = m_qMessagesOut.front().get() == m_pQueuedChunk;
+				if (m_qMessagesOut.front()->header.id == ControlId<T>(control::Pong))
+				{
+					m_bPongQueued = false;
+				}
+				m_qMessagesOut.pop_front();
+				if (!m_qMessagesOut.empty())
+				{
+					WriteHeader();
+				}
+
+				// The next piece of a stream goes behind whatever was queued while the previous one was being written
+				if (bChunk)
+				{
+					m_pQueuedChunk = nullptr;
+					QueueStreamChunk();
+				}
+			}
+
+			// Records a stage of the message at the front of the outgoing queue if it is traced
+			void TraceWrite(trace_stage stage, bool bDone)
+			{
+				auto it = m_mapTracedOut.find(m_qMessagesOut.front().get());
+				if (it != m_mapTracedOut.end())
+				{
+					m_pTracer->RecordSend(it->second.first, stage, id, m_qMessagesOut.front()->header.id, it->second.second);
+					if (bDone)
+					{
+						m_mapTracedOut.erase(it);
+					}
+				}
+			}
+
+			// Queues the next piece of the current stream, unless one is already queued
+			void QueueStreamChunk()
+			{
+				if (m_pQueuedChunk || m_deqStreamsOut.empty() || !m_socket.is_open())
+				{
+					return;
+				}
+
+				size_t nChunkSize = std::max<uint32_t>(1, m_socketOptions.nStreamChunkSize);
+				if (m_socketOptions.nMaxMessageSize > sizeof(stream_chunk))
+				{
+					nChunkSize = std::min<size_t>(nChunkSize, m_socketOptions.nMaxMessageSize - sizeof(stream_chunk));
+				}
+
+				stream_out& stream = m_deqStreamsOut.front();
+				auto msg = std::make_shared<message<T>>();
+				msg->header.id = stream.id;
+				msg->body.resize(nChunkSize);
+				size_t nRead = stream.fnSource(msg->body.data(), nChunkSize);
+				msg->body.resize(nRead);
+
+				stream_chunk chunk;
+				chunk.nStream = stream.nStream;
+				chunk.nOffset = stream.nOffset;
+				chunk.nTotal = stream.nTotal;
+				stream.nOffset += nRead;
+				chunk.nLast = (nRead == 0 || (stream.nTotal > 0 && stream.nOffset >= stream.nTotal)) ? 1 : 0;
+				*msg << chunk;
+				if (chunk.nLast)
+				{
+					m_deqStreamsOut.pop_front();
+				}
+
+				// Numbered like the messages of Send, the client counts the pieces it receives as messages of the session
+				shared_message<T> piece(std::move(msg));
+				if (m_pSession)
+				{
+					m_pSession->Retain(piece);
+				}
+
+				m_pQueuedChunk = piece.get();
+				QueueOutgoing(std::move(piece));
+			}
+
 			void AddToIncomingMessageQueue()
 			{
+				// Probes are answered and measured right here, on any kind of connection, the sooner the better
+				if (m_msgTemporaryIn.header.id == ControlId<T>(control::Ping) || m_msgTemporaryIn.header.id == ControlId<T>(control::Pong))
+				{
+					if (!OnProbe())
+					{
+						NETMSG_LOG_WARNING("[" << id << "] Malformed Probe");
+						m_socket.close();
+						return;
+					}
+					ReadHeader();
+					return;
+				}
+
+				// A relay link only carries relay traffic, the server sorts it out
+				if (m_pPeerServer)
+				{
+					if (m_msgTemporaryIn.header.id == ControlId<T>(control::Relay))
+					{
+						m_pPeerServer->OnRelayReceived(this->shared_from_this(), m_msgTemporaryIn);
+					}
+					ReadHeader();
+					return;
+				}
+
+				// Framework messages are consumed here, they are not part of the application traffic. A heartbeat has nothing to 
+				// do as reading it already refreshed the idle timeout
+				if (IsControlId(m_msgTemporaryIn.header.id))
+				{
+					ReadHeader();
+					return;
+				}
+
+				// The rate limits are checked before anything is copied into the queue, the message is still in the temporary 
+				// buffer and no other read is issued until it is dealt with
+				if (m_pLimits && !CheckInboundLimits())
+				{
+					return;
+				}
+
 				// If the owner of the connection is the server, then we will move the message into the tsqueue and push it into it by 
 				// using the shared pointer of the connection itself and the temporal message
 				if (m_nOwnerType == owner::server)
 				{
-					m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+					if (m_pCapture)
+					{
+						m_pCapture->Append(id, m_msgTemporaryIn);
+					}
+					if (m_nTraceIn)
+					{
+						m_pTracer->Record(m_nTraceIn, trace_stage::BodyRead, id, m_msgTemporaryIn.header.id);
+					}
+					m_qMessagesIn.push_back({ m_hSelf, m_msgTemporaryIn, m_nTraceIn });
+					m_nTraceIn = 0;
 				}
 				else
 				{
 					// If the owner of the connection is a client then we will use a null pointer to reassure that the client has just one connection
-					m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });
+					m_qMessagesIn.push_back({ {}, m_msgTemporaryIn });
+					// The count tells the server where to resume the replay from if this connection drops
+					m_nMessagesReceived++;
 				}
 				// When the message is finished on reading, we need to prime the context again into reading the next header available
 				ReadHeader();
@@ -302,76 +705,480 @@ namespace netmsg
 				return out ^ 0xC0DEFACE12345678;
 			};
 
-			// Asynchronous function used by both client and server to write packets for the validation process
+			// Asynchronous function used by both client and server to write packets for the validation process, the server writes 
+			// the challenge and the client writes its reply
 			void WriteValidation()
 			{
-				asio::async_write(m_socket, asio::buffer(&m_nHandshakeOut, sizeof(uint64_t)),
-					[this](std::error_code ec, std::size_t length)
+				asio::mutable_buffer buffer = (m_nOwnerType == owner::server)
+					? asio::buffer(&m_nHandshakeOut, sizeof(uint64_t))
+					: asio::buffer(&m_handshakeReply, sizeof(handshake_reply));
+
+				asio::async_write(m_socket, buffer,
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
 							// When the validation is sent by the client, all they can do is to sit and wait for the servers 
-							// response and proper validation
+							// response and its session ticket
 							if (m_nOwnerType == owner::client)
 							{
-								ReadHeader();
+								ReadTicket();
 							};
-						};
+						}
 						else
 						{
 							m_socket.close();
+							EndHandshake();
 						};
 					});
 			};
 
 			// This function receives a pointer to a server class which will inform the user or the derived class that derivate the 
 			// server that the client has been validated
-			void ReadValidation(netmsg::net::server_interface<T>* server = nullptr)
+			void ReadValidation(netmsg::net::server_interface<T, Transport>* server = nullptr)
 			{
-				asio::async_read(m_socket, asio::buffer(&m_nHandshakeIn, sizeof(uint64_t)),
-					[this, server](std::error_code ec, std::size_t length)
+				asio::mutable_buffer buffer = (m_nOwnerType == owner::server)
+					? asio::buffer(&m_handshakeReply, sizeof(handshake_reply))
+					: asio::buffer(&m_nHandshakeIn, sizeof(uint64_t));
+
+				asio::async_read(m_socket, buffer,
+					[this, self = this->shared_from_this(), server](std::error_code ec, std::size_t length)
 					{
 						if (!ec)
 						{
 							if (m_nOwnerType == owner::server)
 							{
-								if (m_nHandshakeIn == m_nHandshakeCheck)
+								// A client presenting a known resumption token keeps the identity of its previous session and 
+								// skips the challenge, an unknown or expired token falls back to the regular validation
+								if (m_handshakeReply.nResumeToken != 0 && server->ResumeSession(this->shared_from_this()))
+								{
+									WriteTicket(server, true);
+								}
+								else if (m_handshakeReply.nAnswer == m_nHandshakeCheck)
 								{
 									// If the client successfully solves the algorithm then the server will properly use the server 
 									// pointer to allow the connection
-									std::cout << "Client Validated" << std::endl;
-									server->OnClientValidated(this->shared_from_this());
-									ReadHeader();
+									if (server->m_options.bLogConnections)
+									{
+										NETMSG_LOG_INFO("Client Validated");
+									}
+									server->OpenSession(this->shared_from_this());
+									WriteTicket(server, false);
 								}
 								else
 								{
-									std::cout << "Client Disconnected (Validation Failed)" << std::endl;
+									NETMSG_LOG_INFO("Client Disconnected (Validation Failed)");
 									m_socket.close();
+									EndHandshake();
 								}
 							}
 							else
 							{
 								// If the connection is a client, then it has to solve the algorithm before the server accepts the interaction
-								m_nHandshakeOut = scramble(m_nHandshakeIn);
+								m_handshakeReply.nAnswer = scramble(m_nHandshakeIn);
 
 								WriteValidation();
 							}
 						}
 						else
 						{
-							std::cout << "Client Disconnected (Read Validation)" << std::endl;
+							NETMSG_LOG_INFO("Client Disconnected (Read Validation)");
 							m_socket.close();
+							EndHandshake();
 						};
 					});
 			};
 
+			// Server side, the ticket is the last part of the handshake. Only once it is written the server is told about the 
+			// client, anything it sends from its handlers goes after the ticket in the stream
+			void WriteTicket(netmsg::net::server_interface<T, Transport>* server, bool bResumed)
+			{
+				m_ticket.nToken = m_pSession ? m_pSession->nToken : 0;
+				m_ticket.nSecret = m_pSession ? m_pSession->nSecret : 0;
+				m_ticket.nClientID = id;
+				m_ticket.nResumed = bResumed ? 1 : 0;
+
+				asio::async_write(m_socket, asio::buffer(&m_ticket, sizeof(session_ticket)),
+					[this, self = this->shared_from_this(), server, bResumed](std::error_code ec, std::size_t)
+					{
+						EndHandshake();
+
+						if (!ec)
+						{
+							if (bResumed)
+							{
+								ReplayMissedMessages();
+								server->OnClientResumed(this->shared_from_this());
+								server->AnnounceClient(id);
+							}
+							else
+							{
+								server->OnClientValidated(this->shared_from_this());
+								server->AnnounceClient(id);
+							}
+							StartKeepAlive();
+							ReadHeader();
+						}
+						else
+						{
+							m_socket.close();
+						}
+					});
+			}
+
+			// Client side, the ticket gives the client its identifier and the token for its next reconnection
+			void ReadTicket()
+			{
+				asio::async_read(m_socket, asio::buffer(&m_ticket, sizeof(session_ticket)),
+					[this, self = this->shared_from_this()](std::error_code ec, std::size_t)
+					{
+						if (!ec)
+						{
+							id = m_ticket.nClientID;
+							// A new session numbers its messages from the start
+							if (!m_ticket.nResumed)
+							{
+								m_nMessagesReceived = 0;
+							}
+							StartKeepAlive();
+							ReadHeader();
+						}
+						else
+						{
+							NETMSG_LOG_INFO("Client Disconnected (Read Ticket)");
+							m_socket.close();
+						}
+					});
+			}
+
+			void BeginHandshake(netmsg::net::server_interface<T, Transport>* server)
+			{
+				m_pHandshakeServer = server;
+				server->m_nPendingHandshakes++;
+
+				if (server->m_options.tHandshakeTimeout.count() > 0)
+				{
+					ArmTimer(m_timerHandshake, server->m_options.tHandshakeTimeout);
+				}
+			}
+
+			// Called once on every way out of the handshake, successful or not, it gives the slot back to the server
+			void EndHandshake()
+			{
+				if (m_pHandshakeServer)
+				{
+					netmsg::net::server_interface<T, Transport>* server = m_pHandshakeServer;
+					m_pHandshakeServer = nullptr;
+					if (m_pWheel)
+					{
+						m_pWheel->Cancel(m_timerHandshake);
+					}
+					server->OnHandshakeFinished();
+				}
+			}
+
+			// Arms one of the deadlines of the connection. On the server side the wheel holds the connection alive while any of 
+			// them is armed, so a callback never finds its connection gone
+			void ArmTimer(wheel_timer& timer, std::chrono::milliseconds tDelay)
+			{
+				if (!m_pWheel)
+				{
+					return;
+				}
+				if (m_nOwnerType == owner::server && !timer.pKeepAlive)
+				{
+					timer.pKeepAlive = this->shared_from_this();
+				}
+				m_pWheel->Schedule(timer, tDelay);
+			}
+
+			// Both ends of a relay link introduce themselves before anything else is sent, the hello carries the nonce the other 
+			// end has to answer
+			void StartPeer()
+			{
+				Transport::ApplyOptions(m_socket, m_socketOptions);
+				m_nRelayNonce = SecureRandom64();
+				QueueOutgoing(RelayEnvelope<T>(relay_kind::Hello, m_pPeerServer->m_options.nRelayNode, m_nRelayNonce));
+				// The heartbeats keep the link from going idle, so the challenge has its own deadline, the one of the handshake
+				if (m_pPeerServer->m_options.tHandshakeTimeout.count() > 0)
+				{
+					ArmTimer(m_timerHandshake, m_pPeerServer->m_options.tHandshakeTimeout);
+				}
+				StartKeepAlive();
+				ReadHeader();
+			}
+
+			// Starts the heartbeat, the idle timeout and the probes once the connection is validated
+			void StartKeepAlive()
+			{
+				m_bProbing = true;
+				if (!m_pWheel)
+				{
+					return;
+				}
+				if (m_socketOptions.tPing.count() > 0)
+				{
+					// The first probe goes right away, the round trip is known as soon as possible
+					SendPing();
+					ArmTimer(m_timerPing, m_socketOptions.tPing);
+				}
+				m_nLastReadTick = m_pWheel->Now();
+				m_nLastWriteTick = m_pWheel->Now();
+				if (m_socketOptions.tHeartbeat.count() > 0)
+				{
+					ArmTimer(m_timerHeartbeat, m_socketOptions.tHeartbeat);
+				}
+				if (m_socketOptions.tIdleTimeout.count() > 0)
+				{
+					ArmTimer(m_timerIdle, m_socketOptions.tIdleTimeout);
+				}
+			}
+
+			// Time since a tick of the wheel
+			std::chrono::milliseconds SinceTick(uint64_t nTick) const
+			{
+				return m_pWheel->Tick() * int64_t(m_pWheel->Now() - nTick);
+			}
+
+			static void OnHandshakeTimer(wheel_timer& timer)
+			{
+				connection* self = static_cast<connection*>(timer.pOwner);
+				if (self->m_pHandshakeServer)
+				{
+					NETMSG_LOG_WARNING("[" << self->id << "] Handshake Timeout");
+					self->m_socket.close();
+					self->EndHandshake();
+				}
+				else if (self->m_pPeerServer && !self->m_bPeerKnown && self->m_socket.is_open())
+				{
+					NETMSG_LOG_WARNING("[relay " << self->m_nPeerNode << "] Relay Authentication Timeout");
+					self->m_socket.close();
+				}
+			}
+
+			// The timers are not moved on every read or write, which would cost a wheel operation per message. They fire at 
+			// their interval, look at the last activity and either act or sleep again for the time that is left. A closed 
+			// connection simply does not arm them again
+			static void OnIdleTimer(wheel_timer& timer)
+			{
+				connection* self = static_cast<connection*>(timer.pOwner);
+				if (!self->IsConnected())
+				{
+					return;
+				}
+
+				std::chrono::milliseconds tIdle = self->SinceTick(self->m_nLastReadTick);
+				if (tIdle >= self->m_socketOptions.tIdleTimeout)
+				{
+					NETMSG_LOG_WARNING("[" << self->id << "] Idle Timeout");
+					self->m_socket.close();
+				}
+				else
+				{
+					self->ArmTimer(timer, self->m_socketOptions.tIdleTimeout - tIdle);
+				}
+			}
+
+			static void OnHeartbeatTimer(wheel_timer& timer)
+			{
+				connection* self = static_cast<connection*>(timer.pOwner);
+				if (!self->IsConnected())
+				{
+					return;
+				}
+
+				std::chrono::milliseconds tQuiet = self->SinceTick(self->m_nLastWriteTick);
+				if (tQuiet >= self->m_socketOptions.tHeartbeat)
+				{
+					// Heartbeats skip the session window, they are not part of what a resumed client has to receive
+					message<T> msg;
+					msg.header.id = ControlId<T>(control::Heartbeat);
+					self->QueueOutgoing(msg);
+					self->ArmTimer(timer, self->m_socketOptions.tHeartbeat);
+				}
+				else
+				{
+					self->ArmTimer(timer, self->m_socketOptions.tHeartbeat - tQuiet);
+				}
+			}
+
+			// Takes a token from the buckets the temporary message counts against. When one of them is empty, the action of 
+			// that limit is applied (the harshest one if both are empty) and false is returned, the caller must then leave the 
+			// message alone as the read loop has been taken care of
+			bool CheckInboundLimits()
+			{
+				auto tNow = std::chrono::steady_clock::now();
+
+				token_bucket* pMessageBucket = nullptr;
+				const rate_limit* pMessageLimit = m_pLimits->FindMessageLimit(m_msgTemporaryIn.header.id);
+				if (pMessageLimit)
+				{
+					auto it = m_mapMessageBuckets.find(inbound_limits::Key(m_msgTemporaryIn.header.id));
+					if (it == m_mapMessageBuckets.end())
+					{
+						it = m_mapMessageBuckets.emplace(inbound_limits::Key(m_msgTemporaryIn.header.id), token_bucket(pMessageLimit->dRate, pMessageLimit->dBurst)).first;
+					}
+					pMessageBucket = &it->second;
+					pMessageBucket->Refill(tNow);
+				}
+				m_bucketInbound.Refill(tNow);
+
+				auto tWait = m_bucketInbound.TimeUntilToken();
+				bool bOver = tWait.count() > 0;
+				limit_action action = bOver ? m_pLimits->connection.action : limit_action::Drop;
+				if (pMessageBucket && pMessageBucket->TimeUntilToken().count() > 0)
+				{
+					tWait = std::max(tWait, pMessageBucket->TimeUntilToken());
+					action = bOver ? std::max(action, pMessageLimit->action) : pMessageLimit->action;
+					bOver = true;
+				}
+
+				if (!bOver)
+				{
+					m_bucketInbound.Take();
+					if (pMessageBucket)
+					{
+						pMessageBucket->Take();
+					}
+					return true;
+				}
+
+				switch (action)
+				{
+				case limit_action::Delay:
+					// The message is checked again once the tokens are there, the socket is not read in the meantime. Without a 
+					// timing wheel nothing would ever read it again, the connection is dropped instead of hanging silently
+					if (m_pWheel)
+					{
+						ArmTimer(m_timerThrottle, std::chrono::duration_cast<std::chrono::milliseconds>(tWait) + std::chrono::milliseconds(1));
+						break;
+					}
+					[[fallthrough]];
+				case limit_action::Disconnect:
+					NETMSG_LOG_WARNING("[" << id << "] Rate Limit Exceeded");
+					m_socket.close();
+					break;
+				default:
+					m_nDroppedMessages++;
+					ReadHeader();
+					break;
+				}
+				return false;
+			}
+
+			// Probes skip the session window like the heartbeats, the time stamps are pushed in order and pulled out backwards
+			void SendPing()
+			{
+				message<T> msg;
+				msg.header.id = ControlId<T>(control::Ping);
+				msg << ProbeClock();
+				m_bPingOutstanding = true;
+				QueueOutgoing(msg);
+			}
+
+			// Probes come before the rate limits, so they are kept cheap to receive: a Ping is only answered when the Pong of the
+			// previous one has been written, a peer sending Pings in a loop gets one Pong per write and not one per Ping, and a
+			// Pong is only taken when a Ping of ours is waiting for it. A probe whose body does not have the size of its
+			// timestamps is malformed, false then and the connection is closed
+			bool OnProbe()
+			{
+				uint64_t nReceived = ProbeClock();
+				if (m_msgTemporaryIn.header.id == ControlId<T>(control::Ping))
+				{
+					if (m_msgTemporaryIn.body.size() != sizeof(uint64_t))
+					{
+						return false;
+					}
+					if (m_bPongQueued)
+					{
+						return true;
+					}
+
+					uint64_t nSent = 0;
+					m_msgTemporaryIn >> nSent;
+
+					message<T> msg;
+					msg.header.id = ControlId<T>(control::Pong);
+					msg << nSent << nReceived << ProbeClock();
+					m_bPongQueued = true;
+					QueueOutgoing(msg);
+				}
+				else
+				{
+					if (m_msgTemporaryIn.body.size() != 3 * sizeof(uint64_t))
+					{
+						return false;
+					}
+					if (!m_bPingOutstanding)
+					{
+						return true;
+					}
+
+					uint64_t nPingSent = 0, nPingReceived = 0, nPongSent = 0;
+					m_msgTemporaryIn >> nPongSent >> nPingReceived >> nPingSent;
+					m_rtt.AddSample(nPingSent, nPingReceived, nPongSent, nReceived);
+					m_bPingOutstanding = false;
+				}
+				return true;
+			}
+
+			static void OnPingTimer(wheel_timer& timer)
+			{
+				connection* self = static_cast<connection*>(timer.pOwner);
+				if (self->IsConnected())
+				{
+					self->SendPing();
+					self->ArmTimer(timer, self->m_socketOptions.tPing);
+				}
+			}
+
+			static void OnThrottleTimer(wheel_timer& timer)
+			{
+				connection* self = static_cast<connection*>(timer.pOwner);
+				if (self->IsConnected())
+				{
+					self->AddToIncomingMessageQueue();
+				}
+			}
+
+			// Queues every message of the session window the client did not receive before its connection dropped, they go out 
+			// ahead of anything new. They are already retained by the session so they are pushed straight into the queue
+			void ReplayMissedMessages()
+			{
+				bool bWritingMessage = !m_qMessagesOut.empty();
+
+				size_t nFirst = size_t(m_handshakeReply.nLastReceived - m_pSession->FirstRetained());
+				for (size_t i = nFirst; i < m_pSession->deqWindow.size(); i++)
+				{
+					m_qMessagesOut.push_back(m_pSession->deqWindow[i]);
+				}
+
+				if (!bWritingMessage && !m_qMessagesOut.empty())
+				{
+					WriteHeader();
+				}
+			}
+
+			// The client of this connection resumed its session on a new connection, everything still sent here is forwarded 
+			// to it and this socket is closed
+			void Supersede(std::shared_ptr<connection> successor)
+			{
+				m_wpSuccessor = successor;
+				m_bSuperseded = true;
+				m_pSession.reset();
+				m_socket.close();
+			}
+
+			template <typename U, typename V>
+			friend class server_interface;
+
 		protected:
 			// Each connection will have a unique socket
-			asio::ip::tcp::socket m_socket;
+			typename Transport::socket m_socket;
 			// Theres going to be a single context which will be shared with the whole ASIO instance
 			asio::io_context& m_asioContext;
 			// This thread-safe queue will contain all the messages to be sent to the remote side of this connection
-			tsqueue<message<T>> m_qMessagesOut;
+			tsqueue<shared_message<T>> m_qMessagesOut;
 			// This thread-safe queue will contain all messages that has been received from the remote side of the connection. This has a 
 			// reference as the owner of this connection is expected to provide a queue
 			tsqueue<owned_message<T>>& m_qMessagesIn;
@@ -386,6 +1193,72 @@ namespace netmsg
 			uint64_t m_nHandshakeOut = 0;
 			uint64_t m_nHandshakeIn = 0;
 			uint64_t m_nHandshakeCheck = 0;
+
+			// Session resumption, the reply and the ticket are the last two steps of the handshake
+			handshake_reply m_handshakeReply;
+			session_ticket m_ticket;
+			// Server side, the session this connection currently carries, null when resumption is disabled
+			std::shared_ptr<session_state<T, connection>> m_pSession;
+			// Client side, how many messages were received in the current session
+			uint64_t m_nMessagesReceived = 0;
+			std::atomic<bool> m_bSuperseded = false;
+			std::weak_ptr<connection> m_wpSuccessor;
+			bool m_bReplay = false;
+
+			// Server side, set while the handshake is in flight
+			netmsg::net::server_interface<T, Transport>* m_pHandshakeServer = nullptr;
+
+			// Deadlines of the connection, all of them on the timing wheel of the context
+			timing_wheel* m_pWheel = nullptr;
+			wheel_timer m_timerHandshake;
+			wheel_timer m_timerIdle;
+			wheel_timer m_timerHeartbeat;
+			wheel_timer m_timerThrottle;
+			wheel_timer m_timerPing;
+			socket_options m_socketOptions;
+			uint64_t m_nLastReadTick = 0;
+			uint64_t m_nLastWriteTick = 0;
+
+			// Server side inbound rate limits, owned by the server options. The message buckets are only created for the 
+			// identifiers the client actually sends
+			const inbound_limits* m_pLimits = nullptr;
+			token_bucket m_bucketInbound;
+			std::unordered_map<uint64_t, token_bucket> m_mapMessageBuckets;
+			uint64_t m_nDroppedMessages = 0;
+			// Relay link side, the server it belongs to and the node at the other end
+			netmsg::net::server_interface<T, Transport>* m_pPeerServer = nullptr;
+			uint32_t m_nPeerNode = 0;
+			bool m_bPeerHello = false;
+			bool m_bPeerKnown = false;
+			uint64_t m_nRelayNonce = 0;
+			// Streams waiting to be sent, and the piece of the current one sitting in the outgoing queue
+			struct stream_out
+			{
+				uint32_t nStream = 0;
+				T id{};
+				uint64_t nOffset = 0;
+				uint64_t nTotal = 0;
+				stream_source fnSource;
+			};
+			std::deque<stream_out> m_deqStreamsOut;
+			const message<T>* m_pQueuedChunk = nullptr;
+			std::atomic<uint32_t> m_nLastStream = 0;
+			// Server side, the handle of this connection in the table of the server, carried by every message it queues
+			connection_handle m_hSelf;
+			// Server side, set when the server traces a sample of its messages. The trace of the message being read, and the
+			// traces of the messages waiting in the outgoing queue along with the number of their send
+			message_tracer* m_pTracer = nullptr;
+			uint64_t m_nTraceCounter = 0;
+			uint64_t m_nTraceIn = 0;
+			std::unordered_map<const message<T>*, std::pair<uint64_t, uint64_t>> m_mapTracedOut;
+			uint64_t m_nTracedSends = 0;
+			// Round trip estimation, probes only flow once the handshake is over
+			rtt_estimator m_rtt;
+			bool m_bProbing = false;
+			bool m_bPingOutstanding = false;
+			bool m_bPongQueued = false;
+			// Server side, set when the server records its traffic
+			capture_writer* m_pCapture = nullptr;
 		};
 	};
 };
@@ -0,0 +1,434 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NETMSG_ENTITY_SSE2
+#endif
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Identifier of an entity of an entity_store, the slot it was created in and the generation of that slot, so the
+		// identifier of a destroyed entity never refers to the entity created in its place
+		struct entity_id
+		{
+			uint32_t nIndex = 0;
+			uint32_t nGeneration = 0;
+
+			bool IsNull() const
+			{
+				return nGeneration == 0;
+			}
+
+			bool operator==(const entity_id& other) const
+			{
+				return nIndex == other.nIndex && nGeneration == other.nGeneration;
+			}
+
+			bool operator!=(const entity_id& other) const
+			{
+				return !(*this == other);
+			}
+		};
+
+		// One entry of a replication message written by entity_store::WriteChanges
+		struct entity_change
+		{
+			entity_id id;
+			float x = 0.0f;
+			float y = 0.0f;
+			float z = 0.0f;
+		};
+
+		// World state of a server, kept as a structure of arrays: every field of every entity lives in an array of its own, so
+		// a pass over one field of the whole world reads memory in order and the kernels below work on four entities per
+		// instruction. The entities are packed at the front of the arrays, a destroyed entity is replaced by the last one.
+		//
+		// Every entity has a position and a velocity, the Components are extra columns of the application (health, a team,
+		// an animation state), one array each, reached with Get<C>. A flag is stored as a uint8_t, a bool column would be a
+		// std::vector<bool> of packed bits whose elements cannot be referenced. Change tracking compares the positions with the ones last
+		// written by WriteChanges, anything else that has to be sent again is flagged with MarkDirty. The store belongs to the
+		// thread running the game tick, usually the one calling Update
+		template <typename... Components>
+		class entity_store
+		{
+			static_assert(!std::disjunction_v<std::is_same<Components, bool>...>, "Components cannot be bool, store flags as uint8_t");
+
+		public:
+			entity_store(size_t nReserve = 0)
+			{
+				Reserve(nReserve);
+			}
+
+			void Reserve(size_t nEntities)
+			{
+				for (auto* v : { &m_vPosX, &m_vPosY, &m_vPosZ, &m_vVelX, &m_vVelY, &m_vVelZ, &m_vSentX, &m_vSentY, &m_vSentZ })
+				{
+					v->reserve(nEntities);
+				}
+				m_vDirty.reserve(nEntities);
+				m_vDense.reserve(nEntities);
+				std::apply([nEntities](auto&... v) { (v.reserve(nEntities), ...); }, m_tComponents);
+			}
+
+			// A new entity is dirty, it has never been sent
+			entity_id Create(float x = 0.0f, float y = 0.0f, float z = 0.0f)
+			{
+				uint32_t nSlot;
+				if (!m_vFree.empty())
+				{
+					nSlot = m_vFree.back();
+					m_vFree.pop_back();
+				}
+				else
+				{
+					nSlot = uint32_t(m_vSlots.size());
+					m_vSlots.push_back({});
+				}
+
+				slot& s = m_vSlots[nSlot];
+				s.nDense = uint32_t(m_vDense.size());
+				entity_id id{ nSlot, s.nGeneration };
+
+				m_vDense.push_back(id);
+				m_vPosX.push_back(x);
+				m_vPosY.push_back(y);
+				m_vPosZ.push_back(z);
+				m_vVelX.push_back(0.0f);
+				m_vVelY.push_back(0.0f);
+				m_vVelZ.push_back(0.0f);
+				m_vSentX.push_back(x);
+				m_vSentY.push_back(y);
+				m_vSentZ.push_back(z);
+				m_vDirty.push_back(1);
+				std::apply([](auto&... v) { (v.emplace_back(), ...); }, m_tComponents);
+				return id;
+			}
+
+			// The last entity takes the place of the destroyed one, so the arrays stay packed
+			void Destroy(entity_id id)
+			{
+				if (!Alive(id))
+				{
+					return;
+				}
+
+				slot& s = m_vSlots[id.nIndex];
+				size_t nDense = s.nDense;
+				size_t nLast = m_vDense.size() - 1;
+				if (nDense != nLast)
+				{
+					MoveDense(nLast, nDense);
+					m_vSlots[m_vDense[nDense].nIndex].nDense = uint32_t(nDense);
+				}
+				PopDense();
+
+				s.nGeneration = s.nGeneration == std::numeric_limits<uint32_t>::max() ? 1 : s.nGeneration + 1;
+				m_vFree.push_back(id.nIndex);
+			}
+
+			bool Alive(entity_id id) const
+			{
+				return !id.IsNull() && id.nIndex < m_vSlots.size() && m_vSlots[id.nIndex].nGeneration == id.nGeneration;
+			}
+
+			size_t Size() const
+			{
+				return m_vDense.size();
+			}
+
+			// Position of an entity in the arrays, it changes when another entity is destroyed
+			size_t Dense(entity_id id) const
+			{
+				return m_vSlots[id.nIndex].nDense;
+			}
+
+			entity_id Entity(size_t nDense) const
+			{
+				return m_vDense[nDense];
+			}
+
+			void SetPosition(entity_id id, float x, float y, float z)
+			{
+				size_t i = Dense(id);
+				m_vPosX[i] = x;
+				m_vPosY[i] = y;
+				m_vPosZ[i] = z;
+			}
+
+			void SetVelocity(entity_id id, float x, float y, float z)
+			{
+				size_t i = Dense(id);
+				m_vVelX[i] = x;
+				m_vVelY[i] = y;
+				m_vVelZ[i] = z;
+			}
+
+			template <typename C>
+			C& Get(entity_id id)
+			{
+				return std::get<std::vector<C>>(m_tComponents)[Dense(id)];
+			}
+
+			// Whole columns, for the systems of the application that run over every entity
+			template <typename C>
+			std::vector<C>& Column()
+			{
+				return std::get<std::vector<C>>(m_tComponents);
+			}
+
+			float* PositionX() { return m_vPosX.data(); }
+			float* PositionY() { return m_vPosY.data(); }
+			float* PositionZ() { return m_vPosZ.data(); }
+			float* VelocityX() { return m_vVelX.data(); }
+			float* VelocityY() { return m_vVelY.data(); }
+			float* VelocityZ() { return m_vVelZ.data(); }
+
+			// Flags an entity to be written by the next WriteChanges, for the changes the position check cannot see
+			void MarkDirty(entity_id id)
+			{
+				m_vDirty[Dense(id)] = 1;
+			}
+
+			bool IsDirty(entity_id id) const
+			{
+				return m_vDirty[Dense(id)] != 0;
+			}
+
+			// Moves every entity by its velocity over fDelta seconds
+			void Integrate(float fDelta)
+			{
+				IntegrateAxis(m_vPosX.data(), m_vVelX.data(), Size(), fDelta);
+				IntegrateAxis(m_vPosY.data(), m_vVelY.data(), Size(), fDelta);
+				IntegrateAxis(m_vPosZ.data(), m_vVelZ.data(), Size(), fDelta);
+			}
+
+			// Flags the entities that moved further than fThreshold from the position last written to the clients, the ones
+			// already flagged stay flagged. Returns the amount of dirty entities
+			size_t ComputeDirty(float fThreshold)
+			{
+				const size_t n = Size();
+				const float* px = m_vPosX.data();
+				const float* py = m_vPosY.data();
+				const float* pz = m_vPosZ.data();
+				const float* sx = m_vSentX.data();
+				const float* sy = m_vSentY.data();
+				const float* sz = m_vSentZ.data();
+				uint8_t* pDirty = m_vDirty.data();
+				const float fLimit = fThreshold * fThreshold;
+
+				size_t i = 0;
+#if defined(NETMSG_ENTITY_SSE2)
+				const __m128 vLimit = _mm_set1_ps(fLimit);
+				for (; i + 4 <= n; i += 4)
+				{
+					__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i), _mm_loadu_ps(sx + i));
+					__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i), _mm_loadu_ps(sy + i));
+					__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + i), _mm_loadu_ps(sz + i));
+					__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					int nMask = _mm_movemask_ps(_mm_cmpgt_ps(d2, vLimit));
+					pDirty[i + 0] |= uint8_t(nMask & 1);
+					pDirty[i + 1] |= uint8_t((nMask >> 1) & 1);
+					pDirty[i + 2] |= uint8_t((nMask >> 2) & 1);
+					pDirty[i + 3] |= uint8_t((nMask >> 3) & 1);
+				}
+#endif
+				for (; i < n; i++)
+				{
+					float dx = px[i] - sx[i];
+					float dy = py[i] - sy[i];
+					float dz = pz[i] - sz[i];
+					pDirty[i] |= uint8_t(dx * dx + dy * dy + dz * dz > fLimit);
+				}
+
+				size_t nDirty = 0;
+				for (size_t j = 0; j < n; j++)
+				{
+					nDirty += pDirty[j];
+				}
+				return nDirty;
+			}
+
+			// Writes the dirty entities into a replication message, from nStart in the arrays, until nMaxChanges of them are
+			// written. Their positions become the ones the clients know and their flags are cleared. Returns where to start
+			// the next message from, Size() once every dirty entity is written. The message reads back with ReadChanges
+			template <typename T>
+			size_t WriteChanges(message<T>& msg, size_t nMaxChanges, size_t nStart = 0)
+			{
+				const size_t n = Size();
+				size_t i = nStart;
+				uint32_t nCount = 0;
+				size_t nBody = msg.body.size();
+				msg.body.resize(nBody + nMaxChanges * sizeof(entity_change) + sizeof(uint32_t));
+				uint8_t* pOut = msg.body.data() + nBody;
+
+				for (; i < n && nCount < nMaxChanges; i++)
+				{
+					if (!m_vDirty[i])
+					{
+						continue;
+					}
+
+					entity_change change{ m_vDense[i], m_vPosX[i], m_vPosY[i], m_vPosZ[i] };
+					std::memcpy(pOut, &change, sizeof(change));
+					pOut += sizeof(change);
+					nCount++;
+
+					m_vSentX[i] = m_vPosX[i];
+					m_vSentY[i] = m_vPosY[i];
+					m_vSentZ[i] = m_vPosZ[i];
+					m_vDirty[i] = 0;
+				}
+
+				std::memcpy(pOut, &nCount, sizeof(nCount));
+				msg.body.resize(nBody + nCount * sizeof(entity_change) + sizeof(uint32_t));
+				msg.header.size = msg.size();
+				return i;
+			}
+
+			// Writes the entities at the given places of the arrays into a replication message, whether they are dirty or not,
+			// in the format of WriteChanges. Nothing is marked as sent, the list is the choice of one client (the entities
+			// replication_lod found due for it) and the others have not received them
+			template <typename T>
+			void WriteSelected(message<T>& msg, const uint32_t* pDense, size_t nCount)
+			{
+				size_t nBody = msg.body.size();
+				msg.body.resize(nBody + nCount * sizeof(entity_change) + sizeof(uint32_t));
+				uint8_t* pOut = msg.body.data() + nBody;
+
+				for (size_t c = 0; c < nCount; c++)
+				{
+					size_t i = pDense[c];
+					entity_change change{ m_vDense[i], m_vPosX[i], m_vPosY[i], m_vPosZ[i] };
+					std::memcpy(pOut, &change, sizeof(change));
+					pOut += sizeof(change);
+				}
+
+				uint32_t nWritten = uint32_t(nCount);
+				std::memcpy(pOut, &nWritten, sizeof(nWritten));
+				msg.header.size = msg.size();
+			}
+
+			// Walks the changes of a replication message, on the client. The message is left as it was
+			template <typename T, typename F>
+			static bool ReadChanges(const message<T>& msg, F&& fn)
+			{
+				uint32_t nCount = 0;
+				if (msg.body.size() < sizeof(nCount))
+				{
+					return false;
+				}
+				std::memcpy(&nCount, msg.body.data() + msg.body.size() - sizeof(nCount), sizeof(nCount));
+				size_t nBytes = size_t(nCount) * sizeof(entity_change);
+				if (nBytes + sizeof(nCount) > msg.body.size())
+				{
+					return false;
+				}
+
+				const uint8_t* pIn = msg.body.data() + msg.body.size() - sizeof(nCount) - nBytes;
+				for (uint32_t c = 0; c < nCount; c++)
+				{
+					entity_change change;
+					std::memcpy(&change, pIn + c * sizeof(entity_change), sizeof(change));
+					fn(change);
+				}
+				return true;
+			}
+
+		private:
+			static void IntegrateAxis(float* p, const float* v, size_t n, float fDelta)
+			{
+				size_t i = 0;
+#if defined(NETMSG_ENTITY_SSE2)
+				const __m128 vDelta = _mm_set1_ps(fDelta);
+				for (; i + 4 <= n; i += 4)
+				{
+					_mm_storeu_ps(p + i, _mm_add_ps(_mm_loadu_ps(p + i), _mm_mul_ps(_mm_loadu_ps(v + i), vDelta)));
+				}
+#endif
+				for (; i < n; i++)
+				{
+					p[i] += v[i] * fDelta;
+				}
+			}
+
+			void MoveDense(size_t nFrom, size_t nTo)
+			{
+				m_vDense[nTo] = m_vDense[nFrom];
+				for (auto* v : { &m_vPosX, &m_vPosY, &m_vPosZ, &m_vVelX, &m_vVelY, &m_vVelZ, &m_vSentX, &m_vSentY, &m_vSentZ })
+				{
+					(*v)[nTo] = (*v)[nFrom];
+				}
+				m_vDirty[nTo] = m_vDirty[nFrom];
+				std::apply([nFrom, nTo](auto&... v) { ((v[nTo] = std::move(v[nFrom])), ...); }, m_tComponents);
+			}
+
+			void PopDense()
+			{
+				m_vDense.pop_back();
+				for (auto* v : { &m_vPosX, &m_vPosY, &m_vPosZ, &m_vVelX, &m_vVelY, &m_vVelZ, &m_vSentX, &m_vSentY, &m_vSentZ })
+				{
+					v->pop_back();
+				}
+				m_vDirty.pop_back();
+				std::apply([](auto&... v) { (v.pop_back(), ...); }, m_tComponents);
+			}
+
+		private:
+			struct slot
+			{
+				uint32_t nDense = 0;
+				uint32_t nGeneration = 1;
+			};
+
+			std::vector<slot> m_vSlots;
+			std::vector<uint32_t> m_vFree;
+			std::vector<entity_id> m_vDense;
+			std::vector<float> m_vPosX, m_vPosY, m_vPosZ;
+			std::vector<float> m_vVelX, m_vVelY, m_vVelZ;
+			std::vector<float> m_vSentX, m_vSentY, m_vSentZ;
+			std::vector<uint8_t> m_vDirty;
+			std::tuple<std::vector<Components>...> m_tComponents;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "net_common.h"
+
+#include <array>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Compact reference to an object of a handle_table, an index into the table and the generation of the slot when the
+		// object was put there. A slot reused by another object has moved on to the next generation, so an old handle never
+		// resolves to the wrong object. Generation 0 is never handed out, the default handle refers to nothing
+		struct connection_handle
+		{
+			uint32_t nIndex = 0;
+			uint32_t nGeneration = 0;
+
+			bool IsNull() const
+			{
+				return nGeneration == 0;
+			}
+
+			bool operator==(const connection_handle& other) const
+			{
+				return nIndex == other.nIndex && nGeneration == other.nGeneration;
+			}
+
+			bool operator!=(const connection_handle& other) const
+			{
+				return !(*this == other);
+			}
+		};
+
+		// Objects referred to by handles instead of shared pointers. Copying a handle is copying 8 bytes, where copying a shared
+		// pointer is an atomic increment on the control block of the object (and a decrement when the copy goes away), which
+		// every thread touching the object writes to.
+		//
+		// The table keeps one reference to every object it holds. Acquire can be called from any thread, Resolve and Release
+		// belong to a single consumer thread (the one running the server Update). A handle has to reach the consumer through
+		// something that synchronises, a locked queue for example, which makes the slot written by Acquire visible to it. The
+		// slots live in chunks that are never moved, so Resolve reads them without a lock
+		template <typename Object>
+		class handle_table
+		{
+		public:
+			static constexpr size_t nChunkSize = 1024;
+			static constexpr size_t nMaxChunks = 4096;
+
+			handle_table() = default;
+			handle_table(const handle_table&) = delete;
+
+			connection_handle Acquire(std::shared_ptr<Object> object)
+			{
+				std::scoped_lock lock(m_muxSlots);
+				uint32_t nIndex;
+				if (!m_vFree.empty())
+				{
+					nIndex = m_vFree.back();
+					m_vFree.pop_back();
+				}
+				else
+				{
+					nIndex = m_nSlots.load(std::memory_order_relaxed);
+					if (nIndex / nChunkSize >= nMaxChunks)
+					{
+						throw std::runtime_error("Handle table is full");
+					}
+					if (!m_vChunks[nIndex / nChunkSize])
+					{
+						m_vChunks[nIndex / nChunkSize] = std::make_unique<slot[]>(nChunkSize);
+					}
+					m_nSlots.store(nIndex + 1, std::memory_order_release);
+				}
+
+				slot& s = Slot(nIndex);
+				s.object = std::move(object);
+				m_nSize++;
+				return { nIndex, s.nGeneration };
+			}
+
+			// The object of a handle, or a null pointer when the handle was released. The reference stays valid until the
+			// handle is released
+			std::shared_ptr<Object>& Resolve(connection_handle handle)
+			{
+				static std::shared_ptr<Object> null;
+				if (handle.IsNull() || handle.nIndex >= m_nSlots.load(std::memory_order_relaxed))
+				{
+					return null;
+				}
+
+				slot& s = Slot(handle.nIndex);
+				return s.nGeneration == handle.nGeneration ? s.object : null;
+			}
+
+			// Drops the reference of the table and moves the slot to its next generation, the old handles resolve to nothing
+			void Release(connection_handle handle)
+			{
+				if (Resolve(handle) == nullptr)
+				{
+					return;
+				}
+
+				std::scoped_lock lock(m_muxSlots);
+				slot& s = Slot(handle.nIndex);
+				s.object.reset();
+				s.nGeneration = s.nGeneration == std::numeric_limits<uint32_t>::max() ? 1 : s.nGeneration + 1;
+				m_vFree.push_back(handle.nIndex);
+				m_nSize--;
+			}
+
+			// Releases everything, the objects that hold on to an io_context have to go before the context does
+			void Clear()
+			{
+				std::scoped_lock lock(m_muxSlots);
+				for (uint32_t n = 0; n < m_nSlots; n++)
+				{
+					slot& s = Slot(n);
+					if (s.object)
+					{
+						s.object.reset();
+						s.nGeneration = s.nGeneration == std::numeric_limits<uint32_t>::max() ? 1 : s.nGeneration + 1;
+						m_vFree.push_back(n);
+					}
+				}
+				m_nSize = 0;
+			}
+
+			size_t Size() const
+			{
+				std::scoped_lock lock(m_muxSlots);
+				return m_nSize;
+			}
+
+		private:
+			struct slot
+			{
+				std::shared_ptr<Object> object;
+				uint32_t nGeneration = 1;
+			};
+
+			slot& Slot(uint32_t nIndex) const
+			{
+				return m_vChunks[nIndex / nChunkSize][nIndex % nChunkSize];
+			}
+
+		private:
+			mutable std::mutex m_muxSlots;
+			std::array<std::unique_ptr<slot[]>, nMaxChunks> m_vChunks;
+			std::vector<uint32_t> m_vFree;
+			std::atomic<uint32_t> m_nSlots = 0;
+			size_t m_nSize = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,297 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <array>
+#include <cmath>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Clock of the snapshot stamps, in microseconds. The clocks of the server and of the client do not need to agree, the 
+		// jitter buffer only looks at how the transit time of the snapshots varies from one to the next
+		inline uint64_t SnapshotClock()
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		// The server stamps a state message right before sending it, the stamp is pushed last so it is the first thing the 
+		// client pulls out of the message
+		template<typename T>
+		void StampSnapshot(message<T>& msg)
+		{
+			msg << SnapshotClock();
+		}
+
+		template<typename T>
+		uint64_t PopSnapshotStamp(message<T>& msg)
+		{
+			uint64_t nTime = 0;
+			msg >> nTime;
+			return nTime;
+		}
+
+		// Default interpolation, enough for numbers and for any vector type with the usual operators
+		template<typename S>
+		struct snapshot_lerp
+		{
+			S operator()(const S& a, const S& b, double t) const
+			{
+				return a + (b - a) * t;
+			}
+		};
+
+		struct jitter_options
+		{
+			// Bounds of the playback delay
+			std::chrono::microseconds tMinDelay = std::chrono::milliseconds(0);
+			std::chrono::microseconds tMaxDelay = std::chrono::milliseconds(500);
+			// The delay covers one send interval plus this many times the measured jitter
+			double dJitterFactor = 3.0;
+			// How much faster or slower than real time the playback may run while the delay moves to its new target, a change of
+			// delay is spread over time instead of making the state jump
+			double dMaxWarp = 0.1;
+			// Snapshots kept at most, the oldest are dropped when the application stops sampling
+			size_t nMaxSnapshots = 64;
+		};
+
+		// Client side jitter buffer. The snapshots of a state the server sends at a steady rate (an entity position, the score 
+		// board...) arrive with uneven gaps, played as they arrive they stutter. The buffer plays them back a little later than 
+		// they arrive, late enough that the next snapshot is almost always there already, and interpolates between the two 
+		// snapshots around the playback time. The delay adapts to the network: it is one send interval plus a few times the 
+		// measured jitter, so the server can lower its send rate and a quiet network keeps a short delay.
+		//
+		// It is not thread-safe, the application pushes the snapshots it pops from the incoming queue and samples the buffer 
+		// from the same thread, usually once per frame
+		template<typename S, typename Interpolate = snapshot_lerp<S>>
+		class jitter_buffer
+		{
+		public:
+			struct snapshot
+			{
+				uint64_t nTime = 0;
+				S state;
+			};
+
+			jitter_buffer(const jitter_options& options = jitter_options(), Interpolate fnInterpolate = Interpolate())
+				: m_options(options), m_fnInterpolate(fnInterpolate)
+			{
+
+			}
+
+			// Adds a snapshot stamped with the server time. Returns false if it is a duplicate or if the playback is already past
+			// it, a late snapshot still counts towards the jitter so the delay grows
+			bool Push(uint64_t nServerTime, const S& state, uint64_t nArrival = SnapshotClock())
+			{
+				Measure(nServerTime, nArrival);
+
+				if (m_bPlaying && int64_t(nServerTime) <= m_nRender)
+				{
+					m_nLate++;
+					return false;
+				}
+
+				// Snapshots almost always arrive in order, the search starts from the newest
+				auto it = m_deqSnapshots.end();
+				while (it != m_deqSnapshots.begin() && std::prev(it)->nTime >= nServerTime)
+				{
+					--it;
+				}
+				if (it != m_deqSnapshots.end() && it->nTime == nServerTime)
+				{
+					return false;
+				}
+				m_deqSnapshots.insert(it, { nServerTime, state });
+
+				while (m_deqSnapshots.size() > m_options.nMaxSnapshots)
+				{
+					m_deqSnapshots.pop_front();
+				}
+				return true;
+			}
+
+			// Writes the state at the current playback time, false while there is nothing to play yet. When the playback catches 
+			// up with the newest snapshot the state holds on it and the underrun is counted
+			bool Sample(S& state, uint64_t nNow = SnapshotClock())
+			{
+				if (m_deqSnapshots.empty())
+				{
+					return false;
+				}
+
+				// The delay moves towards its target at most by the warp factor of the time elapsed since the last sample
+				double dTarget = TargetDelay();
+				if (!m_bPlaying)
+				{
+					m_dDelay = dTarget;
+					m_nRender = std::numeric_limits<int64_t>::min();
+					m_bPlaying = true;
+				}
+				else
+				{
+					double dStep = m_options.dMaxWarp * double(nNow - std::min(nNow, m_nLastSample));
+					m_dDelay += std::clamp(dTarget - m_dDelay, -dStep, dStep);
+				}
+				m_nLastSample = nNow;
+
+				// The playback time is in the clock of the server, it never goes backwards
+				m_nRender = std::max(m_nRender, int64_t(nNow) - m_nBaseTransit - int64_t(m_dDelay));
+
+				while (m_deqSnapshots.size() > 1 && int64_t(m_deqSnapshots[1].nTime) <= m_nRender)
+				{
+					m_deqSnapshots.pop_front();
+				}
+
+				const snapshot& a = m_deqSnapshots.front();
+				if (m_nRender <= int64_t(a.nTime))
+				{
+					state = a.state;
+				}
+				else if (m_deqSnapshots.size() == 1)
+				{
+					state = a.state;
+					m_nUnderruns++;
+				}
+				else
+				{
+					const snapshot& b = m_deqSnapshots[1];
+					state = m_fnInterpolate(a.state, b.state, double(m_nRender - int64_t(a.nTime)) / double(b.nTime - a.nTime));
+				}
+				return true;
+			}
+
+			void Clear()
+			{
+				m_deqSnapshots.clear();
+				m_bPlaying = false;
+				m_nTransits = 0;
+				m_nBaseTransit = 0;
+				m_nLastServerTime = 0;
+				m_dJitter = 0.0;
+				m_dInterval = 0.0;
+			}
+
+			size_t Size() const
+			{
+				return m_deqSnapshots.size();
+			}
+
+			// Current playback delay, measured jitter and send interval, in microseconds
+			double Delay() const
+			{
+				return m_dDelay;
+			}
+
+			double Jitter() const
+			{
+				return m_dJitter;
+			}
+
+			double Interval() const
+			{
+				return m_dInterval;
+			}
+
+			// Snapshots that arrived after their playback time, and samples that ran out of snapshots
+			uint64_t Late() const
+			{
+				return m_nLate;
+			}
+
+			uint64_t Underruns() const
+			{
+				return m_nUnderruns;
+			}
+
+		private:
+			// The transit time is the arrival time minus the server stamp, it includes the unknown offset between both clocks. 
+			// The smallest transit of the recent snapshots is taken as the base, the snapshot that came the fastest, and the 
+			// jitter is smoothed the same way RTP does it, from the difference of transit between consecutive snapshots
+			void Measure(uint64_t nServerTime, uint64_t nArrival)
+			{
+				int64_t nTransit = int64_t(nArrival) - int64_t(nServerTime);
+
+				if (m_nTransits > 0)
+				{
+					m_dJitter += (std::abs(double(nTransit - m_nLastTransit)) - m_dJitter) / 16.0;
+					if (nServerTime > m_nLastServerTime)
+					{
+						double dGap = double(nServerTime - m_nLastServerTime);
+						m_dInterval = m_dInterval == 0.0 ? dGap : m_dInterval + (dGap - m_dInterval) / 8.0;
+					}
+				}
+				m_nLastTransit = nTransit;
+				m_nLastServerTime = std::max(m_nLastServerTime, nServerTime);
+
+				m_vTransits[m_nTransits % m_vTransits.size()] = nTransit;
+				m_nTransits++;
+				m_nBaseTransit = *std::min_element(m_vTransits.begin(), m_vTransits.begin() + std::min<size_t>(m_nTransits, m_vTransits.size()));
+			}
+
+			double TargetDelay() const
+			{
+				double dDelay = m_dInterval + m_options.dJitterFactor * m_dJitter;
+				return std::clamp(dDelay, double(m_options.tMinDelay.count()), double(m_options.tMaxDelay.count()));
+			}
+
+		private:
+			jitter_options m_options;
+			Interpolate m_fnInterpolate;
+			std::deque<snapshot> m_deqSnapshots;
+
+			// Playback state
+			bool m_bPlaying = false;
+			double m_dDelay = 0.0;
+			int64_t m_nRender = 0;
+			uint64_t m_nLastSample = 0;
+
+			// Network measurements
+			std::array<int64_t, 64> m_vTransits{};
+			size_t m_nTransits = 0;
+			int64_t m_nBaseTransit = 0;
+			int64_t m_nLastTransit = 0;
+			uint64_t m_nLastServerTime = 0;
+			double m_dJitter = 0.0;
+			double m_dInterval = 0.0;
+
+			uint64_t m_nLate = 0;
+			uint64_t m_nUnderruns = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_entity.h"
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Entities up to fDistance away from the observer are sent to it once every nInterval ticks
+		struct lod_band
+		{
+			float fDistance = 0.0f;
+			uint32_t nInterval = 1;
+		};
+
+		// Replication level of detail. A client does not notice that an entity far away from its player moves in steps a
+		// few ticks apart, the step is a fraction of a pixel on its screen, so the entities of a client are only sent to it
+		// as often as their distance asks for. The bands are sorted by distance: every tick near the player, every other
+		// tick further out, and so on. The entities further than the last band are out of range of the observer and never
+		// sent to it, a last band at infinity sends the whole world.
+		//
+		// The tick an entity goes out on is not the same for every entity of a band, each pair of observer and entity has
+		// a phase of its own, taken from a hash of both. A band with an interval of 8 then sends an eighth of its entities
+		// on every tick instead of all of them on one tick out of eight, and the same entity goes out on different ticks
+		// for different clients, so the bandwidth of the server stays flat from one tick to the next.
+		//
+		// The scheduler keeps no state per observer or per entity, a pair is due when (tick + phase) is a multiple of its
+		// interval, so it costs nothing for observers to come and go. It belongs to the thread running the game tick
+		class replication_lod
+		{
+		public:
+			replication_lod(std::vector<lod_band> vBands = { { 25.0f, 1 }, { 50.0f, 2 }, { 100.0f, 4 }, { 200.0f, 8 } })
+			{
+				SetBands(std::move(vBands));
+			}
+
+			void SetBands(std::vector<lod_band> vBands)
+			{
+				for (size_t i = 0; i < vBands.size(); i++)
+				{
+					if (vBands[i].nInterval == 0 || (i > 0 && vBands[i].fDistance < vBands[i - 1].fDistance))
+					{
+						throw std::runtime_error("Level of detail bands must be sorted by distance and have an interval of at least 1");
+					}
+				}
+
+				m_vBands = std::move(vBands);
+				m_vLimits.clear();
+				for (const auto& band : m_vBands)
+				{
+					m_vLimits.push_back(band.fDistance * band.fDistance);
+				}
+			}
+
+			const std::vector<lod_band>& Bands() const
+			{
+				return m_vBands;
+			}
+
+			// Interval of an entity at a squared distance from the observer, 0 when it is out of range
+			uint32_t Interval(float fDistanceSquared) const
+			{
+				// Most of a large world is out of range of any one observer
+				if (m_vLimits.empty() || fDistanceSquared > m_vLimits.back())
+				{
+					return 0;
+				}
+				for (size_t b = 0; b < m_vLimits.size(); b++)
+				{
+					if (fDistanceSquared <= m_vLimits[b])
+					{
+						return m_vBands[b].nInterval;
+					}
+				}
+				return 0;
+			}
+
+			// Tick offset of a pair of observer and entity, the slot is enough to spread them
+			static uint32_t Phase(uint32_t nObserver, entity_id id)
+			{
+				uint32_t h = id.nIndex * 0x9E3779B1u ^ nObserver * 0x85EBCA77u;
+				h ^= h >> 16;
+				h *= 0x7FEB352Du;
+				h ^= h >> 15;
+				return h;
+			}
+
+			static bool Due(uint64_t nTick, uint32_t nObserver, entity_id id, uint32_t nInterval)
+			{
+				return nInterval != 0 && (nTick + Phase(nObserver, id)) % nInterval == 0;
+			}
+
+			// Appends to vDue the places in the arrays of the store of the entities due for the observer on this tick, ready
+			// for entity_store::WriteSelected. The observer is usually the identifier of the connection, and (x, y, z) where
+			// its player stands. pRelevance is an optional column of the application, one value per entity in the order of
+			// the arrays: the distance of an entity is divided by it, so a relevance of 2 sends the entity as if it were half
+			// as far (a boss, the target of the player) and a relevance of 0.5 as if it were twice as far. A relevance of 0
+			// (or below, or NaN) never sends the entity, the way to hide one from an observer without a division by zero.
+			// Returns the amount of entities appended
+			template <typename... Components>
+			size_t Schedule(entity_store<Components...>& store, uint32_t nObserver, float x, float y, float z, uint64_t nTick,
+				std::vector<uint32_t>& vDue, const float* pRelevance = nullptr)
+			{
+				const size_t n = store.Size();
+				m_vDistance.resize(n);
+				DistanceSquared(store.PositionX(), store.PositionY(), store.PositionZ(), n, x, y, z, m_vDistance.data());
+
+				size_t nBefore = vDue.size();
+				for (size_t i = 0; i < n; i++)
+				{
+					float fDistanceSquared = m_vDistance[i];
+					if (pRelevance)
+					{
+						if (!(pRelevance[i] > 0.0f))
+						{
+							continue;
+						}
+						fDistanceSquared /= pRelevance[i] * pRelevance[i];
+					}
+
+					if (Due(nTick, nObserver, store.Entity(i), Interval(fDistanceSquared)))
+					{
+						vDue.push_back(uint32_t(i));
+					}
+				}
+				return vDue.size() - nBefore;
+			}
+
+		private:
+			// Squared distance of every entity from the observer, four at a time when SSE2 is there
+			static void DistanceSquared(const float* px, const float* py, const float* pz, size_t n, float x, float y, float z, float* pOut)
+			{
+				size_t i = 0;
+#if defined(NETMSG_ENTITY_SSE2)
+				const __m128 vx = _mm_set1_ps(x);
+				const __m128 vy = _mm_set1_ps(y);
+				const __m128 vz = _mm_set1_ps(z);
+				for (; i + 4 <= n; i += 4)
+				{
+					__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i), vx);
+					__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i), vy);
+					__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + i), vz);
+					_mm_storeu_ps(pOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+				}
+#endif
+				for (; i < n; i++)
+				{
+					float dx = px[i] - x;
+					float dy = py[i] - y;
+					float dz = pz[i] - z;
+					pOut[i] = dx * dx + dy * dy + dz * dz;
+				}
+			}
+
+		private:
+			std::vector<lod_band> m_vBands;
+			std::vector<float> m_vLimits;
+			std::vector<float> m_vDistance;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,448 @@
+#pragma once
+
+#include "net_common.h"
+
+#include <condition_variable>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// Lowest level compiled into the program, the lines below it are removed by the compiler along with the formatting of their
+// arguments. 0 keeps everything down to Trace, 5 removes every line. Defined before the framework is included (or on the
+// compiler command line), the default keeps Debug lines in so they can still be turned on at runtime with logger::SetLevel
+#ifndef NETMSG_LOG_LEVEL
+#define NETMSG_LOG_LEVEL 1
+#endif
+
+// The arguments are a stream expression, "[" << id << "] Read Header Fail", which is only evaluated when the level is enabled
+#define NETMSG_LOG(level, expr) \
+	do \
+	{ \
+		if constexpr (int(level) >= NETMSG_LOG_LEVEL) \
+		{ \
+			if (netmsg::net::logger::Enabled(level)) \
+			{ \
+				netmsg::net::log_line netmsgLogLine(level); \
+				netmsgLogLine << expr; \
+			} \
+		} \
+	} while (false)
+
+#define NETMSG_LOG_TRACE(expr) NETMSG_LOG(netmsg::net::log_level::Trace, expr)
+#define NETMSG_LOG_DEBUG(expr) NETMSG_LOG(netmsg::net::log_level::Debug, expr)
+#define NETMSG_LOG_INFO(expr) NETMSG_LOG(netmsg::net::log_level::Info, expr)
+#define NETMSG_LOG_WARNING(expr) NETMSG_LOG(netmsg::net::log_level::Warning, expr)
+#define NETMSG_LOG_ERROR(expr) NETMSG_LOG(netmsg::net::log_level::Error, expr)
+
+namespace netmsg
+{
+	namespace net
+	{
+		enum class log_level : uint8_t
+		{
+			Trace,
+			Debug,
+			Info,
+			Warning,
+			Error,
+			Off,
+		};
+
+		// Receives every line written, on the thread of the logger, so it can be as slow as it needs to be
+		using log_sink = std::function<void(log_level level, const char* sText, size_t nLength)>;
+
+		// One formatted line waiting in the buffer of its thread, longer lines are cut
+		struct log_record
+		{
+			static constexpr size_t nMaxLength = 200;
+			log_level level = log_level::Info;
+			uint8_t nLength = 0;
+			char sText[nMaxLength];
+		};
+
+		// Buffer of the lines written by one thread, a ring with a single producer (the thread) and a single consumer (the
+		// logger thread), so neither side ever takes a lock. When the ring is full the line is dropped and counted instead of
+		// making the thread wait, a thread doing network I/O must never block on the console
+		class log_buffer
+		{
+		public:
+			static constexpr size_t nCapacity = 512;
+
+			bool Push(const log_record& record)
+			{
+				uint64_t nTail = m_nTail.load(std::memory_order_relaxed);
+				if (nTail - m_nHead.load(std::memory_order_acquire) >= nCapacity)
+				{
+					m_nDropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				m_vRecords[nTail % nCapacity] = record;
+				m_nTail.store(nTail + 1, std::memory_order_release);
+				return true;
+			}
+
+			// Hands every waiting line to the function, in the order they were written
+			template <typename F>
+			size_t Drain(F&& fn)
+			{
+				uint64_t nHead = m_nHead.load(std::memory_order_relaxed);
+				uint64_t nTail = m_nTail.load(std::memory_order_acquire);
+				for (uint64_t n = nHead; n < nTail; n++)
+				{
+					fn(m_vRecords[n % nCapacity]);
+				}
+				m_nHead.store(nTail, std::memory_order_release);
+				return size_t(nTail - nHead);
+			}
+
+			bool Empty() const
+			{
+				return m_nHead.load(std::memory_order_acquire) == m_nTail.load(std::memory_order_acquire);
+			}
+
+			uint64_t TakeDropped()
+			{
+				return m_nDropped.exchange(0, std::memory_order_relaxed);
+			}
+
+			// Set when its thread exits, the logger then hands the buffer to the next thread that needs one
+			std::atomic<bool> bAbandoned = false;
+
+		private:
+			std::vector<log_record> m_vRecords = std::vector<log_record>(nCapacity);
+			alignas(64) std::atomic<uint64_t> m_nHead = 0;
+			alignas(64) std::atomic<uint64_t> m_nTail = 0;
+			std::atomic<uint64_t> m_nDropped = 0;
+		};
+
+		// Process wide logger. Every thread writes its lines into a buffer of its own, and a background thread started with
+		// the first line moves them to the sink (the console by default) every few milliseconds, so writing a line costs its
+		// formatting and a copy. The logger is never destroyed: once the program starts exiting it flushes what is left and
+		// writes the lines that still come, from the destructors of static objects, straight to the sink
+		class logger
+		{
+		public:
+			static logger& Get()
+			{
+				static logger* pLogger = new logger();
+				return *pLogger;
+			}
+
+			static bool Enabled(log_level level)
+			{
+				return int(level) >= NETMSG_LOG_LEVEL && level >= Get().m_level.load(std::memory_order_relaxed);
+			}
+
+			// Runtime level, Info by default, it can only enable the levels that were compiled in with NETMSG_LOG_LEVEL
+			static void SetLevel(log_level level)
+			{
+				Get().m_level = level;
+			}
+
+			static void SetSink(log_sink fnSink)
+			{
+				logger& log = Get();
+				std::scoped_lock lock(log.m_muxSink);
+				log.m_fnSink = std::move(fnSink);
+			}
+
+			// Waits until every line written before the call reached the sink
+			static void Flush()
+			{
+				logger& log = Get();
+				std::unique_lock lock(log.m_muxBuffers);
+				if (!log.m_threadDrain.joinable() || log.m_bShutdown)
+				{
+					return;
+				}
+				uint64_t nRequest = ++log.m_nFlushRequested;
+				log.m_cvWake.notify_one();
+				log.m_cvFlushed.wait(lock, [&]() { return log.m_nFlushDone >= nRequest || log.m_bShutdown; });
+			}
+
+			void Write(const log_record& record)
+			{
+				if (tbExited || m_bShutdown.load(std::memory_order_acquire))
+				{
+					// The lines still buffered were written first, they go out first
+					Flush();
+					WriteToSink(record);
+					return;
+				}
+
+				log_buffer* pBuffer = tpBuffer;
+				if (!pBuffer)
+				{
+					pBuffer = Register();
+				}
+				pBuffer->Push(record);
+			}
+
+		private:
+			logger() = default;
+
+			// Marks the buffer of a thread as abandoned when the thread exits. The pointer to the buffer is a plain thread_local
+			// so it is still there when a destructor running after this one writes a line, which then goes straight to the sink
+			struct thread_exit
+			{
+				~thread_exit()
+				{
+					tbExited = true;
+					if (tpBuffer)
+					{
+						tpBuffer->bAbandoned = true;
+					}
+				}
+			};
+
+			// Flushes the buffers once main returns, constructed with the first buffer so it is destroyed before the objects
+			// constructed earlier, which may still write a line or two from their destructors
+			struct process_exit
+			{
+				~process_exit()
+				{
+					Get().Shutdown();
+				}
+			};
+
+			log_buffer* Register()
+			{
+				static thread_local thread_exit threadExit;
+				(void)threadExit;
+
+				std::scoped_lock lock(m_muxBuffers);
+				static process_exit processExit;
+				(void)processExit;
+
+				// A buffer left by a thread that exited is reused once the logger thread emptied it
+				for (auto& buffer : m_vBuffers)
+				{
+					if (buffer->bAbandoned && buffer->Empty())
+					{
+						buffer->bAbandoned = false;
+						tpBuffer = buffer.get();
+						return tpBuffer;
+					}
+				}
+				m_vBuffers.push_back(std::make_unique<log_buffer>());
+				tpBuffer = m_vBuffers.back().get();
+
+				if (!m_threadDrain.joinable())
+				{
+					m_threadDrain = std::thread([this]() { Run(); });
+				}
+				return tpBuffer;
+			}
+
+			void Run()
+			{
+				std::unique_lock lock(m_muxBuffers);
+				while (!m_bShutdown)
+				{
+					m_cvWake.wait_for(lock, std::chrono::milliseconds(5));
+					uint64_t nRequest = m_nFlushRequested;
+					DrainAll();
+					m_nFlushDone = nRequest;
+					m_cvFlushed.notify_all();
+				}
+				DrainAll();
+			}
+
+			// Called with the buffer list locked, the lines are only handed to the sink once the list is released so a thread
+			// registering its buffer does not wait for the console
+			void DrainAll()
+			{
+				std::vector<log_record> vLines;
+				uint64_t nDropped = 0;
+				for (auto& buffer : m_vBuffers)
+				{
+					buffer->Drain([&](const log_record& record) { vLines.push_back(record); });
+					nDropped += buffer->TakeDropped();
+				}
+				if (vLines.empty() && nDropped == 0)
+				{
+					return;
+				}
+
+				m_muxBuffers.unlock();
+				for (const auto& record : vLines)
+				{
+					WriteToSink(record);
+				}
+				if (nDropped > 0)
+				{
+					log_record record;
+					record.level = log_level::Warning;
+					int n = std::snprintf(record.sText, log_record::nMaxLength, "[LOG] %llu lines dropped", (unsigned long long)nDropped);
+					record.nLength = uint8_t(std::clamp(n, 0, int(log_record::nMaxLength) - 1));
+					WriteToSink(record);
+				}
+				std::cout.flush();
+				m_muxBuffers.lock();
+			}
+
+			void WriteToSink(const log_record& record)
+			{
+				std::scoped_lock lock(m_muxSink);
+				if (m_fnSink)
+				{
+					m_fnSink(record.level, record.sText, record.nLength);
+					return;
+				}
+				std::ostream& os = record.level >= log_level::Error ? std::cerr : std::cout;
+				os.write(record.sText, record.nLength);
+				os.put('\n');
+			}
+
+			void Shutdown()
+			{
+				{
+					std::scoped_lock lock(m_muxBuffers);
+					m_bShutdown = true;
+				}
+				m_cvWake.notify_one();
+				m_cvFlushed.notify_all();
+				if (m_threadDrain.joinable())
+				{
+					m_threadDrain.join();
+				}
+				std::cout.flush();
+			}
+
+		private:
+			std::atomic<log_level> m_level = log_level::Info;
+			std::atomic<bool> m_bShutdown = false;
+			std::mutex m_muxBuffers;
+			std::condition_variable m_cvWake;
+			std::condition_variable m_cvFlushed;
+			uint64_t m_nFlushRequested = 0;
+			uint64_t m_nFlushDone = 0;
+			std::vector<std::unique_ptr<log_buffer>> m_vBuffers;
+			std::thread m_threadDrain;
+			std::mutex m_muxSink;
+			log_sink m_fnSink;
+
+			static inline thread_local log_buffer* tpBuffer = nullptr;
+			static inline thread_local bool tbExited = false;
+		};
+
+		// A line being formatted, on the stack of the thread writing it. The common types are formatted by hand, anything else
+		// with an output stream operator goes through a string stream. The line is handed to the logger when it goes out of scope
+		class log_line
+		{
+		public:
+			log_line(log_level level)
+			{
+				m_record.level = level;
+			}
+
+			~log_line()
+			{
+				m_record.nLength = uint8_t(m_nLength);
+				logger::Get().Write(m_record);
+			}
+
+			log_line& operator<<(std::string_view s)
+			{
+				size_t n = std::min(s.size(), log_record::nMaxLength - m_nLength);
+				std::memcpy(m_record.sText + m_nLength, s.data(), n);
+				m_nLength += n;
+				return *this;
+			}
+
+			log_line& operator<<(const char* s)
+			{
+				return *this << std::string_view(s);
+			}
+
+			log_line& operator<<(const std::string& s)
+			{
+				return *this << std::string_view(s);
+			}
+
+			log_line& operator<<(char c)
+			{
+				return *this << std::string_view(&c, 1);
+			}
+
+			log_line& operator<<(bool b)
+			{
+				return *this << (b ? "1" : "0");
+			}
+
+			// Doubles are written the way std::cout writes them, six significant digits
+			log_line& operator<<(double d)
+			{
+				char sNumber[32];
+				int n = std::snprintf(sNumber, sizeof(sNumber), "%g", d);
+				return *this << std::string_view(sNumber, size_t(std::max(n, 0)));
+			}
+
+			template <typename V>
+			log_line& operator<<(const V& value)
+			{
+				if constexpr (std::is_integral_v<V>)
+				{
+					char sNumber[24];
+					auto result = std::to_chars(sNumber, sNumber + sizeof(sNumber), value);
+					return *this << std::string_view(sNumber, size_t(result.ptr - sNumber));
+				}
+				else if constexpr (std::is_enum_v<V>)
+				{
+					return *this << std::underlying_type_t<V>(value);
+				}
+				else if constexpr (std::is_floating_point_v<V>)
+				{
+					return *this << double(value);
+				}
+				else
+				{
+					std::ostringstream os;
+					os << value;
+					return *this << os.str();
+				}
+			}
+
+		private:
+			log_record m_record;
+			size_t m_nLength = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
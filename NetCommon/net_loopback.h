@@ -0,0 +1,536 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_transport.h"
+
+#include <unordered_map>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Name a loopback server listens on, and the remote endpoint of every loopback socket
+		struct loopback_endpoint
+		{
+			std::string sName;
+
+			friend std::ostream& operator<<(std::ostream& os, const loopback_endpoint& endpoint)
+			{
+				os << "loopback:" << endpoint.sName;
+				return os;
+			}
+		};
+
+		// Both directions of one loopback connection, shared by its two sockets. Side 0 is the socket that connected and side 1
+		// the one that was accepted, each side reads the pipe of its own index and writes the other one. A pipe holds at most
+		// one read waiting for data, the framework never has two reads in flight on a socket
+		class loopback_stream
+		{
+		public:
+			struct pending_read
+			{
+				std::vector<asio::mutable_buffer> vBuffers;
+
+				virtual ~pending_read() = default;
+				virtual void Complete(asio::error_code ec, size_t nBytes) = 0;
+			};
+
+			struct pipe
+			{
+				std::vector<uint8_t> vData;
+				size_t nOffset = 0;
+				std::unique_ptr<pending_read> pReader;
+
+				// Copies what is buffered into the buffers of a read, the vector is only rewound once it has been drained
+				size_t Drain(const std::vector<asio::mutable_buffer>& vBuffers)
+				{
+					size_t nBytes = asio::buffer_copy(vBuffers, asio::buffer(vData.data() + nOffset, vData.size() - nOffset));
+					nOffset += nBytes;
+					if (nOffset == vData.size())
+					{
+						vData.clear();
+						nOffset = 0;
+					}
+					return nBytes;
+				}
+
+				bool Empty() const
+				{
+					return nOffset == vData.size();
+				}
+			};
+
+			std::mutex muxStream;
+			pipe pipes[2];
+			bool bClosed = false;
+		};
+
+		// In-process stand-in for a stream socket, for the benchmarks and the tests that want the cost of the framework without
+		// the cost of the kernel. The bytes written on one end are copied into memory owned by the connection and handed to the
+		// read waiting on the other end, on the context of that end, so the two ends can run on different contexts (a client
+		// and a server) like real sockets. Writes always complete at once, nothing limits how much a side can buffer.
+		//
+		// Only what the framework needs from a socket is there: the asynchronous read_some and write_some the ASIO stream
+		// functions are built on, is_open, close and remote_endpoint. Closing one end completes the read waiting on the other
+		// end with end of file once the buffered data has been read, like a TCP peer would
+		class loopback_socket
+		{
+		public:
+			using executor_type = asio::io_context::executor_type;
+
+			explicit loopback_socket(asio::io_context& context) : m_pContext(&context)
+			{
+
+			}
+
+			// One end of a new connection, open from the start
+			loopback_socket(asio::io_context& context, std::shared_ptr<loopback_stream> stream, size_t nSide, std::string sName)
+				: m_pContext(&context), m_stream(std::move(stream)), m_nSide(nSide), m_sName(std::move(sName)), m_bOpen(true)
+			{
+
+			}
+
+			loopback_socket(loopback_socket&& other) noexcept
+				: m_pContext(other.m_pContext), m_stream(std::move(other.m_stream)), m_nSide(other.m_nSide), m_sName(std::move(other.m_sName))
+			{
+				m_bOpen = other.m_bOpen.exchange(false);
+			}
+
+			loopback_socket& operator=(loopback_socket&& other) noexcept
+			{
+				if (this != &other)
+				{
+					close();
+					m_pContext = other.m_pContext;
+					m_stream = std::move(other.m_stream);
+					m_nSide = other.m_nSide;
+					m_sName = std::move(other.m_sName);
+					m_bOpen = other.m_bOpen.exchange(false);
+				}
+				return *this;
+			}
+
+			~loopback_socket()
+			{
+				close();
+			}
+
+			executor_type get_executor() noexcept
+			{
+				return m_pContext->get_executor();
+			}
+
+			bool is_open() const
+			{
+				return m_bOpen.load(std::memory_order_acquire);
+			}
+
+			loopback_endpoint remote_endpoint() const
+			{
+				return { m_sName };
+			}
+
+			// The read waiting on this end is aborted and the one waiting on the other end gets the end of file
+			void close()
+			{
+				if (!m_bOpen.exchange(false))
+				{
+					return;
+				}
+
+				std::unique_ptr<loopback_stream::pending_read> pOwn, pPeer;
+				{
+					std::scoped_lock lock(m_stream->muxStream);
+					m_stream->bClosed = true;
+					pOwn = std::move(m_stream->pipes[m_nSide].pReader);
+					if (m_stream->pipes[1 - m_nSide].Empty())
+					{
+						pPeer = std::move(m_stream->pipes[1 - m_nSide].pReader);
+					}
+				}
+
+				if (pOwn)
+				{
+					pOwn->Complete(asio::error::operation_aborted, 0);
+				}
+				if (pPeer)
+				{
+					pPeer->Complete(asio::error::eof, 0);
+				}
+			}
+
+			template <typename MutableBuffers, typename Handler>
+			void async_read_some(const MutableBuffers& buffers, Handler&& handler)
+			{
+				auto pRead = std::make_unique<stream_operation<std::decay_t<Handler>>>(std::forward<Handler>(handler), get_executor());
+				pRead->vBuffers.assign(asio::buffer_sequence_begin(buffers), asio::buffer_sequence_end(buffers));
+				if (!is_open())
+				{
+					pRead->Complete(asio::error::bad_descriptor, 0);
+					return;
+				}
+				if (asio::buffer_size(pRead->vBuffers) == 0)
+				{
+					pRead->Complete({}, 0);
+					return;
+				}
+
+				asio::error_code ec;
+				size_t nBytes = 0;
+				{
+					std::scoped_lock lock(m_stream->muxStream);
+					loopback_stream::pipe& in = m_stream->pipes[m_nSide];
+					if (!in.Empty())
+					{
+						nBytes = in.Drain(pRead->vBuffers);
+					}
+					else if (m_stream->bClosed)
+					{
+						ec = asio::error::eof;
+					}
+					else
+					{
+						in.pReader = std::move(pRead);
+						return;
+					}
+				}
+				pRead->Complete(ec, nBytes);
+			}
+
+			template <typename ConstBuffers, typename Handler>
+			void async_write_some(const ConstBuffers& buffers, Handler&& handler)
+			{
+				auto pWrite = std::make_unique<stream_operation<std::decay_t<Handler>>>(std::forward<Handler>(handler), get_executor());
+				if (!is_open())
+				{
+					pWrite->Complete(asio::error::bad_descriptor, 0);
+					return;
+				}
+
+				size_t nBytes = asio::buffer_size(buffers);
+				asio::error_code ec;
+				std::unique_ptr<loopback_stream::pending_read> pPeer;
+				size_t nPeerBytes = 0;
+				{
+					std::scoped_lock lock(m_stream->muxStream);
+					if (m_stream->bClosed)
+					{
+						ec = asio::error::broken_pipe;
+						nBytes = 0;
+					}
+					else
+					{
+						loopback_stream::pipe& out = m_stream->pipes[1 - m_nSide];
+						size_t nEnd = out.vData.size();
+						out.vData.resize(nEnd + nBytes);
+						asio::buffer_copy(asio::buffer(out.vData.data() + nEnd, nBytes), buffers);
+						if (out.pReader)
+						{
+							pPeer = std::move(out.pReader);
+							nPeerBytes = out.Drain(pPeer->vBuffers);
+						}
+					}
+				}
+
+				if (pPeer)
+				{
+					pPeer->Complete({}, nPeerBytes);
+				}
+				pWrite->Complete(ec, nBytes);
+			}
+
+		private:
+			// A handler waiting for its completion, it keeps the context of its socket running until then. It is completed on the
+			// executor the handler is associated with, the context of its socket by default, never inside the call that started
+			// it or on the thread of the other end
+			template <typename Handler>
+			struct stream_operation : loopback_stream::pending_read
+			{
+				stream_operation(Handler&& h, const executor_type& executor) : handler(std::move(h)), work(executor)
+				{
+
+				}
+
+				void Complete(asio::error_code ec, size_t nBytes) override
+				{
+					auto executor = asio::get_associated_executor(handler, work.get_executor());
+					asio::post(executor,
+						[handler = std::move(handler), ec, nBytes]() mutable
+						{
+							handler(ec, nBytes);
+						});
+					work.reset();
+				}
+
+				Handler handler;
+				asio::executor_work_guard<executor_type> work;
+			};
+
+		private:
+			asio::io_context* m_pContext;
+			std::shared_ptr<loopback_stream> m_stream;
+			size_t m_nSide = 0;
+			std::string m_sName;
+			std::atomic<bool> m_bOpen = false;
+
+			friend struct loopback_transport;
+		};
+
+		// Listens on a name instead of a port, the names live in a table of the process. A connection to a name nobody listens
+		// on is refused, and the connections that arrive while no accept is waiting are kept until the next one
+		class loopback_acceptor
+		{
+		public:
+			explicit loopback_acceptor(asio::io_context& context) : m_context(context)
+			{
+
+			}
+
+			loopback_acceptor(const loopback_acceptor&) = delete;
+			loopback_acceptor& operator=(const loopback_acceptor&) = delete;
+
+			~loopback_acceptor()
+			{
+				close();
+			}
+
+			void Listen(const std::string& sName)
+			{
+				listeners& table = Listeners();
+				std::scoped_lock lock(table.muxListeners);
+				if (!table.mapListeners.emplace(sName, this).second)
+				{
+					throw std::runtime_error("Loopback name " + sName + " is already in use");
+				}
+				m_sName = sName;
+				m_bOpen = true;
+			}
+
+			bool is_open() const
+			{
+				std::scoped_lock lock(m_muxAccept);
+				return m_bOpen;
+			}
+
+			// The accept waiting is aborted and the connections nobody accepted yet are closed
+			void close()
+			{
+				{
+					listeners& table = Listeners();
+					std::scoped_lock lock(table.muxListeners);
+					auto it = table.mapListeners.find(m_sName);
+					if (it != table.mapListeners.end() && it->second == this)
+					{
+						table.mapListeners.erase(it);
+					}
+				}
+
+				std::unique_ptr<pending_accept> pAccept;
+				std::deque<loopback_socket> deqBacklog;
+				{
+					std::scoped_lock lock(m_muxAccept);
+					m_bOpen = false;
+					pAccept = std::move(m_pAccept);
+					deqBacklog.swap(m_deqBacklog);
+				}
+				if (pAccept)
+				{
+					pAccept->Complete(asio::error::operation_aborted, loopback_socket(m_context));
+				}
+			}
+
+			// The handler receives the error and the accepted socket, like the one of a TCP acceptor
+			template <typename Handler>
+			void async_accept(Handler&& handler)
+			{
+				auto pAccept = std::make_unique<accept_operation<std::decay_t<Handler>>>(std::forward<Handler>(handler), m_context.get_executor());
+				std::optional<loopback_socket> socket;
+				{
+					std::scoped_lock lock(m_muxAccept);
+					if (!m_bOpen)
+					{
+						socket.emplace(m_context);
+					}
+					else if (!m_deqBacklog.empty())
+					{
+						socket.emplace(std::move(m_deqBacklog.front()));
+						m_deqBacklog.pop_front();
+					}
+					else
+					{
+						m_pAccept = std::move(pAccept);
+						return;
+					}
+				}
+				asio::error_code ec = socket->is_open() ? asio::error_code() : asio::error_code(asio::error::bad_descriptor);
+				pAccept->Complete(ec, std::move(*socket));
+			}
+
+		private:
+			struct pending_accept
+			{
+				virtual ~pending_accept() = default;
+				virtual void Complete(asio::error_code ec, loopback_socket socket) = 0;
+			};
+
+			template <typename Handler>
+			struct accept_operation : pending_accept
+			{
+				accept_operation(Handler&& h, const asio::io_context::executor_type& executor) : handler(std::move(h)), work(executor)
+				{
+
+				}
+
+				void Complete(asio::error_code ec, loopback_socket socket) override
+				{
+					auto executor = asio::get_associated_executor(handler, work.get_executor());
+					asio::post(executor,
+						[handler = std::move(handler), ec, socket = std::move(socket)]() mutable
+						{
+							handler(ec, std::move(socket));
+						});
+					work.reset();
+				}
+
+				Handler handler;
+				asio::executor_work_guard<asio::io_context::executor_type> work;
+			};
+
+			struct listeners
+			{
+				std::mutex muxListeners;
+				std::unordered_map<std::string, loopback_acceptor*> mapListeners;
+			};
+
+			// Never destroyed, the acceptors of static objects may still be closed after the end of main
+			static listeners& Listeners()
+			{
+				static listeners* pListeners = new listeners();
+				return *pListeners;
+			}
+
+			// Called with the table locked, the acceptor cannot go away in the meantime. The accepted end belongs to the context
+			// of the acceptor
+			void Offer(std::shared_ptr<loopback_stream> stream, const std::string& sClient)
+			{
+				loopback_socket socket(m_context, std::move(stream), 1, sClient);
+
+				std::unique_ptr<pending_accept> pAccept;
+				{
+					std::scoped_lock lock(m_muxAccept);
+					if (!m_pAccept)
+					{
+						m_deqBacklog.push_back(std::move(socket));
+						return;
+					}
+					pAccept = std::move(m_pAccept);
+				}
+				pAccept->Complete({}, std::move(socket));
+			}
+
+		private:
+			asio::io_context& m_context;
+			std::string m_sName;
+			mutable std::mutex m_muxAccept;
+			bool m_bOpen = false;
+			std::unique_ptr<pending_accept> m_pAccept;
+			std::deque<loopback_socket> m_deqBacklog;
+
+			friend struct loopback_transport;
+		};
+
+		// The in-process transport, the server listens on a name and the client gives that name as the host of Connect. Both
+		// have to live in the same process. No socket option means anything here
+		struct loopback_transport
+		{
+			using socket = loopback_socket;
+			using acceptor = loopback_acceptor;
+			using endpoints = loopback_endpoint;
+			using address = std::string;
+
+			static const char* Name()
+			{
+				return "loopback";
+			}
+
+			static void Listen(acceptor& a, const address& sName, bool bReusePort)
+			{
+				if (bReusePort)
+				{
+					throw std::runtime_error("SO_REUSEPORT is only supported by the tcp transport");
+				}
+				a.Listen(sName);
+			}
+
+			static endpoints Resolve(asio::io_context&, const std::string& sName, uint16_t)
+			{
+				return { sName };
+			}
+
+			// The connection is made right away, only the handler waits for the context like any other completion
+			template <typename Handler>
+			static void AsyncConnect(socket& s, const endpoints& e, Handler&& handler)
+			{
+				s.close();
+				asio::error_code ec = asio::error::connection_refused;
+				{
+					loopback_acceptor::listeners& table = loopback_acceptor::Listeners();
+					std::scoped_lock lock(table.muxListeners);
+					auto it = table.mapListeners.find(e.sName);
+					if (it != table.mapListeners.end())
+					{
+						auto stream = std::make_shared<loopback_stream>();
+						it->second->Offer(stream, e.sName);
+						s = loopback_socket(*s.m_pContext, std::move(stream), 0, e.sName);
+						ec = {};
+					}
+				}
+
+				asio::post(s.get_executor(),
+					[handler = std::forward<Handler>(handler), ec]() mutable
+					{
+						handler(ec);
+					});
+			}
+
+			static void ApplyOptions(socket&, const socket_options&)
+			{
+
+			}
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -1,5 +1,6 @@
 #pragma once
 #include "net_common.h"
+#include "net_handle.h"
 
 namespace netmsg
 {
@@ -92,15 +93,133 @@ namespace netmsg
 			};
 		};
 
+		// Message identifiers reserved by the framework for its own traffic (heartbeats and the like). They are taken from the top 
+		// of the range of the identifier type, so any enum of the application counting up from 0 never reaches them. Messages 
+		// with these identifiers are handled by the connection itself and never show up in the incoming queue
+		enum class control : uint8_t
+		{
+			Heartbeat,
+			// Traffic between the server processes of one world, see net_relay.h
+			Relay,
+			// Round trip probes, see net_rtt.h
+			Ping,
+			Pong,
+			// Never sent on the wire, the server queues it behind the last messages of a client it dropped so the handle of the
+			// client is released once they are handled
+			Closed,
+			// Amount of identifiers set aside, anything added above must stay below it
+			Reserved = 16,
+		};
+
+		namespace detail
+		{
+			template <typename T, bool bEnum = std::is_enum<T>::value>
+			struct id_integer
+			{
+				using type = typename std::underlying_type<T>::type;
+			};
+
+			template <typename T>
+			struct id_integer<T, false>
+			{
+				using type = T;
+			};
+		}
+
+		template <typename T>
+		constexpr T ControlId(control c)
+		{
+			using U = typename detail::id_integer<T>::type;
+			return static_cast<T>(U(std::numeric_limits<U>::max() - U(c)));
+		}
+
+		template <typename T>
+		constexpr bool IsControlId(T id)
+		{
+			using U = typename detail::id_integer<T>::type;
+			return U(id) > U(std::numeric_limits<U>::max() - U(control::Reserved));
+		}
+
+		// A message ready to be written, shared by every connection it is sent to. A broadcast is built once and each of the 
+		// outgoing queues only holds a reference to it, which is also what the session windows keep
+		template <typename T>
+		using shared_message = std::shared_ptr<const message<T>>;
+
+		// Builds a message in place, in the very storage the connection writes to the socket from. The message is allocated 
+		// along with its reference count, the body is reserved up front so the payloads are written without growing it, and 
+		// Send hands the storage over as it is:
+		//
+		//   client->Send(message_builder<T>(T::Move, sizeof(pos) + sizeof(tick)) << pos << tick);
+		//
+		// Share ends the building and gives the message out to be sent to many (MessageAllClients, a channel, ...)
 		template <typename T>
-		class connection;
+		class message_builder
+		{
+		public:
+			message_builder(T id, size_t nReserve = 0) : m_msg(std::make_shared<message<T>>())
+			{
+				m_msg->header.id = id;
+				m_msg->body.reserve(nReserve);
+			}
+
+			message_builder(const message_builder&) = delete;
+			message_builder(message_builder&&) = default;
+			message_builder& operator=(message_builder&&) = default;
+
+			template <typename DataType>
+			message_builder& operator<<(const DataType& data) &
+			{
+				*m_msg << data;
+				return *this;
+			}
+
+			// A builder written as a temporary stays one, so it can go straight into Send
+			template <typename DataType>
+			message_builder&& operator<<(const DataType& data) &&
+			{
+				*m_msg << data;
+				return std::move(*this);
+			}
+
+			// Appends raw bytes, for the payloads that are not a single standard layout object
+			message_builder& Write(const void* pData, size_t nSize)
+			{
+				size_t i = m_msg->body.size();
+				m_msg->body.resize(i + nSize);
+				std::memcpy(m_msg->body.data() + i, pData, nSize);
+				m_msg->header.size = m_msg->size();
+				return *this;
+			}
+
+			message<T>& Message()
+			{
+				return *m_msg;
+			}
+
+			shared_message<T> Share() &&
+			{
+				return std::move(m_msg);
+			}
+
+			// Lets a finished builder go wherever a shared message is taken, MessageClient and MessageAllClients for example
+			operator shared_message<T>() &&
+			{
+				return std::move(m_msg);
+			}
+
+		private:
+			std::shared_ptr<message<T>> m_msg;
+		};
 
-		// Encapsulates the regular message but it also has a shared pointer for the connection object
+		// Encapsulates the regular message along with a handle of the connection it came from, the server resolves it when the 
+		// message is handled. The handle is null on the client side, a client only has the one connection
 		template <typename T>
 		struct owned_message
 		{
-			std::shared_ptr<connection<T>> remote = nullptr;
+			connection_handle remote;
 			message<T> msg;
+			// Trace of a sampled message, 0 when the message is not traced, see net_trace.h
+			uint64_t nTrace = 0;
 
 			// Overloaded the << operator for the output to work on this object
 			friend std::ostream& operator<<(std::ostream& os, const owned_message<T>& msg)
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "net_common.h"
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Preallocated slab of fixed size blocks. The server uses it to create its connection objects, so a login storm takes 
+		// blocks from a free list instead of hitting the general purpose allocator thousands of times per second. Blocks are 
+		// aligned to a cache line so two connections never share one. The block size given to the constructor can only be an 
+		// estimate when the caller does not know the exact size of what it will allocate (std::allocate_shared puts its control 
+		// block next to the object), so the first request decides: when it does not fit, the slab is allocated again with 
+		// blocks of its size before anything was handed out. The pool never grows, once it is empty or for a later request 
+		// that does not fit a block the memory comes from the regular allocator, and the requests that did not fit are counted
+		class block_pool
+		{
+		public:
+			static constexpr size_t nAlignment = 64;
+
+			block_pool(size_t nBlockSize, size_t nBlocks) : m_nBlocks(nBlocks)
+			{
+				AllocateSlab(nBlockSize);
+			}
+
+			block_pool(const block_pool&) = delete;
+			block_pool& operator=(const block_pool&) = delete;
+
+			~block_pool()
+			{
+				FreeSlab();
+			}
+
+			void* Allocate(size_t nBytes)
+			{
+				{
+					std::scoped_lock lock(m_muxFree);
+					if (m_bFirstRequest)
+					{
+						m_bFirstRequest = false;
+						if (nBytes > m_nBlockSize && m_nBlocks > 0)
+						{
+							FreeSlab();
+							AllocateSlab(nBytes);
+						}
+					}
+
+					if (nBytes > m_nBlockSize)
+					{
+						m_nOversized++;
+					}
+					else if (!m_vFree.empty())
+					{
+						void* p = m_vFree.back();
+						m_vFree.pop_back();
+						return p;
+					}
+				}
+				return ::operator new(nBytes, std::align_val_t(nAlignment));
+			}
+
+			void Release(void* p, size_t)
+			{
+				if (Owns(p))
+				{
+					std::scoped_lock lock(m_muxFree);
+					m_vFree.push_back(static_cast<uint8_t*>(p));
+				}
+				else
+				{
+					::operator delete(p, std::align_val_t(nAlignment));
+				}
+			}
+
+			size_t Available()
+			{
+				std::scoped_lock lock(m_muxFree);
+				return m_vFree.size();
+			}
+
+			size_t Capacity() const
+			{
+				return m_nBlocks;
+			}
+
+			size_t BlockSize()
+			{
+				std::scoped_lock lock(m_muxFree);
+				return m_nBlockSize;
+			}
+
+			// Requests that came after the first one and did not fit in a block, they all went to the regular allocator
+			size_t Oversized()
+			{
+				std::scoped_lock lock(m_muxFree);
+				return m_nOversized;
+			}
+
+		private:
+			static size_t RoundUp(size_t nBytes)
+			{
+				return (nBytes + nAlignment - 1) / nAlignment * nAlignment;
+			}
+
+			void AllocateSlab(size_t nBlockSize)
+			{
+				m_nBlockSize = RoundUp(nBlockSize);
+				if (m_nBlocks > 0)
+				{
+					m_pSlab = static_cast<uint8_t*>(::operator new(m_nBlockSize * m_nBlocks, std::align_val_t(nAlignment)));
+					m_vFree.reserve(m_nBlocks);
+					// The free list is filled backwards so the first blocks handed out are the ones at the start of the slab
+					for (size_t i = m_nBlocks; i > 0; i--)
+					{
+						m_vFree.push_back(m_pSlab + (i - 1) * m_nBlockSize);
+					}
+				}
+			}
+
+			void FreeSlab()
+			{
+				if (m_pSlab)
+				{
+					::operator delete(m_pSlab, std::align_val_t(nAlignment));
+					m_pSlab = nullptr;
+				}
+				m_vFree.clear();
+			}
+
+			bool Owns(void* p) const
+			{
+				uint8_t* pByte = static_cast<uint8_t*>(p);
+				return m_pSlab && pByte >= m_pSlab && pByte < m_pSlab + m_nBlockSize * m_nBlocks;
+			}
+
+		private:
+			size_t m_nBlockSize = 0;
+			const size_t m_nBlocks;
+			uint8_t* m_pSlab = nullptr;
+			std::mutex m_muxFree;
+			std::vector<uint8_t*> m_vFree;
+			bool m_bFirstRequest = true;
+			size_t m_nOversized = 0;
+		};
+
+		// Standard allocator on top of a block pool, meant for std::allocate_shared so the object and its reference counts live 
+		// together in a single pooled block. The pool must outlive every object allocated through it
+		template <typename U>
+		struct pool_allocator
+		{
+			using value_type = U;
+
+			block_pool* pPool = nullptr;
+
+			explicit pool_allocator(block_pool* pool) : pPool(pool)
+			{
+
+			}
+
+			template <typename V>
+			pool_allocator(const pool_allocator<V>& other) : pPool(other.pPool)
+			{
+
+			}
+
+			U* allocate(size_t n)
+			{
+				return static_cast<U*>(pPool->Allocate(n * sizeof(U)));
+			}
+
+			void deallocate(U* p, size_t n)
+			{
+				pPool->Release(p, n * sizeof(U));
+			}
+
+			template <typename V>
+			bool operator==(const pool_allocator<V>& other) const
+			{
+				return pPool == other.pPool;
+			}
+
+			template <typename V>
+			bool operator!=(const pool_allocator<V>& other) const
+			{
+				return pPool != other.pPool;
+			}
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <unordered_map>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Classic token bucket, tokens are added at a steady rate up to the burst size and every event takes one. It is not 
+		// thread-safe, each bucket belongs to the context thread of its connection or its server
+		struct token_bucket
+		{
+			double dRate = 0.0;
+			double dBurst = 0.0;
+			double dTokens = 0.0;
+			std::chrono::steady_clock::time_point tLast = std::chrono::steady_clock::now();
+
+			token_bucket() = default;
+
+			// The bucket starts full, a client gets its whole burst right away
+			token_bucket(double rate, double burst) : dRate(rate), dBurst(std::max(1.0, burst)), dTokens(std::max(1.0, burst))
+			{
+
+			}
+
+			// A bucket without a rate never limits anything
+			bool IsLimited() const
+			{
+				return dRate > 0.0;
+			}
+
+			void Refill(std::chrono::steady_clock::time_point tNow)
+			{
+				dTokens = std::min(dBurst, dTokens + std::chrono::duration<double>(tNow - tLast).count() * dRate);
+				tLast = tNow;
+			}
+
+			// Time left until a token is available, zero if there is one already. The bucket must be refilled first
+			std::chrono::steady_clock::duration TimeUntilToken() const
+			{
+				if (!IsLimited() || dTokens >= 1.0)
+				{
+					return std::chrono::steady_clock::duration::zero();
+				}
+				return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((1.0 - dTokens) / dRate));
+			}
+
+			void Take()
+			{
+				if (IsLimited())
+				{
+					dTokens -= 1.0;
+				}
+			}
+		};
+
+		// What a connection does with a message over its limit
+		enum class limit_action : uint8_t
+		{
+			// The message is discarded and the connection keeps reading
+			Drop,
+			// The connection stops reading until a token is available, the socket buffers fill up and TCP pushes the flood back 
+			// onto the client. Nothing is lost, the client is simply slowed down to the limit. The wait is a timer of the timing 
+			// wheel, a connection without one disconnects instead
+			Delay,
+			// The connection is closed
+			Disconnect,
+		};
+
+		struct rate_limit
+		{
+			// Messages per second, 0 is unlimited
+			double dRate = 0.0;
+			// Messages allowed at once above the rate
+			double dBurst = 1.0;
+			limit_action action = limit_action::Drop;
+		};
+
+		// Limits applied by the server on every connection before a message reaches the incoming queue, so a flooding client 
+		// costs the server one socket read per message and nothing more. The connection limit counts every message of the 
+		// client, the message limits only count their own identifier and are meant for the expensive requests (a broadcast 
+		// fanning out to every client for example). A message has to fit in both
+		struct inbound_limits
+		{
+			rate_limit connection;
+			std::unordered_map<uint64_t, rate_limit> mapMessages;
+
+			template <typename T>
+			void SetMessageLimit(T id, const rate_limit& limit)
+			{
+				mapMessages[Key(id)] = limit;
+			}
+
+			template <typename T>
+			const rate_limit* FindMessageLimit(T id) const
+			{
+				auto it = mapMessages.find(Key(id));
+				return it != mapMessages.end() ? &it->second : nullptr;
+			}
+
+			bool IsEnabled() const
+			{
+				return connection.dRate > 0.0 || !mapMessages.empty();
+			}
+
+			template <typename T>
+			static uint64_t Key(T id)
+			{
+				return uint64_t(typename detail::id_integer<T>::type(id));
+			}
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
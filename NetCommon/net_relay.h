@@ -0,0 +1,199 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <cstring>
+#include <string>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Kinds of traffic exchanged between the server processes of one world
+		enum class relay_kind : uint32_t
+		{
+			// First message on a link, it carries the node of its sender and a random nonce the other end has to answer
+			Hello,
+			// Answer to the hello of the other end, the proof that the sender knows the secret of the world
+			Proof,
+			// A key (a client identifier, or any key of the application like a player identifier) is reachable through the 
+			// sender, and no longer reachable
+			Announce,
+			Withdraw,
+			// To every client of the receiving process
+			Broadcast,
+			// To whoever owns the key on the receiving process
+			Route,
+			// To the receiving server itself, through OnPeerMessage
+			Peer,
+		};
+
+		// Trailer of every relay message. The message of the application travels as it is, its identifier is kept in the 
+		// trailer and the envelope takes the reserved relay identifier, so a relayed message is never taken for a client one
+		struct relay_header
+		{
+			uint64_t nKey = 0;
+			uint64_t nInnerId = 0;
+			relay_kind nKind = relay_kind::Hello;
+			uint32_t nNode = 0;
+		};
+
+		// Key of the links of a world, derived from the secret shared by its servers
+		struct relay_key
+		{
+			uint64_t k0 = 0;
+			uint64_t k1 = 0;
+		};
+
+		// SipHash-2-4, a keyed hash made for short inputs. Only the servers knowing the key can compute it, and seeing the 
+		// output for some inputs does not help computing it for another
+		inline uint64_t SipHash24(const relay_key& key, const uint8_t* pData, size_t nSize)
+		{
+			auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+			uint64_t v0 = 0x736f6d6570736575ull ^ key.k0;
+			uint64_t v1 = 0x646f72616e646f6dull ^ key.k1;
+			uint64_t v2 = 0x6c7967656e657261ull ^ key.k0;
+			uint64_t v3 = 0x7465646279746573ull ^ key.k1;
+			auto round = [&]()
+			{
+				v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+				v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+				v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+				v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+			};
+
+			// Full words first, the last one holds the remaining bytes and the size in its top byte
+			const size_t nWords = nSize / 8;
+			for (size_t i = 0; i <= nWords; i++)
+			{
+				uint64_t m = 0;
+				const size_t nBytes = i < nWords ? 8 : nSize % 8;
+				for (size_t b = 0; b < nBytes; b++)
+				{
+					m |= uint64_t(pData[i * 8 + b]) << (8 * b);
+				}
+				if (i == nWords)
+				{
+					m |= uint64_t(nSize & 0xFF) << 56;
+				}
+				v3 ^= m;
+				round();
+				round();
+				v0 ^= m;
+			}
+
+			v2 ^= 0xFF;
+			round();
+			round();
+			round();
+			round();
+			return v0 ^ v1 ^ v2 ^ v3;
+		}
+
+		inline relay_key MakeRelayKey(const std::string& sSecret)
+		{
+			relay_key key;
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(sSecret.data());
+			relay_key k0 = { 0, 0 };
+			relay_key k1 = { 0, 1 };
+			key.k0 = SipHash24(k0, p, sSecret.size());
+			key.k1 = SipHash24(k1, p, sSecret.size());
+			return key;
+		}
+
+		// What a server answers to a hello: the nonce of that hello and its own node, keyed with the secret of the world. The
+		// node is part of it so an answer can not be passed off as coming from another server, and a server refuses links 
+		// claiming its own node so it can not be made to answer its own hello
+		inline uint64_t RelayProof(const relay_key& key, uint64_t nNonce, uint32_t nNode)
+		{
+			uint8_t data[sizeof(uint64_t) + sizeof(uint32_t)];
+			for (size_t b = 0; b < sizeof(uint64_t); b++)
+			{
+				data[b] = uint8_t(nNonce >> (8 * b));
+			}
+			for (size_t b = 0; b < sizeof(uint32_t); b++)
+			{
+				data[sizeof(uint64_t) + b] = uint8_t(nNode >> (8 * b));
+			}
+			return SipHash24(key, data, sizeof(data));
+		}
+
+		// Wraps a message for the links, done once however many peers it goes to
+		template <typename T>
+		message<T> RelayEnvelope(relay_kind nKind, uint32_t nNode, uint64_t nKey, const message<T>* pInner = nullptr)
+		{
+			message<T> env;
+			env.header.id = ControlId<T>(control::Relay);
+			relay_header rh;
+			rh.nKind = nKind;
+			rh.nNode = nNode;
+			rh.nKey = nKey;
+			if (pInner)
+			{
+				env.body = pInner->body;
+				rh.nInnerId = uint64_t(typename detail::id_integer<T>::type(pInner->header.id));
+			}
+			env << rh;
+			return env;
+		}
+
+		// Reads the trailer without taking it off the envelope
+		template <typename T>
+		relay_header PeekRelayHeader(const message<T>& env)
+		{
+			relay_header rh;
+			if (env.body.size() >= sizeof(relay_header))
+			{
+				std::memcpy(&rh, env.body.data() + env.body.size() - sizeof(relay_header), sizeof(relay_header));
+			}
+			return rh;
+		}
+
+		// Unwraps an envelope into the message of the application it carries
+		template <typename T>
+		message<T> OpenRelayEnvelope(message<T>& env, relay_header& rh)
+		{
+			env >> rh;
+			message<T> inner;
+			inner.header.id = static_cast<T>(typename detail::id_integer<T>::type(rh.nInnerId));
+			inner.body = std::move(env.body);
+			inner.header.size = uint32_t(inner.body.size());
+			return inner;
+		}
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_transport.h"
+
+#include <array>
+#include <cstring>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Routes incoming messages to one handler per identifier. Instead of a switch in OnMessage decoding every body by hand, a 
+		// handler is registered for an identifier together with the payload type it expects, the decoding of that type is 
+		// generated by the compiler and the handler receives the payload already typed:
+		//
+		//   m_router.On<MsgTypes::Move, move_payload>([this](auto& client, const move_payload& move) { ... });
+		//   m_router.On<MsgTypes::Leave>([this](auto& client) { ... });
+		//   m_router.OnRaw<MsgTypes::Chat>([this](auto& client, message<MsgTypes>& msg) { ... });
+		//
+		// The identifiers index a dense table of routes, so a dispatch is a bounds check and an indirect call, with no virtual 
+		// call and no switch. Identifiers must be below the size of the table, which is checked when the route is registered. 
+		// A payload is copied out of the body as a whole, its type must be trivially copyable and the body must have exactly its 
+		// size, anything else counts as a malformed message and the handler is not called. Encode builds the matching message
+		// on the sending side. Routes are registered before the messages start flowing, dispatching is not synchronised with 
+		// registering
+		template <typename T, typename Context = std::shared_ptr<connection<T>>, size_t nRoutes = 256>
+		class message_router
+		{
+		public:
+			// Handler for a message whose body is exactly one payload, or for an empty message when the payload is void
+			template <T Id, typename Payload = void, typename F>
+			void On(F&& fnHandler)
+			{
+				static_assert(Index(Id) < nRoutes, "Message identifier is outside of the route table");
+				using handler = std::decay_t<F>;
+				Set(Index(Id), &Decode<Payload, handler>, std::make_shared<handler>(std::forward<F>(fnHandler)));
+			}
+
+			// Handler receiving the message as it is, for bodies that are not a single payload
+			template <T Id, typename F>
+			void OnRaw(F&& fnHandler)
+			{
+				static_assert(Index(Id) < nRoutes, "Message identifier is outside of the route table");
+				using handler = std::decay_t<F>;
+				Set(Index(Id), &Forward<handler>, std::make_shared<handler>(std::forward<F>(fnHandler)));
+			}
+
+			template <T Id>
+			void Remove()
+			{
+				static_assert(Index(Id) < nRoutes, "Message identifier is outside of the route table");
+				m_vRoutes[Index(Id)] = route();
+				m_vHandlers[Index(Id)].reset();
+			}
+
+			// Returns false when there is no route for the identifier, the caller then handles the message some other way
+			bool Dispatch(Context& context, message<T>& msg)
+			{
+				size_t nIndex = Index(msg.header.id);
+				if (nIndex >= nRoutes || !m_vRoutes[nIndex].fnThunk)
+				{
+					return false;
+				}
+
+				const route& r = m_vRoutes[nIndex];
+				if (!r.fnThunk(r.pHandler, context, msg))
+				{
+					m_nMalformed++;
+				}
+				return true;
+			}
+
+			// Builds the message a route with a payload expects
+			template <T Id, typename Payload>
+			static message<T> Encode(const Payload& payload)
+			{
+				static_assert(std::is_trivially_copyable<Payload>::value, "Payloads are copied as a whole and must be trivially copyable");
+				message<T> msg;
+				msg.header.id = Id;
+				msg << payload;
+				return msg;
+			}
+
+			// Messages whose body did not match the payload of their route
+			uint64_t GetMalformed() const
+			{
+				return m_nMalformed;
+			}
+
+		private:
+			using thunk = bool (*)(void*, Context&, message<T>&);
+
+			struct route
+			{
+				thunk fnThunk = nullptr;
+				void* pHandler = nullptr;
+			};
+
+			static constexpr size_t Index(T id)
+			{
+				using U = typename detail::id_integer<T>::type;
+				return size_t(typename std::make_unsigned<U>::type(U(id)));
+			}
+
+			void Set(size_t nIndex, thunk fnThunk, std::shared_ptr<void> pHandler)
+			{
+				m_vRoutes[nIndex] = { fnThunk, pHandler.get() };
+				m_vHandlers[nIndex] = std::move(pHandler);
+			}
+
+			// One of these is instantiated for every route, the payload type is known here so the copy out of the body is a 
+			// fixed size memcpy
+			template <typename Payload, typename F>
+			static bool Decode(void* pHandler, Context& context, message<T>& msg)
+			{
+				F& fnHandler = *static_cast<F*>(pHandler);
+				if constexpr (std::is_void<Payload>::value)
+				{
+					if (!msg.body.empty())
+					{
+						return false;
+					}
+					fnHandler(context);
+				}
+				else
+				{
+					static_assert(std::is_trivially_copyable<Payload>::value, "Payloads are copied as a whole and must be trivially copyable");
+					if (msg.body.size() != sizeof(Payload))
+					{
+						return false;
+					}
+					Payload payload;
+					std::memcpy(&payload, msg.body.data(), sizeof(Payload));
+					fnHandler(context, payload);
+				}
+				return true;
+			}
+
+			template <typename F>
+			static bool Forward(void* pHandler, Context& context, message<T>& msg)
+			{
+				(*static_cast<F*>(pHandler))(context, msg);
+				return true;
+			}
+
+		private:
+			std::array<route, nRoutes> m_vRoutes{};
+			// Owners of the handlers, the table only keeps raw pointers to them so a dispatch does not touch a reference count
+			std::array<std::shared_ptr<void>, nRoutes> m_vHandlers{};
+			uint64_t m_nMalformed = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
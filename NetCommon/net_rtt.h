@@ -0,0 +1,124 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <array>
+#include <cmath>
+
+namespace netmsg
+{
+	namespace net
+	{
+		using rtt_duration = std::chrono::duration<double, std::micro>;
+
+		// What a connection knows about the path to its peer. The clock offset is how far the steady clock of the peer is ahead
+		// of the local one, adding it to a local time gives the same instant on the clock of the peer. Everything is zero 
+		// until the first probe came back
+		struct rtt_stats
+		{
+			rtt_duration tSmoothed{ 0.0 };
+			rtt_duration tVariance{ 0.0 };
+			rtt_duration tLast{ 0.0 };
+			rtt_duration tMin{ 0.0 };
+			rtt_duration tClockOffset{ 0.0 };
+			uint64_t nSamples = 0;
+		};
+
+		// Time stamps of the probes, nanoseconds of the steady clock, which never jumps like the system clock does
+		inline uint64_t ProbeClock()
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		// Round trip and clock offset estimation from ping/pong probes. A ping carries the time it was sent (t0), the pong 
+		// carries it back along with the times the peer received the ping (t1) and sent the pong (t2), and t3 is when the pong 
+		// arrived. The time the peer held the ping is taken out of the round trip, and the offset is computed the way NTP does.
+		//
+		// The round trip is smoothed like the retransmission timer of TCP (RFC 6298). The offset is only trusted from the fastest 
+		// of the recent probes, a probe delayed on one way only skews the offset by half of that delay and the fastest one is 
+		// the least likely to be lopsided. Probes are measured on the context thread and read from any thread
+		class rtt_estimator
+		{
+		public:
+			void AddSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+			{
+				double dRtt = std::max(0.0, double(int64_t(t3 - t0) - int64_t(t2 - t1)) / 1000.0);
+				double dOffset = (double(int64_t(t1 - t0)) + double(int64_t(t2 - t3))) / 2000.0;
+
+				std::scoped_lock lock(m_muxStats);
+				if (m_stats.nSamples == 0)
+				{
+					m_stats.tSmoothed = rtt_duration(dRtt);
+					m_stats.tVariance = rtt_duration(dRtt / 2.0);
+					m_stats.tMin = rtt_duration(dRtt);
+				}
+				else
+				{
+					m_stats.tVariance = rtt_duration(0.75 * m_stats.tVariance.count() + 0.25 * std::abs(m_stats.tSmoothed.count() - dRtt));
+					m_stats.tSmoothed = rtt_duration(0.875 * m_stats.tSmoothed.count() + 0.125 * dRtt);
+					m_stats.tMin = rtt_duration(std::min(m_stats.tMin.count(), dRtt));
+				}
+				m_stats.tLast = rtt_duration(dRtt);
+
+				m_vProbes[m_stats.nSamples % m_vProbes.size()] = { dRtt, dOffset };
+				m_stats.nSamples++;
+				size_t nProbes = std::min<size_t>(m_stats.nSamples, m_vProbes.size());
+				auto itFastest = std::min_element(m_vProbes.begin(), m_vProbes.begin() + nProbes,
+					[](const probe& a, const probe& b) { return a.dRtt < b.dRtt; });
+				m_stats.tClockOffset = rtt_duration(itFastest->dOffset);
+			}
+
+			rtt_stats Stats() const
+			{
+				std::scoped_lock lock(m_muxStats);
+				return m_stats;
+			}
+
+		private:
+			struct probe
+			{
+				double dRtt = 0.0;
+				double dOffset = 0.0;
+			};
+
+			mutable std::mutex m_muxStats;
+			rtt_stats m_stats;
+			std::array<probe, 8> m_vProbes{};
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
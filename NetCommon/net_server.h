@@ -4,25 +4,150 @@
 #include "net_tsqueue.h"
 #include "net_message.h"
 #include "net_connection.h"
+#include "net_pool.h"
+#include "net_ratelimit.h"
+#include "net_capture.h"
+#include "net_relay.h"
+#include "net_channel.h"
+#include "net_router.h"
+#include "net_trace.h"
+#include "net_log.h"
+#include "net_batch.h"
+
+#include <unordered_set>
 
 namespace netmsg
 {
 	namespace net
 	{
-		template <typename T>
+		// Server wide settings, the default values behave like a single server owning the port
+		struct server_options
+		{
+			// Applied to every accepted client socket
+			socket_options socket;
+			// Allows other acceptors to bind the same port, required by the sharded server
+			bool bReusePort = false;
+			// Runs the Update loop on the context thread, so connections, the incoming queue and the handlers are only ever 
+			// touched by that single thread. Used by the shards of the sharded server
+			bool bSingleThread = false;
+			// Core the context thread is pinned to, -1 leaves the scheduling to the operating system
+			int nCpuCore = -1;
+			// First identifier handed to a client, shards use separate ranges so an ID is unique across the whole server
+			uint32_t nFirstClientID = 10000;
+			// Session resumption, amount of outgoing messages kept per client so they can be replayed after a reconnection. 0 
+			// disables resumption, every client is then validated from scratch
+			size_t nResumeWindow = 0;
+			// How long a session is kept after its connection is gone
+			std::chrono::seconds tResumeRetention = std::chrono::seconds(30);
+			// Connection objects preallocated when the server is constructed, more are allocated on demand past this amount
+			size_t nConnectionPool = 0;
+			// Handshakes allowed in flight at once, the server stops accepting (the kernel backlog holds the rest) until one of 
+			// them finishes. 0 is unlimited
+			size_t nMaxPendingHandshakes = 0;
+			// Accepted connections per second, with bursts of up to nAcceptBurst. 0 is unlimited
+			double dAcceptRate = 0.0;
+			size_t nAcceptBurst = 64;
+			// Time a client has to complete the handshake before it is dropped. 0 waits forever
+			std::chrono::milliseconds tHandshakeTimeout = std::chrono::milliseconds(10000);
+			// Rate limits of the messages coming from each client
+			inbound_limits inbound;
+			// Records every message accepted from the clients into this file, see ReplayCapture. Empty does not record anything
+			std::string sCaptureFile;
+			// Port on which the other server processes of the world link to this one, and the node identifying this process 
+			// among them (unique in the world). 0 keeps the server on its own
+			uint16_t nRelayPort = 0;
+			uint32_t nRelayNode = 0;
+			// Interface the relay port listens on, the loopback unless the servers of the world run on several machines, in 
+			// which case it is the address of the private network linking them and never a public one
+			std::string sRelayBindAddress = "127.0.0.1";
+			// Client identifiers are route keys, so with the relay on they have to be unique in the whole world: node n hands
+			// out the range of nRelayNodeIDs identifiers starting at nFirstClientID + n * nRelayNodeIDs
+			uint32_t nRelayNodeIDs = 1 << 24;
+			// Secret shared by every server of the world, required with the relay. A link carries nothing until the server at 
+			// the other end has proven it knows the secret, by answering a random challenge
+			std::string sRelaySecret;
+			// Traces one message out of every n from the socket to its handler and through what the handler sends, see WriteTrace.
+			// The last nTraceCapacity stage time stamps are kept. 0 does not trace anything
+			size_t nTraceSampleEvery = 0;
+			size_t nTraceCapacity = 1 << 16;
+			// Prints a line on every accepted or denied connection, best turned off on servers facing connection storms
+			bool bLogConnections = true;
+			// Update drains the queue first and hands the messages to OnMessageBatch grouped by identifier, instead of one
+			// OnMessage call per message. The messages of a client keep their order within an identifier but not across
+			// identifiers, a server whose handlers depend on that order leaves it off
+			bool bBatchMessages = false;
+		};
+
+		template <typename Shard>
+		class sharded_server;
+
+		// The transport (net_transport.h) is the kind of socket the server accepts, TCP unless told otherwise. The callbacks 
+		// receive connections of that same transport
+		template <typename T, typename Transport>
 		class server_interface
 		{
 		public:
-			// The server acceptor is associated with the context, the endpoint will be the address on which the server will 
-			// listen to connections, in this instance we are using a version 4 for the IP address
-			server_interface(uint16_t port) : m_asioAcceptor(m_asioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+			// Message identifier type this server was specialized on, used by the sharded server to name the shard messages
+			using message_type = T;
+			using transport_type = Transport;
+
+			// The server acceptor is associated with the context, the address is what the server listens on, a port for TCP 
+			// (on every IPv4 interface) or a path for a Unix domain socket
+			server_interface(const typename Transport::address& address, const server_options& options = server_options()) : 
+				m_connectionPool(sizeof(connection<T, Transport>) + nControlBlockSize, options.nConnectionPool), m_asioAcceptor(m_asioContext), m_timerWheel(m_asioContext), m_timerAccept(m_asioContext), m_options(options), m_relayAcceptor(m_asioContext)
 			{
+				Transport::Listen(m_asioAcceptor, address, m_options.bReusePort);
+
+				// The other server processes of the world are always reached over TCP, the relay links are connections of the
+				// same transport as the clients so only a TCP server can have them
+				if (m_options.nRelayPort != 0)
+				{
+					if constexpr (std::is_same_v<Transport, tcp_transport>)
+					{
+						if (m_options.sRelaySecret.empty())
+						{
+							throw std::runtime_error("The relay needs the secret of the world (server_options::sRelaySecret)");
+						}
+						m_relayKey = MakeRelayKey(m_options.sRelaySecret);
+
+						const uint64_t nFirstID = uint64_t(m_options.nFirstClientID) + uint64_t(m_options.nRelayNode) * m_options.nRelayNodeIDs;
+						if (m_options.nRelayNodeIDs == 0 || nFirstID + m_options.nRelayNodeIDs - 1 > std::numeric_limits<uint32_t>::max())
+						{
+							throw std::runtime_error("The client identifiers of relay node " + std::to_string(m_options.nRelayNode) 
+								+ " do not fit in 32 bits (server_options::nRelayNodeIDs)");
+						}
+						m_options.nFirstClientID = uint32_t(nFirstID);
+						Transport::Listen(m_relayAcceptor, m_options.sRelayBindAddress, m_options.nRelayPort, false);
+					}
+					else
+					{
+						throw std::runtime_error(std::string("The relay is not supported by the ") + Transport::Name() + " transport");
+					}
+				}
+
+				if (!m_options.sCaptureFile.empty())
+				{
+					m_pCapture = std::make_unique<capture_writer>(m_options.sCaptureFile, uint32_t(sizeof(T)));
+				}
+				if (m_options.nTraceSampleEvery > 0)
+				{
+					m_pTracer = std::make_unique<message_tracer>(m_options.nTraceSampleEvery, m_options.nTraceCapacity);
+				}
 
+				nIDCounter = m_options.nFirstClientID;
+				m_bucketAccept = token_bucket(m_options.dAcceptRate, double(m_options.nAcceptBurst));
 			}
 
 			virtual ~server_interface()
 			{
 				Stop();
+				m_timerWheel.Cancel(m_timerPeers);
+				// The connections own sockets that belong to the context, they are released here while the context is still alive 
+				// as the members are destroyed in reverse order and the context is declared after them
+				m_qMessagesIn.clear();
+				m_channels.Clear();
+				m_deqConnections.clear();
+				m_handles.Clear();
 			}
 
 			bool Start()
@@ -32,20 +157,41 @@ namespace netmsg
 					// As stated before, the ASIO context requires some work to do for the process to not stop, so this is the 
 					// first step towad using it
 					WaitForClientConnection();
+					// Every deadline of every connection runs on this one wheel
+					m_timerWheel.Start();
+					if (m_options.nRelayPort != 0)
+					{
+						WaitForPeerConnection();
+						m_timerPeers.fnCallback = &server_interface::OnPeersTimer;
+						m_timerPeers.pOwner = this;
+						m_timerWheel.Schedule(m_timerPeers, std::chrono::seconds(1));
+					}
 					// We are assigning the context is own thread so it can run while othr processes are being done
 					m_threadContext = std::thread([this]()
 						{
-							m_asioContext.run();
+							if (m_options.bSingleThread)
+							{
+								RunSingleThread();
+							}
+							else
+							{
+								m_asioContext.run();
+							}
 						});
+
+					if (m_options.nCpuCore >= 0)
+					{
+						PinThreadToCore(m_threadContext, size_t(m_options.nCpuCore));
+					}
 				}
 				catch (std::exception& e)
 				{
 					// Catches errors if something is not letting the server to listen to clients.
-					std::cerr << "[SERVER] Exception: " << e.what() << "\n";
+					NETMSG_LOG_ERROR("[SERVER] Exception: " << e.what());
 					return false;
 				}
 
-				std::cout << "[SERVER] Started!\n";
+				NETMSG_LOG_INFO("[SERVER] Started! (" << IoBackendName() << ")");
 				return true;
 			}
 
@@ -59,47 +205,95 @@ namespace netmsg
 					m_threadContext.join();
 				}
 
-				std::cout << "[SERVER] Stopped!\n";
+				NETMSG_LOG_INFO("[SERVER] Stopped!");
 			}
 
 			// Instructs ASIO to wait for connections
 			void WaitForClientConnection()
 			{
+				// Only one accept (or one wait for the rate limiter) is ever outstanding
+				if (m_bAccepting)
+				{
+					return;
+				}
+
+				// With too many handshakes in flight no more connections are accepted, they wait in the kernel backlog and the
+				// accept loop is started again as soon as one of the handshakes finishes
+				if (m_options.nMaxPendingHandshakes > 0 && m_nPendingHandshakes >= m_options.nMaxPendingHandshakes)
+				{
+					return;
+				}
+
+				// The accept rate is limited by a token bucket, when it is empty the accept is delayed until the next token
+				if (m_options.dAcceptRate > 0.0 && !TakeAcceptToken())
+				{
+					m_bAccepting = true;
+					m_timerAccept.expires_after(m_bucketAccept.TimeUntilToken());
+					m_timerAccept.async_wait(
+						[this](std::error_code ec)
+						{
+							m_bAccepting = false;
+							if (!ec)
+							{
+								WaitForClientConnection();
+							}
+						});
+					return;
+				}
+
+				m_bAccepting = true;
+
 				// Asynchronous function which will allow the server to accept connections, the function receives an ASIO error type which 
 				// can be used to catch any errors on the connections, it will also receive a socket for the client ip to be used to stablish 
 				// the connection.
 				m_asioAcceptor.async_accept(
 					// lambda function
-					[this](std::error_code ec, asio::ip::tcp::socket socket)
+					[this](std::error_code ec, typename Transport::socket socket)
 					{
+						m_bAccepting = false;
+
 						if (!ec)
 						{
 							// If theres no errors, we will call the socket end point to retrieve its ip address
-							std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
-							// Make shared is used to allocate the object, we will also tell the connection that it will be owned by the 
-							// server, the connection constructor will also use the context, we move the socket used for the connection and 
-							// we pass by reference the queue of incoming messages
-							
-							std::shared_ptr<connection<T>> newconn = std::make_shared<connection<T>>(connection<T>::owner::server, m_asioContext, std::move(socket), m_qMessagesIn);
+							if (m_options.bLogConnections)
+							{
+								NETMSG_LOG_INFO("[SERVER] New Connection: " << socket.remote_endpoint());
+							}
+							Transport::ApplyOptions(socket, m_options.socket);
+
+							// The connection object is taken from the preallocated pool, we will also tell the connection that it will 
+							// be owned by the server, the connection constructor will also use the context, we move the socket used for 
+							// the connection and we pass by reference the queue of incoming messages
+							std::shared_ptr<connection<T, Transport>> newconn = std::allocate_shared<connection<T, Transport>>(pool_allocator<connection<T, Transport>>(&m_connectionPool),
+								connection<T, Transport>::owner::server, m_asioContext, std::move(socket), m_qMessagesIn, &m_timerWheel);
 
 							// gives the user server a chance to deny connection
 							if (OnClientConnect(newconn))
 							{
-								// If the connection is allowed, we add it to the container of new connections
+								// If the connection is allowed, we add it to the container of new connections, its messages carry the 
+								// handle it gets in the table of the server
+								newconn->m_hSelf = m_handles.Acquire(newconn);
 								m_deqConnections.push_back(std::move(newconn));
 								// We will allocate an id for that new connection
 								m_deqConnections.back()->ConnectToClient(this, nIDCounter++);
-								std::cout << "[" << m_deqConnections.back()->GetID() << "] Connections Approved\n";
-
+								if (m_options.bLogConnections)
+								{
+									NETMSG_LOG_INFO("[" << m_deqConnections.back()->GetID() << "] Connections Approved");
+								}
 							}
-							else
+							else if (m_options.bLogConnections)
 							{
-								std::cout << "[-----] Connection Denied\n";
+								NETMSG_LOG_INFO("[-----] Connection Denied");
 							}
 						}
+						else if (!m_asioAcceptor.is_open())
+						{
+							// The acceptor is being shut down
+							return;
+						}
 						else
 						{
-							std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
+							NETMSG_LOG_WARNING("[SERVER] New Connection Error: " << ec.message());
 						}
 						// Prime the ASIO context again with more work, giving an asynchronous task whch will simply wait for another connection
 						WaitForClientConnection();
@@ -107,18 +301,36 @@ namespace netmsg
 			}
 
 			// Sends message to an specific client, the server will store the clients connection as a shared pointer
-			void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg)
+			void MessageClient(std::shared_ptr<connection<T, Transport>> client, const message<T>& msg)
+			{
+				MessageClient(std::move(client), std::make_shared<const message<T>>(msg));
+			}
+
+			// The message is moved all the way to the socket, its body is never copied
+			void MessageClient(std::shared_ptr<connection<T, Transport>> client, message<T>&& msg)
+			{
+				MessageClient(std::move(client), std::make_shared<const message<T>>(std::move(msg)));
+			}
+
+			void MessageClient(std::shared_ptr<connection<T, Transport>> client, shared_message<T> msg)
 			{
-				// We check if the shared pointer is valid at first
-				if (client && client->IsConnected())
+				// We check if the shared pointer is valid at first, the stand-ins of a replay have no socket but are not gone
+				if (client && (client->IsConnected() || client->IsReplay()))
 				{
-					client->Send(msg);
+					client->Send(std::move(msg));
 				}
 				else
 				{
 					// One of the problems on the tcp protocol is that we dont receive a message when the used disconnects, so we have to 
-					// manipulate the client to check if its still communicating or not
-					OnClientDisconnect(client);
+					// manipulate the client to check if its still communicating or not. A superseded connection is not reported, its 
+					// client is still here through the connection that resumed the session
+					if (!client || !client->IsSuperseded())
+					{
+						OnClientDisconnect(client);
+						WithdrawClient(client);
+					}
+					m_channels.UnsubscribeAll(client.get());
+					RetireHandle(client);
 					// We will delete the client
 					client.reset();
 					// We will delete the client from our deque of connections
@@ -128,18 +340,29 @@ namespace netmsg
 			}
 
 
-			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
+			{
+				// The message is copied once, every connection queues a reference to it
+				MessageAllClients(std::make_shared<const message<T>>(msg), std::move(pIgnoreClient));
+			}
+
+			void MessageAllClients(message<T>&& msg, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
+			{
+				MessageAllClients(std::make_shared<const message<T>>(std::move(msg)), std::move(pIgnoreClient));
+			}
+
+			void MessageAllClients(shared_message<T> shared, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
 			{
 				bool bInvalidClientExists = false;
 				// We will iterate through all clients to check which one is connected or not, we set a null pointer as default for the 
 				// program to send messages only to those clients which are connected.
 				for (auto& client : m_deqConnections)
 				{
-					if (client && client->IsConnected())
+					if (client && client->IsConnected() && !client->IsSuperseded())
 					{
 						if (client != pIgnoreClient)
 						{
-							client->Send(msg);
+							client->Send(shared);
 						}
 					}
 					else
@@ -147,7 +370,13 @@ namespace netmsg
 						// this approach will not run the eraser for the deque connections inmediately but will just set a boolean as true 
 						// to run the eraser only if there is disconnected clients. this will save some memory and allow the program to 
 						// loose a bit of its weight
-						OnClientDisconnect(client);
+						if (!client || !client->IsSuperseded())
+						{
+							OnClientDisconnect(client);
+							WithdrawClient(client);
+						}
+						m_channels.UnsubscribeAll(client.get());
+						RetireHandle(client);
 						client.reset();
 						bInvalidClientExists = true;
 					}
@@ -160,6 +389,175 @@ namespace netmsg
 				}
 			}
 
+			// Global broadcast across a sharded server, the message is handed over to every shard and each one of them fans it out 
+			// to its own connections on its own thread. Meant for rare events, regular traffic should stay inside its shard. A server 
+			// which is not part of a sharded server simply messages all of its clients
+			void MessageAllShards(const message<T>& msg, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
+			{
+				if (m_vShards.empty())
+				{
+					MessageAllClients(msg, pIgnoreClient);
+					return;
+				}
+
+				for (server_interface* shard : m_vShards)
+				{
+					asio::post(shard->m_asioContext,
+						[shard, msg, pIgnoreClient]()
+						{
+							shard->MessageAllClients(msg, pIgnoreClient);
+						});
+				}
+			}
+
+			// Channels group the clients for the broadcasts that only concern some of them (a guild, a party, an instance). A 
+			// channel is any number chosen by the application, it exists as long as it has subscribers. Like the other 
+			// messaging functions they must be called from the thread running Update. Subscribe adds a client to a channel, 
+			// false when there is no client or it already was in the channel
+			bool Subscribe(uint64_t nChannel, std::shared_ptr<connection<T, Transport>> client)
+			{
+				return client && m_channels.Subscribe(nChannel, client);
+			}
+
+			bool Unsubscribe(uint64_t nChannel, std::shared_ptr<connection<T, Transport>> client)
+			{
+				return client && m_channels.Unsubscribe(nChannel, client.get());
+			}
+
+			void UnsubscribeAll(std::shared_ptr<connection<T, Transport>> client)
+			{
+				m_channels.UnsubscribeAll(client.get());
+			}
+
+			// Sends a message to every subscriber of a channel, the message is copied once for all of them and the clients 
+			// outside of the channel are never looked at. A client that dropped is taken out of its channels here, unless its 
+			// session can still be resumed, then it keeps receiving (into its session) until it is reported disconnected
+			size_t Publish(uint64_t nChannel, const message<T>& msg, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
+			{
+				return m_channels.Publish(nChannel, std::make_shared<const message<T>>(msg), pIgnoreClient.get(), m_options.nResumeWindow > 0);
+			}
+
+			size_t ChannelSize(uint64_t nChannel) const
+			{
+				return m_channels.ChannelSize(nChannel);
+			}
+
+			// Links this server to another server process of the world, through the relay port of that server. The link is 
+			// dialed again every second for as long as it is down. Each process only needs to dial the processes it knows about, 
+			// a pair linked both ways is used only once
+			void AddPeer(const std::string& host, const uint16_t port)
+			{
+				auto endpoints = Transport::Resolve(m_asioContext, host, port);
+				asio::post(m_asioContext,
+					[this, endpoints]()
+					{
+						m_vPeerDials.push_back({ endpoints, nullptr });
+						DialPeer(m_vPeerDials.back());
+					});
+			}
+
+			// Broadcast to every client of the world, the local ones and the ones of every linked server. The message is wrapped 
+			// once whatever the amount of peers
+			void MessageWorld(const message<T>& msg, std::shared_ptr<connection<T, Transport>> pIgnoreClient = nullptr)
+			{
+				MessageAllClients(msg, pIgnoreClient);
+				RelayToPeers(RelayEnvelope(relay_kind::Broadcast, m_options.nRelayNode, 0, &msg));
+			}
+
+			// Sends a message to the owner of a key wherever it is in the world. A key is a client identifier, or a key announced 
+			// by the application with AnnounceRoute (a player identifier for example), which is then delivered to OnRoutedMessage 
+			// on the server that announced it. A key nobody owns is dropped
+			void MessageRoute(uint64_t nKey, const message<T>& msg)
+			{
+				if (nKey <= std::numeric_limits<uint32_t>::max())
+				{
+					if (auto client = FindClient(uint32_t(nKey)))
+					{
+						client->Send(msg);
+						return;
+					}
+				}
+
+				asio::post(m_asioContext,
+					[this, nKey, env = RelayEnvelope(relay_kind::Route, m_options.nRelayNode, nKey, &msg)]()
+					{
+						if (m_setLocalRoutes.count(nKey) > 0)
+						{
+							m_qMessagesIn.push_back({ {}, env });
+						}
+						else if (auto link = FindRoute(nKey))
+						{
+							link->Send(env);
+						}
+					});
+			}
+
+			// Sends a message to every linked server, it arrives in OnPeerMessage
+			void MessagePeers(const message<T>& msg)
+			{
+				RelayToPeers(RelayEnvelope(relay_kind::Peer, m_options.nRelayNode, 0, &msg));
+			}
+
+			// Makes a key of the application reachable through this server, or no longer. Client identifiers are announced and 
+			// withdrawn by the framework
+			void AnnounceRoute(uint64_t nKey)
+			{
+				asio::post(m_asioContext,
+					[this, nKey]()
+					{
+						m_setLocalRoutes.insert(nKey);
+						SendToPeers(RelayEnvelope<T>(relay_kind::Announce, m_options.nRelayNode, nKey));
+					});
+			}
+
+			void WithdrawRoute(uint64_t nKey)
+			{
+				asio::post(m_asioContext,
+					[this, nKey]()
+					{
+						if (m_setLocalRoutes.erase(nKey) > 0)
+						{
+							SendToPeers(RelayEnvelope<T>(relay_kind::Withdraw, m_options.nRelayNode, nKey));
+						}
+					});
+			}
+
+			// Connected client with an identifier, if there is one. It must be called from the thread running Update
+			std::shared_ptr<connection<T, Transport>> FindClient(uint32_t nID) const
+			{
+				for (auto& client : m_deqConnections)
+				{
+					if (client && client->GetID() == nID && client->IsConnected() && !client->IsSuperseded())
+					{
+						return client;
+					}
+				}
+				return nullptr;
+			}
+
+			// Runs a task on the thread of another shard, which is the only safe way to reach its connections. The task receives 
+			// the shard so it can be cast back into the derived server type
+			void PostToShard(size_t nShard, std::function<void(server_interface&)> task)
+			{
+				server_interface* shard = m_vShards.empty() ? this : m_vShards.at(nShard);
+				asio::post(shard->m_asioContext,
+					[shard, task = std::move(task)]()
+					{
+						task(*shard);
+					});
+			}
+
+			// Index of this shard inside its sharded server, 0 for a standalone server
+			size_t GetShardIndex() const
+			{
+				return m_nShardIndex;
+			}
+
+			size_t GetShardCount() const
+			{
+				return m_vShards.empty() ? 1 : m_vShards.size();
+			}
+
 			// This function will be called by clients, it will decide which is the appropriate time to send messages into the queue. 
 			// The function will constrain the number of messages the user will send in one go
 			void Update(size_t nMaxMessages = -1, bool bWait = false)
@@ -170,58 +568,616 @@ namespace netmsg
 				{
 					m_qMessagesIn.wait();
 				}
+				if (m_options.bBatchMessages)
+				{
+					UpdateBatched(nMaxMessages);
+					return;
+				}
 				size_t nMessageCount = 0;
 				// Funtion will check if there are messages in the queue
 				while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty())
 				{
 					// If there is, it will pop it in the front of the queue
 					auto msg = m_qMessagesIn.pop_front();
-					// Pass the message to the message handler, as a reminder, the messages are shared pointers
-					OnMessage(msg.remote, msg.msg);
+					// Pass the message to the message handler along with its connection, found from the handle of the message. 
+					// Messages relayed by the other servers of the world are delivered here too, on the same thread as everything else
+					if (msg.msg.header.id == ControlId<T>(control::Closed))
+					{
+						m_handles.Release(msg.remote);
+						continue;
+					}
+					if (IsControlId(msg.msg.header.id))
+					{
+						DeliverRelayed(msg.msg);
+						nMessageCount++;
+						continue;
+					}
+
+					// The handle of a dropped client is only released once its last messages are handled, a message still 
+					// coming after that (read just as the client was dropped) has no connection left to be handled with
+					auto& client = m_handles.Resolve(msg.remote);
+					if (!client)
+					{
+						continue;
+					}
+
+					if (msg.nTrace && m_pTracer)
+					{
+						// The trace follows the handler, whatever it sends on this thread is part of it
+						m_pTracer->Record(msg.nTrace, trace_stage::Dequeued, client->GetID(), msg.msg.header.id);
+						message_tracer::Current() = msg.nTrace;
+						HandleMessage(client, msg.msg);
+						message_tracer::Current() = 0;
+						m_pTracer->Record(msg.nTrace, trace_stage::Handled, client->GetID(), msg.msg.header.id);
+					}
+					else
+					{
+						HandleMessage(client, msg.msg);
+					}
 					nMessageCount++;
 				}
 			}
 
+			// Writes the messages traced so far (server_options::nTraceSampleEvery) as a Chrome trace, it opens in
+			// chrome://tracing or Perfetto with one row per client. Can be called while the server runs, false when the server
+			// does not trace or the file cannot be written
+			bool WriteTrace(const std::string& sFile) const
+			{
+				return m_pTracer && m_pTracer->WriteChromeTrace(sFile);
+			}
+
+			// Feeds a capture recorded with server_options::sCaptureFile back into OnMessage, on the calling thread, the same
+			// way Update would. Every client of the capture is stood in for by a connection without a socket carrying its 
+			// original identifier, what the handlers send to it is simply discarded. OnClientConnect and OnClientValidated are 
+			// not called, and neither is OnClientDisconnect: the stand-ins are marked (IsReplay) so sending to them or publishing 
+			// to a channel they joined does not take them for clients that left. The server does not need to be started, the context is then polled here to get rid of the messages 
+			// sent by the handlers
+			replay_stats ReplayCapture(const std::string& sFile, replay_speed speed = replay_speed::AsFastAsPossible)
+			{
+				capture_reader reader(sFile);
+				if (reader.Header().nIdSize != sizeof(T))
+				{
+					throw std::runtime_error("Capture " + sFile + " was recorded with another message identifier type");
+				}
+
+				std::unordered_map<uint32_t, std::shared_ptr<connection<T, Transport>>> mapClients;
+				replay_stats stats;
+				const bool bPoll = !m_threadContext.joinable();
+				const auto tStart = std::chrono::steady_clock::now();
+				std::chrono::steady_clock::duration tHandlers(0);
+
+				capture_view view;
+				while (reader.Next(view))
+				{
+					if (speed == replay_speed::Original)
+					{
+						std::this_thread::sleep_until(tStart + std::chrono::nanoseconds(view.pRecord->nTime));
+					}
+
+					auto& client = mapClients[view.pRecord->nClientID];
+					if (!client)
+					{
+						client = std::make_shared<connection<T, Transport>>(connection<T, Transport>::owner::server, m_asioContext, typename Transport::socket(m_asioContext), m_qMessagesIn);
+						client->id = view.pRecord->nClientID;
+						client->m_bReplay = true;
+					}
+
+					message<T> msg = view.ToMessage<T>();
+					auto tHandler = std::chrono::steady_clock::now();
+					if (m_options.bBatchMessages)
+					{
+						// A batch of one, the handlers written for batches see the replayed messages too
+						m_batcher.Push(client, std::move(msg));
+						m_batcher.Dispatch([this](auto& batch) { OnMessageBatch(batch); });
+					}
+					else
+					{
+						HandleMessage(client, msg);
+					}
+					tHandlers += std::chrono::steady_clock::now() - tHandler;
+					stats.nMessages++;
+
+					if (bPoll && (stats.nMessages & 1023) == 0)
+					{
+						m_asioContext.restart();
+						m_asioContext.poll();
+					}
+				}
+
+				stats.dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+				stats.dHandlerSeconds = std::chrono::duration<double>(tHandlers).count();
+				// The sends still queued for the stand-in connections hold them until they have run
+				if (bPoll)
+				{
+					m_asioContext.restart();
+					m_asioContext.poll();
+				}
+				return stats;
+			}
+
+		private:
+			// Called by the connection when its handshake ends, whatever the outcome. If the accept loop was paused by the cap of 
+			// pending handshakes it is started again
+			void OnHandshakeFinished()
+			{
+				m_nPendingHandshakes--;
+				WaitForClientConnection();
+			}
+
+			bool TakeAcceptToken()
+			{
+				m_bucketAccept.Refill(std::chrono::steady_clock::now());
+				if (m_bucketAccept.TimeUntilToken().count() == 0)
+				{
+					m_bucketAccept.Take();
+					return true;
+				}
+				return false;
+			}
+
+			// Called by the connection once the client solved the challenge, a new session is opened when resumption is enabled
+			void OpenSession(std::shared_ptr<connection<T, Transport>> client)
+			{
+				if (m_options.nResumeWindow > 0)
+				{
+					client->m_pSession = m_sessions.Open(client->GetID(), m_options.nResumeWindow, m_options.tResumeRetention);
+					client->m_pSession->wpConnection = client;
+				}
+			}
+
+			// Called by the connection when the client presents a resumption token. The session moves over to the new connection, 
+			// which takes the identifier of the client, and the old connection (if it is still around) hands everything over to it
+			bool ResumeSession(std::shared_ptr<connection<T, Transport>> client)
+			{
+				if (m_options.nResumeWindow == 0)
+				{
+					return false;
+				}
+
+				auto session = m_sessions.Resume(client->m_handshakeReply.nResumeToken, client->m_handshakeReply.nResumeSecret,
+					m_options.tResumeRetention);
+				if (!session || !session->CanReplayFrom(client->m_handshakeReply.nLastReceived))
+				{
+					return false;
+				}
+
+				if (auto previous = session->wpConnection.lock())
+				{
+					if (previous != client)
+					{
+						previous->Supersede(client);
+					}
+				}
+
+				client->id = session->nClientID;
+				client->m_pSession = session;
+				session->wpConnection = client;
+				return true;
+			}
+
+			// The relay state (the links, the routes of the other servers and the keys of this one) belongs to the context thread, 
+			// the functions below are only ever run on it. What has to reach the clients or the application goes through the 
+			// incoming queue instead, so it is handled by Update like any other message
+			void WaitForPeerConnection()
+			{
+				m_relayAcceptor.async_accept(
+					[this](std::error_code ec, typename Transport::socket socket)
+					{
+						if (!ec)
+						{
+							auto link = std::make_shared<connection<T, Transport>>(connection<T, Transport>::owner::server, m_asioContext, std::move(socket), m_qMessagesIn, &m_timerWheel);
+							m_vPeerLinks.push_back(link);
+							link->ConnectToPeer(this);
+						}
+
+						if (m_relayAcceptor.is_open())
+						{
+							WaitForPeerConnection();
+						}
+					});
+			}
+
+			struct peer_dial
+			{
+				typename Transport::endpoints endpoints;
+				std::shared_ptr<connection<T, Transport>> link;
+			};
+
+			void DialPeer(peer_dial& dial)
+			{
+				dial.link = std::make_shared<connection<T, Transport>>(connection<T, Transport>::owner::server, m_asioContext, typename Transport::socket(m_asioContext), m_qMessagesIn, &m_timerWheel);
+				m_vPeerLinks.push_back(dial.link);
+				dial.link->ConnectToPeer(this, &dial.endpoints);
+			}
+
+			// Once a second the dead links are dropped along with the routes going through them, and the peers this server 
+			// dials are dialed again if their link is down
+			static void OnPeersTimer(wheel_timer& timer)
+			{
+				server_interface* self = static_cast<server_interface*>(timer.pOwner);
+
+				auto& vLinks = self->m_vPeerLinks;
+				vLinks.erase(std::remove_if(vLinks.begin(), vLinks.end(),
+					[](const std::shared_ptr<connection<T, Transport>>& link) { return !link->IsConnected(); }), vLinks.end());
+
+				for (auto it = self->m_mapRoutes.begin(); it != self->m_mapRoutes.end();)
+				{
+					auto link = it->second.lock();
+					it = (link && link->IsConnected()) ? std::next(it) : self->m_mapRoutes.erase(it);
+				}
+
+				for (auto& dial : self->m_vPeerDials)
+				{
+					if (!dial.link || !dial.link->IsConnected())
+					{
+						self->DialPeer(dial);
+					}
+				}
+
+				self->m_timerWheel.Schedule(timer, std::chrono::seconds(1));
+			}
+
+			// A new link learns every key of this server, once the other end has proven it belongs to the world
+			void OnPeerLinkUp(std::shared_ptr<connection<T, Transport>> link)
+			{
+				for (uint64_t nKey : m_setLocalRoutes)
+				{
+					link->QueueOutgoing(RelayEnvelope<T>(relay_kind::Announce, m_options.nRelayNode, nKey));
+				}
+			}
+
+			void OnRelayReceived(std::shared_ptr<connection<T, Transport>> link, const message<T>& env)
+			{
+				if (env.body.size() < sizeof(relay_header))
+				{
+					RefusePeer(link, "Malformed Relay Message");
+					return;
+				}
+
+				relay_header rh = PeekRelayHeader(env);
+
+				// Until the other end has answered the challenge the link only takes its hello and its proof, anything else 
+				// (and a second hello, or a hello claiming the node of this server) ends the link
+				if (!link->m_bPeerKnown)
+				{
+					switch (rh.nKind)
+					{
+					case relay_kind::Hello:
+						if (link->m_bPeerHello || rh.nNode == m_options.nRelayNode)
+						{
+							RefusePeer(link, "Invalid Relay Hello");
+							return;
+						}
+						link->m_nPeerNode = rh.nNode;
+						link->m_bPeerHello = true;
+						link->QueueOutgoing(RelayEnvelope<T>(relay_kind::Proof, m_options.nRelayNode, RelayProof(m_relayKey, rh.nKey, m_options.nRelayNode)));
+						break;
+					case relay_kind::Proof:
+						if (!link->m_bPeerHello || rh.nNode != link->m_nPeerNode 
+							|| !SecretsEqual(rh.nKey, RelayProof(m_relayKey, link->m_nRelayNonce, rh.nNode)))
+						{
+							RefusePeer(link, "Relay Authentication Failed");
+							return;
+						}
+						link->m_bPeerKnown = true;
+						OnPeerLinkUp(link);
+						break;
+					default:
+						RefusePeer(link, "Relay Traffic Before Authentication");
+						break;
+					}
+					return;
+				}
+
+				switch (rh.nKind)
+				{
+				case relay_kind::Hello:
+				case relay_kind::Proof:
+					RefusePeer(link, "Relay Hello After Authentication");
+					break;
+				case relay_kind::Announce:
+					m_mapRoutes[rh.nKey] = link;
+					break;
+				case relay_kind::Withdraw:
+				{
+					auto it = m_mapRoutes.find(rh.nKey);
+					if (it != m_mapRoutes.end() && it->second.lock() == link)
+					{
+						m_mapRoutes.erase(it);
+					}
+				}
+				break;
+				default:
+					m_qMessagesIn.push_back({ {}, env });
+					break;
+				}
+			}
+
+			void RefusePeer(const std::shared_ptr<connection<T, Transport>>& link, const char* sReason)
+			{
+				NETMSG_LOG_WARNING("[relay " << link->m_nPeerNode << "] " << sReason);
+				link->Disconnect();
+			}
+
+			std::shared_ptr<connection<T, Transport>> FindRoute(uint64_t nKey) const
+			{
+				auto it = m_mapRoutes.find(nKey);
+				return it != m_mapRoutes.end() ? it->second.lock() : nullptr;
+			}
+
+			// Sends to one link per peer node, two servers that dialed each other have two links but get every message once
+			void SendToPeers(const message<T>& env)
+			{
+				std::vector<uint32_t> vNodes;
+				for (auto& link : m_vPeerLinks)
+				{
+					if (link->IsConnected() && link->IsPeerKnown() && std::find(vNodes.begin(), vNodes.end(), link->GetPeerNode()) == vNodes.end())
+					{
+						vNodes.push_back(link->GetPeerNode());
+						link->Send(env);
+					}
+				}
+			}
+
+			void RelayToPeers(message<T> env)
+			{
+				if (m_options.nRelayPort != 0)
+				{
+					asio::post(m_asioContext, [this, env = std::move(env)]() { SendToPeers(env); });
+				}
+			}
+
+			// Called by the connection of a client once it is validated
+			void AnnounceClient(uint32_t nID)
+			{
+				if (m_options.nRelayPort != 0)
+				{
+					m_setLocalRoutes.insert(nID);
+					SendToPeers(RelayEnvelope<T>(relay_kind::Announce, m_options.nRelayNode, nID));
+				}
+			}
+
+			void WithdrawClient(const std::shared_ptr<connection<T, Transport>>& client)
+			{
+				if (client && m_options.nRelayPort != 0)
+				{
+					WithdrawRoute(client->GetID());
+				}
+			}
+
+			// The handle of a dropped client is released by Update once it reaches this marker, the messages the client sent 
+			// before it was dropped are still in the queue ahead of it and are handled first
+			void RetireHandle(const std::shared_ptr<connection<T, Transport>>& client)
+			{
+				if (client && !client->m_hSelf.IsNull())
+				{
+					owned_message<T> marker;
+					marker.remote = client->m_hSelf;
+					marker.msg.header.id = ControlId<T>(control::Closed);
+					m_qMessagesIn.push_back(marker);
+				}
+			}
+
+			// Update with server_options::bBatchMessages, the queue is drained into the batcher and the batches are handed out
+			// once it is empty or nMaxMessages were taken. The queue is taken in blocks under one lock rather than one lock per
+			// message. The connections are resolved while draining, a client dropped meanwhile still has the messages it sent
+			// before handled, as in Update. Relayed messages are not batched, they are delivered as they come out of the queue
+			void UpdateBatched(size_t nMaxMessages)
+			{
+				size_t nMessageCount = 0;
+				while (nMessageCount < nMaxMessages && m_qMessagesIn.pop_front(m_vDrained, nMaxMessages - nMessageCount) > 0)
+				{
+					for (auto& msg : m_vDrained)
+					{
+						if (msg.msg.header.id == ControlId<T>(control::Closed))
+						{
+							m_handles.Release(msg.remote);
+							continue;
+						}
+						if (IsControlId(msg.msg.header.id))
+						{
+							DeliverRelayed(msg.msg);
+							nMessageCount++;
+							continue;
+						}
+
+						auto& client = m_handles.Resolve(msg.remote);
+						if (!client)
+						{
+							continue;
+						}
+						if (msg.nTrace && m_pTracer)
+						{
+							m_pTracer->Record(msg.nTrace, trace_stage::Dequeued, client->GetID(), msg.msg.header.id);
+						}
+						m_batcher.Push(client, std::move(msg.msg), msg.nTrace);
+						nMessageCount++;
+					}
+					m_vDrained.clear();
+				}
+
+				m_batcher.Dispatch([this](message_batch<T, connection<T, Transport>>& batch)
+					{
+						OnMessageBatch(batch);
+						if (m_pTracer)
+						{
+							for (size_t i = 0; i < batch.size(); i++)
+							{
+								if (batch.Trace(i))
+								{
+									m_pTracer->Record(batch.Trace(i), trace_stage::Handled, batch.Client(i)->GetID(), batch.Id());
+								}
+							}
+						}
+					});
+			}
+
+			// Run by Update for the relayed messages, on the thread that owns the clients
+			void DeliverRelayed(message<T>& env)
+			{
+				relay_header rh;
+				message<T> msg = OpenRelayEnvelope(env, rh);
+				switch (rh.nKind)
+				{
+				case relay_kind::Broadcast:
+					MessageAllClients(msg);
+					break;
+				case relay_kind::Route:
+					OnRoutedMessage(rh.nKey, msg);
+					break;
+				case relay_kind::Peer:
+					OnPeerMessage(rh.nNode, msg);
+					break;
+				default:
+					break;
+				}
+			}
+
+			// In single thread mode every handler that ASIO completes is followed by draining the incoming queue, the only producer 
+			// of that queue is this same thread so the messages are handled as soon as they are read and no lock is ever contended. 
+			// run_one returns 0 once the context is stopped, which ends the loop
+			void RunSingleThread()
+			{
+				while (m_asioContext.run_one() > 0)
+				{
+					Update(-1, false);
+				}
+			}
+
 		protected:
 			// Function called when a client connects
-			virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
+			virtual bool OnClientConnect(std::shared_ptr<connection<T, Transport>> client)
 			{
 				return false;
 			}
 
 			// Called when a client seems to be disconnected
-			virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client)
+			virtual void OnClientDisconnect(std::shared_ptr<connection<T, Transport>> client)
+			{
+
+			}
+
+			// Called when a message arrives, for the identifiers without a route in m_router
+			virtual void OnMessage(std::shared_ptr <connection<T, Transport>> client, message<T>& msg)
 			{
 
 			}
 
-			// Called when a message arrives
-			virtual void OnMessage(std::shared_ptr <connection<T>> client, message<T>& msg)
+			// Called with server_options::bBatchMessages, once per identifier with every message of that identifier drained by
+			// Update. The default hands them one by one to the routes and OnMessage, so a server only overrides it for the
+			// identifiers it wants to handle as a whole (the movement of every player at once) and passes the others on
+			virtual void OnMessageBatch(message_batch<T, connection<T, Transport>>& batch)
 			{
+				for (size_t i = 0; i < batch.size(); i++)
+				{
+					message_tracer::Current() = batch.Trace(i);
+					HandleMessage(batch.Client(i), batch.Message(i));
+				}
+				message_tracer::Current() = 0;
+			}
 
+			// Messages with a route go straight to their handler, the others to OnMessage
+			void HandleMessage(std::shared_ptr<connection<T, Transport>>& client, message<T>& msg)
+			{
+				if (!m_router.Dispatch(client, msg))
+				{
+					OnMessage(client, msg);
+				}
 			}
 
 		public:
-			virtual void OnClientValidated(std::shared_ptr<connection<T>> client)
+			virtual void OnClientValidated(std::shared_ptr<connection<T, Transport>> client)
+			{
+
+			}
+
+			// Called instead of OnClientValidated when a client comes back and resumes its session, it keeps its identifier and the
+			// messages it missed have already been queued again, so there is no need to send it the whole state
+			virtual void OnClientResumed(std::shared_ptr<connection<T, Transport>>)
+			{
+
+			}
+
+			// Called when a message routed to a key reaches the server owning it. By default the key is taken for a client 
+			// identifier and the message is sent to that client, a server announcing keys of its own handles them here
+			virtual void OnRoutedMessage(uint64_t nKey, message<T>& msg)
+			{
+				if (nKey <= std::numeric_limits<uint32_t>::max())
+				{
+					if (auto client = FindClient(uint32_t(nKey)))
+					{
+						client->Send(msg);
+					}
+				}
+			}
+
+			// Called when another server of the world sends a message to this one with MessagePeers
+			virtual void OnPeerMessage(uint32_t, message<T>&)
 			{
 
 			}
 
 		protected:
+			// Estimate of what std::allocate_shared adds next to the connection (reference counts, virtual table and allocator), 
+			// the pool corrects its block size on the first connection if it is off
+			static constexpr size_t nControlBlockSize = 64;
+			// The pool is declared first so it is destroyed last, after every connection and every session that points to one
+			block_pool m_connectionPool;
+
 			// Thread-safe queue for incoming message packets
 			tsqueue<owned_message<T>> m_qMessagesIn;
 
-			std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+			std::deque<std::shared_ptr<connection<T, Transport>>> m_deqConnections;
+			// Every accepted connection, the messages in the incoming queue refer to them by handle
+			handle_table<connection<T, Transport>> m_handles;
 			// ASIO context which will be shared across all of the connected clients
 			asio::io_context m_asioContext;
 			// Context requires its own thread
 			std::thread m_threadContext;
 			// The acceptor will be the tool we will use to get the client sockets
-			asio::ip::tcp::acceptor m_asioAcceptor;
+			typename Transport::acceptor m_asioAcceptor;
+			// Handshake timeouts, heartbeats and idle timeouts of all the connections
+			timing_wheel m_timerWheel;
+			// Delays the accept loop when the accept rate limit is reached
+			asio::steady_timer m_timerAccept;
+			bool m_bAccepting = false;
+			token_bucket m_bucketAccept;
+			// Handshakes in flight, only touched from the context thread
+			size_t m_nPendingHandshakes = 0;
 			// ID number will change and be delivered to each client connected on the server, this approach its a simplified version 
 			// for identifiers, its also secure as the id confirmation is not some private information used by our system (like an IP 
 			// address) which will be returned to the client or possibly other clients, it will be just a number provided by the server
 			uint32_t nIDCounter = 10000;
+
+			server_options m_options;
+			std::unique_ptr<capture_writer> m_pCapture;
+			std::unique_ptr<message_tracer> m_pTracer;
+			session_store<T, connection<T, Transport>> m_sessions;
+
+			// Filled by the sharded server, the whole group of shards including this one
+			std::vector<server_interface*> m_vShards;
+			size_t m_nShardIndex = 0;
+
+			// Channels of the clients, only touched from the thread running Update
+			channel_registry<T, connection<T, Transport>> m_channels;
+			// Handlers of the message identifiers the server subclass routes, the others go to OnMessage
+			message_router<T, std::shared_ptr<connection<T, Transport>>> m_router;
+			// Messages grouped by identifier for OnMessageBatch, only used with server_options::bBatchMessages
+			message_batcher<T, connection<T, Transport>> m_batcher;
+			std::vector<owned_message<T>> m_vDrained;
+
+			// Relay, only touched from the context thread
+			typename Transport::acceptor m_relayAcceptor;
+			relay_key m_relayKey;
+			std::vector<peer_dial> m_vPeerDials;
+			std::vector<std::shared_ptr<connection<T, Transport>>> m_vPeerLinks;
+			std::unordered_map<uint64_t, std::weak_ptr<connection<T, Transport>>> m_mapRoutes;
+			std::unordered_set<uint64_t> m_setLocalRoutes;
+			wheel_timer m_timerPeers;
+
+			template <typename Shard>
+			friend class sharded_server;
+			friend class connection<T, Transport>;
 		};
 	}
 }
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_transport.h"
+
+#include <random>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#include <cerrno>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <stdlib.h>
+#endif
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Session credentials are bearer secrets, anyone holding them takes over the identity of the client, so they come from
+		// the random source of the operating system rather than from a seeded generator whose output can be predicted from a few
+		// observed values. std::random_device is the fallback on the platforms without one, it is asked again for every value
+		inline uint64_t SecureRandom64()
+		{
+			uint64_t n = 0;
+#if defined(__linux__)
+			uint8_t* p = reinterpret_cast<uint8_t*>(&n);
+			size_t nFilled = 0;
+			while (nFilled < sizeof(n))
+			{
+				ssize_t nRead = getrandom(p + nFilled, sizeof(n) - nFilled, 0);
+				if (nRead < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					throw std::runtime_error("getrandom failed");
+				}
+				nFilled += size_t(nRead);
+			}
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+			arc4random_buf(&n, sizeof(n));
+#else
+			std::random_device rd;
+			n = (uint64_t(rd()) << 32) | uint64_t(rd());
+#endif
+			return n;
+		}
+
+		// Compares two secrets without stopping at the first byte that differs, so how long a rejection takes says nothing 
+		// about how much of the secret was right
+		inline bool SecretsEqual(uint64_t a, uint64_t b)
+		{
+			volatile uint8_t nDiff = 0;
+			for (size_t i = 0; i < sizeof(uint64_t); i++)
+			{
+				nDiff |= uint8_t((a >> (i * 8)) ^ (b >> (i * 8)));
+			}
+			return nDiff == 0;
+		}
+
+		// Written by the client in response to the challenge of the server. The answer is always included, so when the server
+		// does not know the resumption token (it expired, or the server restarted) the client is still validated as a brand new
+		// session without another round trip. A token of 0 means the client is not trying to resume anything. The token only 
+		// finds the session, what proves the client owns it is the secret, which is compared in constant time once the session 
+		// is found
+		struct handshake_reply
+		{
+			uint64_t nAnswer = 0;
+			uint64_t nResumeToken = 0;
+			uint64_t nResumeSecret = 0;
+			// Amount of messages the client received during its previous session, the server replays from this point on
+			uint64_t nLastReceived = 0;
+		};
+
+		// Written by the server once the client is validated, it tells the client its identifier and the token it must present
+		// the next time it connects. The token changes on every resumption so a ticket can only be used once
+		struct session_ticket
+		{
+			uint64_t nToken = 0;
+			uint64_t nSecret = 0;
+			uint32_t nClientID = 0;
+			uint32_t nResumed = 0;
+		};
+
+		// What the client keeps from one connection to the next
+		struct session_resume
+		{
+			uint64_t nToken = 0;
+			uint64_t nSecret = 0;
+			uint64_t nReceived = 0;
+		};
+
+		// Server side state of a session, it outlives its connection for the retention time so a client coming back quickly can
+		// pick up where it left. The window keeps a copy of the last messages sent to the client, each of them is numbered by its
+		// position in the session, so the first message of the window is number nNextSeq - deqWindow.size()
+		template <typename T, typename Connection = connection<T>>
+		struct session_state
+		{
+			uint64_t nToken = 0;
+			uint64_t nSecret = 0;
+			uint32_t nClientID = 0;
+			uint64_t nNextSeq = 0;
+			size_t nMaxWindow = 0;
+			std::deque<shared_message<T>> deqWindow;
+			std::weak_ptr<Connection> wpConnection;
+			std::chrono::steady_clock::time_point tLastSeen = std::chrono::steady_clock::now();
+
+			void Retain(const shared_message<T>& msg)
+			{
+				deqWindow.push_back(msg);
+				if (deqWindow.size() > nMaxWindow)
+				{
+					deqWindow.pop_front();
+				}
+				nNextSeq++;
+			}
+
+			uint64_t FirstRetained() const
+			{
+				return nNextSeq - deqWindow.size();
+			}
+
+			// A client can only be resumed if every message it missed is still in the window
+			bool CanReplayFrom(uint64_t nReceived) const
+			{
+				return nReceived >= FirstRetained() && nReceived <= nNextSeq;
+			}
+		};
+
+		// Sessions of a server, indexed by their current token. It is only used from the ASIO context thread of its server (or
+		// shard) so it does not need a lock
+		template <typename T, typename Connection = connection<T>>
+		class session_store
+		{
+		public:
+			std::shared_ptr<session_state<T, Connection>> Open(uint32_t nClientID, size_t nWindow, std::chrono::seconds tRetention)
+			{
+				Expire(tRetention);
+
+				auto session = std::make_shared<session_state<T, Connection>>();
+				session->nToken = NewToken();
+				session->nSecret = SecureRandom64();
+				session->nClientID = nClientID;
+				session->nMaxWindow = nWindow;
+				m_mapSessions[session->nToken] = session;
+				return session;
+			}
+
+			// Finds the session of a token, checks the secret and gives the session a fresh token and secret, the old ones stop 
+			// being valid right away. A wrong secret leaves the session alone, the rightful client can still resume it
+			std::shared_ptr<session_state<T, Connection>> Resume(uint64_t nToken, uint64_t nSecret, std::chrono::seconds tRetention)
+			{
+				Expire(tRetention);
+
+				auto it = m_mapSessions.find(nToken);
+				if (it == m_mapSessions.end() || !SecretsEqual(it->second->nSecret, nSecret))
+				{
+					return nullptr;
+				}
+
+				auto session = it->second;
+				m_mapSessions.erase(it);
+				session->nToken = NewToken();
+				session->nSecret = SecureRandom64();
+				m_mapSessions[session->nToken] = session;
+				return session;
+			}
+
+		private:
+			uint64_t NewToken()
+			{
+				uint64_t nToken = 0;
+				while (nToken == 0 || m_mapSessions.count(nToken) > 0)
+				{
+					nToken = SecureRandom64();
+				}
+				return nToken;
+			}
+
+			// Sessions whose connection has been gone for longer than the retention time are dropped. The sweep is done at most
+			// once a second, during a reconnect storm it would otherwise run for every single client
+			void Expire(std::chrono::seconds tRetention)
+			{
+				auto tNow = std::chrono::steady_clock::now();
+				if (tNow - m_tLastSweep < std::chrono::seconds(1))
+				{
+					return;
+				}
+				m_tLastSweep = tNow;
+
+				for (auto it = m_mapSessions.begin(); it != m_mapSessions.end();)
+				{
+					auto conn = it->second->wpConnection.lock();
+					if (conn && conn->IsConnected() && !conn->IsSuperseded())
+					{
+						it->second->tLastSeen = tNow;
+						++it;
+					}
+					else if (tNow - it->second->tLastSeen > tRetention)
+					{
+						it = m_mapSessions.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+
+		private:
+			std::unordered_map<uint64_t, std::shared_ptr<session_state<T, Connection>>> m_mapSessions;
+			std::chrono::steady_clock::time_point m_tLastSweep;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_server.h"
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Shared-nothing server mode, one shard per core. Every shard is a complete server of the user type with its own ASIO
+		// context, its own acceptor bound to the same port through SO_REUSEPORT, its own deque of connections and its own
+		// incoming queue, all driven by a single thread pinned to one core. The kernel balances the new connections between the
+		// acceptors, so the shards never share a lock or a cache line while handling their clients. The only way to reach
+		// another shard is the explicit cross-shard API of the server interface (MessageAllShards and PostToShard).
+		// The shard type must derive from server_interface and take the port and the server options in its constructor
+		template <typename Shard>
+		class sharded_server
+		{
+		public:
+			sharded_server(uint16_t port, size_t nShards = 0, server_options options = server_options())
+			{
+				if (nShards == 0)
+				{
+					nShards = std::max<size_t>(1, std::thread::hardware_concurrency());
+				}
+
+				options.bReusePort = true;
+				options.bSingleThread = true;
+
+				// Each shard receives its own slice of the client identifiers so they are still unique in the whole server
+				const uint32_t nFirstID = options.nFirstClientID;
+				const uint32_t nIDRange = (std::numeric_limits<uint32_t>::max() - nFirstID) / uint32_t(nShards);
+				const std::string sCaptureFile = options.sCaptureFile;
+
+				for (size_t i = 0; i < nShards; i++)
+				{
+					options.nCpuCore = int(i);
+					options.nFirstClientID = nFirstID + uint32_t(i) * nIDRange;
+					// Every shard records into a file of its own, suffixed with its index
+					if (!sCaptureFile.empty())
+					{
+						options.sCaptureFile = sCaptureFile + "." + std::to_string(i);
+					}
+					m_vShards.push_back(std::make_unique<Shard>(port, options));
+				}
+
+				// Every shard knows the whole group, which is needed for the cross-shard messaging
+				std::vector<server_interface<typename Shard::message_type, typename Shard::transport_type>*> vGroup;
+				for (auto& shard : m_vShards)
+				{
+					vGroup.push_back(shard.get());
+				}
+				for (size_t i = 0; i < m_vShards.size(); i++)
+				{
+					m_vShards[i]->m_vShards = vGroup;
+					m_vShards[i]->m_nShardIndex = i;
+				}
+			}
+
+			virtual ~sharded_server()
+			{
+				Stop();
+			}
+
+			bool Start()
+			{
+				for (auto& shard : m_vShards)
+				{
+					if (!shard->Start())
+					{
+						Stop();
+						return false;
+					}
+				}
+				return true;
+			}
+
+			void Stop()
+			{
+				for (auto& shard : m_vShards)
+				{
+					shard->Stop();
+				}
+			}
+
+			size_t ShardCount() const
+			{
+				return m_vShards.size();
+			}
+
+			Shard& GetShard(size_t nShard)
+			{
+				return *m_vShards.at(nShard);
+			}
+
+			// Broadcast from outside of the shards (a console command or an admin tool for example)
+			void MessageAllShards(const message<typename Shard::message_type>& msg)
+			{
+				if (!m_vShards.empty())
+				{
+					m_vShards.front()->MessageAllShards(msg);
+				}
+			}
+
+		protected:
+			std::vector<std::unique_ptr<Shard>> m_vShards;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,591 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_tsqueue.h"
+#include "net_transport.h"
+#include "net_log.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Settings of a shared memory channel, both ends must agree on nothing but the name, the capacity is taken from the
+		// segment by the side that opens it
+		struct shm_options
+		{
+			// Bytes of each of the two rings, rounded up to a power of two. A message has to fit in a ring with its 16 byte record
+			size_t nCapacity = 1 << 20;
+			// Times the receiving thread looks at an empty ring before it goes to sleep on the futex. Spinning keeps the latency of
+			// a busy channel away from the scheduler, a quiet channel sleeps after a microsecond or so
+			uint32_t nSpinCount = 2000;
+			// Largest body taken out of the ring, as socket_options::nMaxMessageSize for a socket. The record sizes are written by
+			// the other process, a larger one is taken as a corrupt channel and closes it. 0 leaves only the ring as the limit
+			uint32_t nMaxMessageSize = socket_options().nMaxMessageSize;
+		};
+
+		// The side that creates the segment (the server) and the side that opens it by name (the co-located process)
+		enum class shm_role
+		{
+			Create,
+			Open,
+		};
+
+		// Every message in a ring starts with a record like the ones of a capture file, then comes the body padded to the next
+		// 8 byte boundary, so records are always aligned and the identifier type of the message does not matter to the layout
+		struct shm_record
+		{
+			uint32_t nSize = 0;
+			uint32_t nReserved = 0;
+			uint64_t nId = 0;
+		};
+
+		// Control block of one direction. The producer only writes the tail and the consumer only writes the head, each on a
+		// cache line of its own. The sequence words are what the futexes sleep on, they move every time data is published or
+		// room is made, and the waiting flags tell the other side whether a wake up system call is needed at all
+		struct shm_ring_control
+		{
+			alignas(64) std::atomic<uint64_t> nHead = 0;
+			std::atomic<uint32_t> nSpaceSeq = 0;
+			std::atomic<uint32_t> bProducerWaiting = 0;
+			alignas(64) std::atomic<uint64_t> nTail = 0;
+			std::atomic<uint32_t> nDataSeq = 0;
+			std::atomic<uint32_t> bConsumerWaiting = 0;
+		};
+
+		// Start of the segment, followed by the data of the ring going to the creator and then the one going to the opener
+		struct shm_segment_header
+		{
+			char sMagic[8] = { 'N', 'M', 'S', 'H', 'M', '0', '1', '\0' };
+			uint64_t nCapacity = 0;
+			uint32_t nIdSize = 0;
+			std::atomic<uint32_t> bReady = 0;
+			std::atomic<uint32_t> bClosed = 0;
+			std::atomic<int32_t> nCreatorPid = 0;
+			std::atomic<int32_t> nOpenerPid = 0;
+			shm_ring_control rings[2];
+		};
+
+		static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+			"The rings are shared between processes and need lock free atomics");
+
+		inline void FutexWait(std::atomic<uint32_t>& word, uint32_t nExpected, std::chrono::milliseconds timeout)
+		{
+			timespec ts{ time_t(timeout.count() / 1000), long(timeout.count() % 1000) * 1000000 };
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, nExpected, &ts, nullptr, 0);
+		}
+
+		inline void FutexWake(std::atomic<uint32_t>& word)
+		{
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+		}
+
+		// One direction of a channel, a single producer single consumer byte ring over shared memory. The positions only ever
+		// grow and are reduced modulo the capacity when the data is copied, a record that runs over the end of the ring is
+		// copied in two pieces
+		class shm_ring
+		{
+		public:
+			shm_ring() = default;
+			shm_ring(shm_ring_control* pControl, uint8_t* pData, size_t nCapacity, const std::atomic<uint32_t>* pClosed)
+				: m_pControl(pControl), m_pData(pData), m_nCapacity(nCapacity), m_pClosed(pClosed)
+			{
+
+			}
+
+			static size_t RecordSize(size_t nBody)
+			{
+				return sizeof(shm_record) + ((nBody + 7) & ~size_t(7));
+			}
+
+			// Copies a message into the ring, waiting for the consumer to make room when the ring is full. False when the message
+			// can never fit or the channel was closed while waiting
+			bool Write(uint64_t nId, const uint8_t* pBody, size_t nSize)
+			{
+				const size_t nNeed = RecordSize(nSize);
+				if (nNeed > m_nCapacity)
+				{
+					return false;
+				}
+
+				shm_ring_control& c = *m_pControl;
+				uint64_t nTail = c.nTail.load(std::memory_order_relaxed);
+				while (m_nCapacity - (nTail - c.nHead.load(std::memory_order_acquire)) < nNeed)
+				{
+					if (m_pClosed->load())
+					{
+						return false;
+					}
+
+					// Same handshake as the consumer below, with the roles swapped
+					c.bProducerWaiting.store(1);
+					uint32_t nSeq = c.nSpaceSeq.load();
+					if (m_nCapacity - (nTail - c.nHead.load()) < nNeed && !m_pClosed->load())
+					{
+						FutexWait(c.nSpaceSeq, nSeq, std::chrono::milliseconds(100));
+					}
+					c.bProducerWaiting.store(0, std::memory_order_relaxed);
+				}
+
+				shm_record record;
+				record.nSize = uint32_t(nSize);
+				record.nId = nId;
+				CopyIn(nTail, &record, sizeof(record));
+				if (nSize > 0)
+				{
+					CopyIn(nTail + sizeof(record), pBody, nSize);
+				}
+
+				c.nTail.store(nTail + nNeed);
+				c.nDataSeq.fetch_add(1);
+				if (c.bConsumerWaiting.load())
+				{
+					FutexWake(c.nDataSeq);
+				}
+				return true;
+			}
+
+			bool Corrupt() const
+			{
+				return m_bCorrupt;
+			}
+
+			bool Empty() const
+			{
+				return m_pControl->nHead.load(std::memory_order_relaxed) == m_pControl->nTail.load(std::memory_order_acquire);
+			}
+
+			// Takes the next message out of the ring, false when it is empty or corrupt. The record comes from the other process
+			// and is checked before anything is allocated or copied: it must lie between the head and the tail, which also
+			// keeps the copy inside the ring, and its body must be within nMaxSize. A record failing either is not consumed,
+			// Corrupt then stays true and the channel has to be closed
+			template <typename T>
+			bool Read(message<T>& msg, uint32_t nMaxSize)
+			{
+				shm_ring_control& c = *m_pControl;
+				uint64_t nHead = c.nHead.load(std::memory_order_relaxed);
+				uint64_t nTail = c.nTail.load(std::memory_order_acquire);
+				if (m_bCorrupt || nHead == nTail)
+				{
+					return false;
+				}
+
+				shm_record record;
+				const uint64_t nAvailable = nTail - nHead;
+				if (nAvailable < sizeof(record) || nAvailable > m_nCapacity)
+				{
+					m_bCorrupt = true;
+					return false;
+				}
+				CopyOut(nHead, &record, sizeof(record));
+				if (RecordSize(record.nSize) > nAvailable || (nMaxSize > 0 && record.nSize > nMaxSize))
+				{
+					m_bCorrupt = true;
+					return false;
+				}
+
+				msg.header.id = T(record.nId);
+				msg.header.size = record.nSize;
+				msg.body.resize(record.nSize);
+				if (record.nSize > 0)
+				{
+					CopyOut(nHead + sizeof(record), msg.body.data(), record.nSize);
+				}
+
+				c.nHead.store(nHead + RecordSize(record.nSize));
+				c.nSpaceSeq.fetch_add(1);
+				if (c.bProducerWaiting.load())
+				{
+					FutexWake(c.nSpaceSeq);
+				}
+				return true;
+			}
+
+			// Sleeps until the producer publishes something, the channel is closed or the timeout runs out. The waiting flag is
+			// raised before the ring is looked at again, so either the producer sees the flag and wakes us, or we see its data
+			// and do not sleep. The sequence word changing in between makes the futex return straight away
+			void Wait(uint32_t nSpinCount, std::chrono::milliseconds timeout)
+			{
+				for (uint32_t n = 0; n < nSpinCount; n++)
+				{
+					if (!Empty() || m_pClosed->load(std::memory_order_relaxed))
+					{
+						return;
+					}
+				}
+
+				shm_ring_control& c = *m_pControl;
+				c.bConsumerWaiting.store(1);
+				uint32_t nSeq = c.nDataSeq.load();
+				if (c.nTail.load() == c.nHead.load(std::memory_order_relaxed) && !m_pClosed->load())
+				{
+					FutexWait(c.nDataSeq, nSeq, timeout);
+				}
+				c.bConsumerWaiting.store(0, std::memory_order_relaxed);
+			}
+
+			// Gets both sides out of their futex, used when the channel closes
+			void WakeAll()
+			{
+				m_pControl->nDataSeq.fetch_add(1);
+				m_pControl->nSpaceSeq.fetch_add(1);
+				FutexWake(m_pControl->nDataSeq);
+				FutexWake(m_pControl->nSpaceSeq);
+			}
+
+		private:
+			void CopyIn(uint64_t nPos, const void* pSource, size_t nSize)
+			{
+				size_t nOffset = size_t(nPos & (m_nCapacity - 1));
+				size_t nFirst = std::min(nSize, m_nCapacity - nOffset);
+				std::memcpy(m_pData + nOffset, pSource, nFirst);
+				std::memcpy(m_pData, static_cast<const uint8_t*>(pSource) + nFirst, nSize - nFirst);
+			}
+
+			void CopyOut(uint64_t nPos, void* pTarget, size_t nSize) const
+			{
+				size_t nOffset = size_t(nPos & (m_nCapacity - 1));
+				size_t nFirst = std::min(nSize, m_nCapacity - nOffset);
+				std::memcpy(pTarget, m_pData + nOffset, nFirst);
+				std::memcpy(static_cast<uint8_t*>(pTarget) + nFirst, m_pData, nSize - nFirst);
+			}
+
+		private:
+			shm_ring_control* m_pControl = nullptr;
+			uint8_t* m_pData = nullptr;
+			size_t m_nCapacity = 0;
+			const std::atomic<uint32_t>* m_pClosed = nullptr;
+			bool m_bCorrupt = false;
+		};
+
+		// A connection between two processes of the same host through a shared memory segment instead of a loopback socket. It
+		// carries the same messages as a connection: Send copies the message straight into the ring of the other side (there is
+		// no outgoing queue, the ring is the queue) and a receiving thread of its own moves what arrives into the Incoming queue,
+		// where it is read like the one of a client_interface. The messages have no remote, there is only one.
+		//
+		// The creator makes the segment under a name (a POSIX shared memory object, /dev/shm on Linux) and the other process
+		// opens it by that name. Send waits for room when the other side does not keep up with its ring. Either side closing
+		// the channel, or its process going away, disconnects both
+		template <typename T>
+		class shm_connection
+		{
+		public:
+			shm_connection(shm_role role, const std::string& sName, const shm_options& options = shm_options())
+				: m_role(role), m_sName(sName.empty() || sName[0] != '/' ? "/" + sName : sName), m_nSpinCount(options.nSpinCount),
+				m_nMaxMessageSize(options.nMaxMessageSize)
+			{
+				if (m_role == shm_role::Create)
+				{
+					CreateSegment(options.nCapacity);
+				}
+				else
+				{
+					OpenSegment();
+				}
+
+				// The ring we read is the one going to our side of the channel
+				uint8_t* pData = reinterpret_cast<uint8_t*>(m_pHeader) + sizeof(shm_segment_header);
+				size_t nCapacity = size_t(m_pHeader->nCapacity);
+				shm_ring toCreator(&m_pHeader->rings[0], pData, nCapacity, &m_pHeader->bClosed);
+				shm_ring toOpener(&m_pHeader->rings[1], pData + nCapacity, nCapacity, &m_pHeader->bClosed);
+				m_ringIn = m_role == shm_role::Create ? toCreator : toOpener;
+				m_ringOut = m_role == shm_role::Create ? toOpener : toCreator;
+
+				m_thrReceive = std::thread([this]() { ReceiveThread(); });
+			}
+
+			shm_connection(const shm_connection&) = delete;
+			shm_connection& operator=(const shm_connection&) = delete;
+
+			~shm_connection()
+			{
+				Disconnect();
+				if (m_thrReceive.joinable())
+				{
+					m_thrReceive.join();
+				}
+
+				munmap(m_pHeader, m_nMappedSize);
+				if (m_role == shm_role::Create)
+				{
+					shm_unlink(m_sName.c_str());
+				}
+			}
+
+			bool IsConnected() const
+			{
+				return !m_pHeader->bClosed.load(std::memory_order_relaxed);
+			}
+
+			// True once the other process has opened the segment, always true on the side that opened it
+			bool IsPeerAttached() const
+			{
+				return m_pHeader->nOpenerPid.load(std::memory_order_acquire) != 0;
+			}
+
+			// Closes the channel for both sides, what is already in the rings is still delivered
+			void Disconnect()
+			{
+				if (m_pHeader->bClosed.exchange(1) == 0)
+				{
+					m_ringIn.WakeAll();
+					m_ringOut.WakeAll();
+				}
+			}
+
+			bool Send(const message<T>& msg)
+			{
+				if (!IsConnected())
+				{
+					return false;
+				}
+				if (m_nMaxMessageSize > 0 && msg.body.size() > m_nMaxMessageSize)
+				{
+					NETMSG_LOG_WARNING("[SHM] " << m_sName << " Message Too Large (" << msg.body.size() << " bytes)");
+					return false;
+				}
+
+				std::scoped_lock lock(m_muxSend);
+				return m_ringOut.Write(uint64_t(msg.header.id), msg.body.data(), msg.body.size());
+			}
+
+			// The message is copied into shared memory either way, the overloads are there so the calls written for a connection
+			// compile unchanged
+			bool Send(message<T>&& msg)
+			{
+				return Send(static_cast<const message<T>&>(msg));
+			}
+
+			bool Send(const shared_message<T>& msg)
+			{
+				return Send(*msg);
+			}
+
+			bool Send(message_builder<T>&& builder)
+			{
+				return Send(builder.Message());
+			}
+
+			tsqueue<owned_message<T>>& Incoming()
+			{
+				return m_qMessagesIn;
+			}
+
+		private:
+			void CreateSegment(size_t nCapacity)
+			{
+				size_t nRing = 4096;
+				while (nRing < nCapacity)
+				{
+					nRing <<= 1;
+				}
+				m_nMappedSize = sizeof(shm_segment_header) + 2 * nRing;
+
+				// A segment left behind by a process that died is replaced, the name belongs to the creator
+				int fd = shm_open(m_sName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+				if (fd < 0 && errno == EEXIST)
+				{
+					shm_unlink(m_sName.c_str());
+					fd = shm_open(m_sName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+				}
+				if (fd < 0)
+				{
+					throw std::runtime_error("Cannot create shared memory " + m_sName + ": " + std::strerror(errno));
+				}
+
+				if (ftruncate(fd, off_t(m_nMappedSize)) != 0)
+				{
+					int nError = errno;
+					close(fd);
+					shm_unlink(m_sName.c_str());
+					throw std::runtime_error("Cannot size shared memory " + m_sName + ": " + std::strerror(nError));
+				}
+
+				Map(fd);
+				m_pHeader = new (m_pHeader) shm_segment_header();
+				m_pHeader->nCapacity = nRing;
+				m_pHeader->nIdSize = uint32_t(sizeof(T));
+				m_pHeader->nCreatorPid = int32_t(getpid());
+				// Published last, the side opening the segment waits for it before it looks at anything else
+				m_pHeader->bReady.store(1, std::memory_order_release);
+			}
+
+			void OpenSegment()
+			{
+				int fd = shm_open(m_sName.c_str(), O_RDWR, 0600);
+				if (fd < 0)
+				{
+					throw std::runtime_error("Cannot open shared memory " + m_sName + ": " + std::strerror(errno));
+				}
+
+				struct stat st;
+				if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(shm_segment_header))
+				{
+					close(fd);
+					throw std::runtime_error("Shared memory " + m_sName + " is not a channel");
+				}
+				m_nMappedSize = size_t(st.st_size);
+				Map(fd);
+
+				// The creator may still be filling the header in when we get there
+				auto tGiveUp = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+				while (!m_pHeader->bReady.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < tGiveUp)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+
+				const char sMagic[8] = { 'N', 'M', 'S', 'H', 'M', '0', '1', '\0' };
+				std::string sError;
+				if (!m_pHeader->bReady.load(std::memory_order_acquire) || std::memcmp(m_pHeader->sMagic, sMagic, sizeof(sMagic)) != 0
+					|| m_nMappedSize != sizeof(shm_segment_header) + 2 * m_pHeader->nCapacity)
+				{
+					sError = "Shared memory " + m_sName + " is not a channel";
+				}
+				else if (m_pHeader->nIdSize != sizeof(T))
+				{
+					sError = "Shared memory " + m_sName + " was created with another message identifier type";
+				}
+				else if (m_pHeader->bClosed.load() || m_pHeader->nOpenerPid.load() != 0 || !PeerAlive())
+				{
+					sError = "Shared memory " + m_sName + " is already in use";
+				}
+
+				if (!sError.empty())
+				{
+					munmap(m_pHeader, m_nMappedSize);
+					throw std::runtime_error(sError);
+				}
+
+				m_pHeader->nOpenerPid.store(int32_t(getpid()), std::memory_order_release);
+			}
+
+			void Map(int fd)
+			{
+				void* p = mmap(nullptr, m_nMappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				int nError = errno;
+				close(fd);
+				if (p == MAP_FAILED)
+				{
+					if (m_role == shm_role::Create)
+					{
+						shm_unlink(m_sName.c_str());
+					}
+					throw std::runtime_error("Cannot map shared memory " + m_sName + ": " + std::strerror(nError));
+				}
+				m_pHeader = static_cast<shm_segment_header*>(p);
+			}
+
+			// A process killed without closing its end leaves the flag alone, so every timeout of the receiving thread checks
+			// the other process is still there. The side opening the segment also checks it was not left behind by a dead server
+			bool PeerAlive() const
+			{
+				int32_t nPid = m_role == shm_role::Create ? m_pHeader->nOpenerPid.load() : m_pHeader->nCreatorPid.load();
+				return nPid == 0 || kill(pid_t(nPid), 0) == 0 || errno != ESRCH;
+			}
+
+			void ReceiveThread()
+			{
+				message<T> msg;
+				while (true)
+				{
+					bool bReceived = false;
+					while (m_ringIn.Read(msg, m_nMaxMessageSize))
+					{
+						m_qMessagesIn.push_back({ {}, std::move(msg) });
+						msg = message<T>();
+						bReceived = true;
+					}
+
+					// Nothing after a bad record can be trusted, not even where the next one starts
+					if (m_ringIn.Corrupt())
+					{
+						NETMSG_LOG_WARNING("[SHM] " << m_sName << " Corrupt Record, Closing");
+						Disconnect();
+						break;
+					}
+
+					// The rings are drained before the thread goes, nothing sent before the close is lost
+					if (!IsConnected())
+					{
+						if (m_ringIn.Empty())
+						{
+							break;
+						}
+						continue;
+					}
+
+					if (!bReceived)
+					{
+						m_ringIn.Wait(m_nSpinCount, std::chrono::milliseconds(100));
+						if (m_ringIn.Empty() && IsConnected() && !PeerAlive())
+						{
+							NETMSG_LOG_INFO("[SHM] " << m_sName << " Peer Gone");
+							Disconnect();
+						}
+					}
+				}
+			}
+
+		private:
+			shm_role m_role;
+			std::string m_sName;
+			uint32_t m_nSpinCount = 0;
+			uint32_t m_nMaxMessageSize = 0;
+			shm_segment_header* m_pHeader = nullptr;
+			size_t m_nMappedSize = 0;
+			shm_ring m_ringIn;
+			shm_ring m_ringOut;
+			std::mutex m_muxSend;
+			tsqueue<owned_message<T>> m_qMessagesIn;
+			std::thread m_thrReceive;
+		};
+	}
+}
+
+#endif
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
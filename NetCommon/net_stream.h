@@ -0,0 +1,225 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <unordered_map>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Trailer of every piece of a stream. A payload too large to be sent as a single message is cut into pieces of a fixed 
+		// size, each of them an ordinary message with the identifier the application chose for the stream, so the pieces go 
+		// through the same queues, rate limits and captures as everything else. The pieces of a stream arrive in order, the 
+		// total is 0 when the sender did not know it in advance
+		struct stream_chunk
+		{
+			uint32_t nStream = 0;
+			uint32_t nLast = 0;
+			uint64_t nOffset = 0;
+			uint64_t nTotal = 0;
+		};
+
+		// Pulls the trailer out of a piece, the body is left with the data of the piece only
+		template<typename T>
+		stream_chunk PopStreamChunk(message<T>& msg)
+		{
+			stream_chunk chunk;
+			msg >> chunk;
+			return chunk;
+		}
+
+		// Produces the data of a stream on the context thread, one piece at a time, and returns how many bytes it wrote into the 
+		// buffer. Returning 0 ends the stream. A source reading a file or generating the data on the fly keeps the memory of 
+		// the sender down to a single piece whatever the size of the stream
+		using stream_source = std::function<size_t(uint8_t* pData, size_t nSize)>;
+
+		// Puts the pieces of the streams of one sender back together. Everything it holds is decided by the sender, so all of it 
+		// is bounded: a stream growing beyond the maximum size is dropped along with the rest of its pieces, only so many 
+		// streams can be in progress at once and only so many bytes buffered for all of them, and a stream that received no 
+		// piece for the timeout is forgotten. The total announced by the sender is not trusted with any allocation, the data 
+		// grows with the pieces that actually arrived. Not thread-safe, it is meant to be used by the thread handling the 
+		// incoming messages
+		class stream_assembler
+		{
+		public:
+			stream_assembler(size_t nMaxStreamSize = 64 * 1024 * 1024, size_t nMaxStreams = 8, size_t nMaxBuffered = 128 * 1024 * 1024,
+				std::chrono::seconds tTimeout = std::chrono::seconds(30))
+				: m_nMaxStreamSize(nMaxStreamSize), m_nMaxStreams(nMaxStreams), m_nMaxBuffered(nMaxBuffered), m_tTimeout(tTimeout)
+			{
+
+			}
+
+			// Adds a piece, the message must still have its trailer. Returns true when this piece completed its stream, the data 
+			// of the whole stream is then moved into vData
+			template<typename T>
+			bool Add(message<T>& msg, std::vector<uint8_t>& vData)
+			{
+				// A piece too short to hold its trailer does not belong to any stream
+				if (msg.body.size() < sizeof(stream_chunk))
+				{
+					m_nDropped++;
+					return false;
+				}
+
+				stream_chunk chunk = PopStreamChunk(msg);
+				auto tNow = std::chrono::steady_clock::now();
+
+				auto it = m_mapStreams.find(chunk.nStream);
+				if (it == m_mapStreams.end())
+				{
+					// Only the first piece opens a stream. The rest of a stream that was refused, or forgotten by Clear or the 
+					// timeout, is ignored
+					if (chunk.nOffset != 0)
+					{
+						return false;
+					}
+
+					Expire(tNow);
+					if (m_mapStreams.size() >= m_nMaxStreams)
+					{
+						m_nDropped++;
+						return false;
+					}
+					it = m_mapStreams.emplace(chunk.nStream, partial()).first;
+				}
+
+				partial& p = it->second;
+				p.tLastPiece = tNow;
+
+				if (!p.bDropped && m_nBuffered + msg.body.size() > m_nMaxBuffered)
+				{
+					Expire(tNow);
+				}
+				if (!p.bDropped && (chunk.nOffset != p.vData.size() || p.vData.size() + msg.body.size() > m_nMaxStreamSize
+					|| m_nBuffered + msg.body.size() > m_nMaxBuffered))
+				{
+					// A piece out of place means the stream was cut short by a reconnection
+					Drop(p);
+				}
+				if (!p.bDropped)
+				{
+					p.vData.insert(p.vData.end(), msg.body.begin(), msg.body.end());
+					m_nBuffered += msg.body.size();
+				}
+
+				if (!chunk.nLast)
+				{
+					return false;
+				}
+
+				bool bComplete = !p.bDropped;
+				if (bComplete)
+				{
+					m_nBuffered -= p.vData.size();
+					vData = std::move(p.vData);
+				}
+				m_mapStreams.erase(it);
+				return bComplete;
+			}
+
+			// Forgets the streams that received no piece for the timeout. Add does it whenever a stream opens or the buffers are 
+			// full, a receiver whose sender may simply stop can also call it from time to time
+			void Expire(std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now())
+			{
+				for (auto it = m_mapStreams.begin(); it != m_mapStreams.end();)
+				{
+					if (tNow - it->second.tLastPiece > m_tTimeout)
+					{
+						if (!it->second.bDropped)
+						{
+							Drop(it->second);
+						}
+						it = m_mapStreams.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+
+			// Forgets the streams in progress, after a reconnection they will never be completed
+			void Clear()
+			{
+				m_mapStreams.clear();
+				m_nBuffered = 0;
+			}
+
+			size_t InProgress() const
+			{
+				return m_mapStreams.size();
+			}
+
+			// Bytes held for the streams in progress
+			size_t Buffered() const
+			{
+				return m_nBuffered;
+			}
+
+			uint64_t Dropped() const
+			{
+				return m_nDropped;
+			}
+
+		private:
+			struct partial
+			{
+				std::vector<uint8_t> vData;
+				bool bDropped = false;
+				std::chrono::steady_clock::time_point tLastPiece;
+			};
+
+			void Drop(partial& p)
+			{
+				m_nBuffered -= p.vData.size();
+				p.vData = std::vector<uint8_t>();
+				p.bDropped = true;
+				m_nDropped++;
+			}
+
+			size_t m_nMaxStreamSize;
+			size_t m_nMaxStreams;
+			size_t m_nMaxBuffered;
+			std::chrono::seconds m_tTimeout;
+			std::unordered_map<uint32_t, partial> m_mapStreams;
+			size_t m_nBuffered = 0;
+			uint64_t m_nDropped = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,570 @@
+#pragma once
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <string_view>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Structured message bodies read in place, in the spirit of FlatBuffers. A body built by table_builder is a tree of
+		// tables, strings and vectors laid out in one buffer, every reference being the offset of its target from the start
+		// of the buffer. A table is its amount of slots followed by one offset per slot, 0 for a field that was not set:
+		//
+		//   [root offset] ... [scalar] [string: length, bytes, 0] [vector: count, elements] ... [table: slots, offsets]
+		//
+		// The children are written before the table that points at them, so the builder only ever appends. On the other end
+		// table_view reads a field straight out of the body it received, by following one offset: nothing is decoded into
+		// locals, nothing is allocated, and the fields a handler does not look at cost nothing. Values are in the byte order
+		// of the machine, like everything else pushed into a message, and are copied out with memcpy so the buffer needs no
+		// particular alignment.
+		//
+		// There is no schema compiler. The accessors a schema compiler would generate are small structs written by hand over
+		// a table_view, one per table, with a method per field giving its slot and type, and a static Verify listing the
+		// same fields for table_verifier. A handler must run the verifier on a body from the network before reading it, the
+		// accessors trust the offsets. New fields go in new slots at the end, a reader that does not know them skips them
+		// and a reader that expects a slot the sender did not have gets the default
+		namespace detail
+		{
+			template <typename S>
+			S LoadScalar(const uint8_t* p)
+			{
+				S value;
+				std::memcpy(&value, p, sizeof(S));
+				return value;
+			}
+		}
+
+		class table_builder
+		{
+		public:
+			table_builder(size_t nReserveBytes = 1024)
+			{
+				m_vBuffer.reserve(nReserveBytes);
+				Clear();
+			}
+
+			// Starts a new body, the first four bytes are kept for the offset of the root table
+			void Clear()
+			{
+				m_vBuffer.assign(sizeof(uint32_t), 0);
+				m_vSlots.clear();
+				m_bInTable = false;
+			}
+
+			uint32_t CreateString(std::string_view sValue)
+			{
+				CheckOutsideTable();
+				uint32_t nOffset = Align();
+				Append(uint32_t(sValue.size()));
+				AppendBytes(sValue.data(), sValue.size());
+				m_vBuffer.push_back(0);
+				return nOffset;
+			}
+
+			template <typename S>
+			uint32_t CreateVector(const S* pValues, size_t nCount)
+			{
+				static_assert(std::is_arithmetic<S>::value || std::is_enum<S>::value, "Only vectors of numbers can be created, use CreateTableVector for tables");
+				CheckOutsideTable();
+				uint32_t nOffset = Align();
+				Append(uint32_t(nCount));
+				AppendBytes(pValues, nCount * sizeof(S));
+				return nOffset;
+			}
+
+			template <typename S>
+			uint32_t CreateVector(const std::vector<S>& vValues)
+			{
+				return CreateVector(vValues.data(), vValues.size());
+			}
+
+			// A vector of tables built before, given by the offsets EndTable returned
+			uint32_t CreateTableVector(const uint32_t* pTables, size_t nCount)
+			{
+				CheckOutsideTable();
+				uint32_t nOffset = Align();
+				Append(uint32_t(nCount));
+				AppendBytes(pTables, nCount * sizeof(uint32_t));
+				return nOffset;
+			}
+
+			uint32_t CreateTableVector(const std::vector<uint32_t>& vTables)
+			{
+				return CreateTableVector(vTables.data(), vTables.size());
+			}
+
+			// One table at a time: the strings, vectors and tables it points at are created before StartTable
+			void StartTable(uint32_t nSlots)
+			{
+				CheckOutsideTable();
+				m_vSlots.assign(nSlots, 0);
+				m_bInTable = true;
+			}
+
+			template <typename S>
+			void AddScalar(uint32_t nSlot, S value)
+			{
+				static_assert(std::is_arithmetic<S>::value || std::is_enum<S>::value, "Only numbers are stored in place, other fields are references");
+				CheckSlot(nSlot);
+				m_vSlots[nSlot] = Align();
+				Append(value);
+			}
+
+			// A string, a vector or a table created before, the slot simply holds its offset
+			void AddReference(uint32_t nSlot, uint32_t nOffset)
+			{
+				CheckSlot(nSlot);
+				m_vSlots[nSlot] = nOffset;
+			}
+
+			uint32_t EndTable()
+			{
+				if (!m_bInTable)
+				{
+					throw std::runtime_error("EndTable without StartTable");
+				}
+				m_bInTable = false;
+				uint32_t nOffset = Align();
+				Append(uint32_t(m_vSlots.size()));
+				AppendBytes(m_vSlots.data(), m_vSlots.size() * sizeof(uint32_t));
+				return nOffset;
+			}
+
+			void Finish(uint32_t nRoot)
+			{
+				CheckOutsideTable();
+				std::memcpy(m_vBuffer.data(), &nRoot, sizeof(nRoot));
+			}
+
+			// Finishes the body and swaps it into the message, which must be empty. The builder carries on with the old
+			// buffer of the message, a message reused from one tick to the next costs no allocation
+			template <typename T>
+			void Finish(uint32_t nRoot, message<T>& msg)
+			{
+				Finish(nRoot);
+				std::swap(msg.body, m_vBuffer);
+				msg.header.size = msg.size();
+				Clear();
+			}
+
+			const std::vector<uint8_t>& Buffer() const
+			{
+				return m_vBuffer;
+			}
+
+		private:
+			void CheckOutsideTable() const
+			{
+				if (m_bInTable)
+				{
+					throw std::runtime_error("Tables are built one at a time, their children first");
+				}
+			}
+
+			void CheckSlot(uint32_t nSlot) const
+			{
+				if (!m_bInTable || nSlot >= m_vSlots.size())
+				{
+					throw std::runtime_error("Field set outside of a table or beyond its slots");
+				}
+			}
+
+			// Every object starts on four bytes, returns where the next one goes
+			uint32_t Align()
+			{
+				m_vBuffer.resize((m_vBuffer.size() + 3) & ~size_t(3), 0);
+				if (m_vBuffer.size() > std::numeric_limits<uint32_t>::max())
+				{
+					throw std::runtime_error("Table body larger than 4 GiB");
+				}
+				return uint32_t(m_vBuffer.size());
+			}
+
+			template <typename S>
+			void Append(S value)
+			{
+				AppendBytes(&value, sizeof(S));
+			}
+
+			void AppendBytes(const void* pData, size_t nBytes)
+			{
+				size_t nAt = m_vBuffer.size();
+				m_vBuffer.resize(nAt + nBytes);
+				if (nBytes > 0)
+				{
+					std::memcpy(m_vBuffer.data() + nAt, pData, nBytes);
+				}
+			}
+
+		private:
+			std::vector<uint8_t> m_vBuffer;
+			std::vector<uint32_t> m_vSlots;
+			bool m_bInTable = false;
+		};
+
+		// The numbers of a vector, read in place
+		template <typename S>
+		class vector_view
+		{
+		public:
+			vector_view() = default;
+
+			vector_view(const uint8_t* pData, uint32_t nCount) : m_pData(pData), m_nCount(nCount)
+			{
+
+			}
+
+			uint32_t size() const
+			{
+				return m_nCount;
+			}
+
+			bool empty() const
+			{
+				return m_nCount == 0;
+			}
+
+			S operator[](uint32_t i) const
+			{
+				return detail::LoadScalar<S>(m_pData + size_t(i) * sizeof(S));
+			}
+
+		private:
+			const uint8_t* m_pData = nullptr;
+			uint32_t m_nCount = 0;
+		};
+
+		class table_view;
+
+		// The tables of a vector, read in place
+		class table_vector_view
+		{
+		public:
+			table_vector_view() = default;
+
+			table_vector_view(const uint8_t* pBuffer, uint32_t nOffset) : m_pBuffer(pBuffer), m_nOffset(nOffset)
+			{
+
+			}
+
+			uint32_t size() const
+			{
+				return m_pBuffer ? detail::LoadScalar<uint32_t>(m_pBuffer + m_nOffset) : 0;
+			}
+
+			bool empty() const
+			{
+				return size() == 0;
+			}
+
+			table_view operator[](uint32_t i) const;
+
+		private:
+			const uint8_t* m_pBuffer = nullptr;
+			uint32_t m_nOffset = 0;
+		};
+
+		// One table of a body, a pointer to the buffer and the offset of the table in it. A default constructed view is the
+		// absent table, every field of it reads as its default
+		class table_view
+		{
+		public:
+			table_view() = default;
+
+			table_view(const uint8_t* pBuffer, uint32_t nOffset) : m_pBuffer(pBuffer), m_nOffset(nOffset)
+			{
+
+			}
+
+			static table_view Root(const uint8_t* pBuffer)
+			{
+				return table_view(pBuffer, detail::LoadScalar<uint32_t>(pBuffer));
+			}
+
+			template <typename T>
+			static table_view Root(const message<T>& msg)
+			{
+				return Root(msg.body.data());
+			}
+
+			bool IsNull() const
+			{
+				return m_pBuffer == nullptr;
+			}
+
+			const uint8_t* Buffer() const
+			{
+				return m_pBuffer;
+			}
+
+			uint32_t Offset() const
+			{
+				return m_nOffset;
+			}
+
+			uint32_t Slots() const
+			{
+				return m_pBuffer ? detail::LoadScalar<uint32_t>(m_pBuffer + m_nOffset) : 0;
+			}
+
+			// Offset of the field in a slot, 0 when it was not set or the slot is beyond what the sender knew about
+			uint32_t Field(uint32_t nSlot) const
+			{
+				if (nSlot >= Slots())
+				{
+					return 0;
+				}
+				return detail::LoadScalar<uint32_t>(m_pBuffer + m_nOffset + sizeof(uint32_t) * (size_t(nSlot) + 1));
+			}
+
+			bool Has(uint32_t nSlot) const
+			{
+				return Field(nSlot) != 0;
+			}
+
+			template <typename S>
+			S Scalar(uint32_t nSlot, S defaultValue = S()) const
+			{
+				uint32_t nField = Field(nSlot);
+				return nField ? detail::LoadScalar<S>(m_pBuffer + nField) : defaultValue;
+			}
+
+			// Points into the buffer, it lives as long as the message does
+			std::string_view String(uint32_t nSlot) const
+			{
+				uint32_t nField = Field(nSlot);
+				if (!nField)
+				{
+					return {};
+				}
+				uint32_t nLength = detail::LoadScalar<uint32_t>(m_pBuffer + nField);
+				return std::string_view(reinterpret_cast<const char*>(m_pBuffer + nField + sizeof(uint32_t)), nLength);
+			}
+
+			template <typename S>
+			vector_view<S> Vector(uint32_t nSlot) const
+			{
+				uint32_t nField = Field(nSlot);
+				if (!nField)
+				{
+					return {};
+				}
+				return vector_view<S>(m_pBuffer + nField + sizeof(uint32_t), detail::LoadScalar<uint32_t>(m_pBuffer + nField));
+			}
+
+			table_view Table(uint32_t nSlot) const
+			{
+				uint32_t nField = Field(nSlot);
+				return nField ? table_view(m_pBuffer, nField) : table_view();
+			}
+
+			table_vector_view Tables(uint32_t nSlot) const
+			{
+				uint32_t nField = Field(nSlot);
+				return nField ? table_vector_view(m_pBuffer, nField) : table_vector_view();
+			}
+
+		private:
+			const uint8_t* m_pBuffer = nullptr;
+			uint32_t m_nOffset = 0;
+		};
+
+		inline table_view table_vector_view::operator[](uint32_t i) const
+		{
+			return table_view(m_pBuffer, detail::LoadScalar<uint32_t>(m_pBuffer + m_nOffset + sizeof(uint32_t) * (size_t(i) + 1)));
+		}
+
+		// Checks a body from the network before any accessor reads it: every offset the accessors will follow lands inside
+		// the buffer with room for what is read there, strings end with their terminator, and the walk stays within a
+		// depth and an amount of tables, so offsets pointing back up the tree cannot keep it going forever. The verifier
+		// knows nothing of the fields, the Verify of each accessor struct tells it the type of every slot:
+		//
+		//   static bool Verify(table_verifier& v, table_view t)
+		//   {
+		//       return v.VerifyTable(t) && v.VerifyScalar<uint32_t>(t, 0) && v.VerifyString(t, 1) && v.VerifyChildren<item>(t, 2);
+		//   }
+		class table_verifier
+		{
+		public:
+			table_verifier(const uint8_t* pBuffer, size_t nSize, size_t nMaxDepth = 64, size_t nMaxTables = 1000000)
+				: m_pBuffer(pBuffer), m_nSize(nSize), m_nMaxDepth(nMaxDepth), m_nMaxTables(nMaxTables)
+			{
+
+			}
+
+			template <typename T>
+			table_verifier(const message<T>& msg, size_t nMaxDepth = 64, size_t nMaxTables = 1000000)
+				: table_verifier(msg.body.data(), msg.body.size(), nMaxDepth, nMaxTables)
+			{
+
+			}
+
+			// Verifies the whole tree below the root table with the accessor struct of the root
+			template <typename Root>
+			bool VerifyRoot()
+			{
+				if (!InBuffer(0, sizeof(uint32_t)))
+				{
+					return false;
+				}
+				return Root::Verify(*this, table_view::Root(m_pBuffer));
+			}
+
+			// The amount of slots and the offsets of the table are inside the buffer
+			bool VerifyTable(table_view t)
+			{
+				if (++m_nTables > m_nMaxTables || !InBuffer(t.Offset(), sizeof(uint32_t)))
+				{
+					return false;
+				}
+				uint64_t nSlots = detail::LoadScalar<uint32_t>(m_pBuffer + t.Offset());
+				return InBuffer(t.Offset() + sizeof(uint32_t), nSlots * sizeof(uint32_t));
+			}
+
+			template <typename S>
+			bool VerifyScalar(table_view t, uint32_t nSlot)
+			{
+				uint32_t nField = t.Field(nSlot);
+				return !nField || InBuffer(nField, sizeof(S));
+			}
+
+			bool VerifyString(table_view t, uint32_t nSlot)
+			{
+				uint32_t nField = t.Field(nSlot);
+				if (!nField)
+				{
+					return true;
+				}
+				if (!InBuffer(nField, sizeof(uint32_t)))
+				{
+					return false;
+				}
+				uint64_t nLength = detail::LoadScalar<uint32_t>(m_pBuffer + nField);
+				return InBuffer(nField + sizeof(uint32_t), nLength + 1) && m_pBuffer[nField + sizeof(uint32_t) + nLength] == 0;
+			}
+
+			template <typename S>
+			bool VerifyVector(table_view t, uint32_t nSlot)
+			{
+				return VerifyArray(t.Field(nSlot), sizeof(S));
+			}
+
+			// A field holding a table, verified with the accessor struct of that table
+			template <typename Child>
+			bool VerifyChild(table_view t, uint32_t nSlot)
+			{
+				uint32_t nField = t.Field(nSlot);
+				if (!nField)
+				{
+					return true;
+				}
+				return Descend([&]() { return Child::Verify(*this, table_view(m_pBuffer, nField)); });
+			}
+
+			// A field holding a vector of tables, each one verified with the accessor struct of the element
+			template <typename Child>
+			bool VerifyChildren(table_view t, uint32_t nSlot)
+			{
+				uint32_t nField = t.Field(nSlot);
+				if (!nField)
+				{
+					return true;
+				}
+				if (!VerifyArray(nField, sizeof(uint32_t)))
+				{
+					return false;
+				}
+				table_vector_view vTables(m_pBuffer, nField);
+				return Descend([&]()
+					{
+						for (uint32_t i = 0; i < vTables.size(); i++)
+						{
+							if (!Child::Verify(*this, vTables[i]))
+							{
+								return false;
+							}
+						}
+						return true;
+					});
+			}
+
+		private:
+			bool InBuffer(uint64_t nOffset, uint64_t nBytes) const
+			{
+				return nOffset <= m_nSize && nBytes <= m_nSize - nOffset;
+			}
+
+			bool VerifyArray(uint32_t nField, size_t nElement) const
+			{
+				if (!nField)
+				{
+					return true;
+				}
+				if (!InBuffer(nField, sizeof(uint32_t)))
+				{
+					return false;
+				}
+				uint64_t nCount = detail::LoadScalar<uint32_t>(m_pBuffer + nField);
+				return InBuffer(nField + sizeof(uint32_t), nCount * nElement);
+			}
+
+			template <typename F>
+			bool Descend(F&& fn)
+			{
+				if (m_nDepth >= m_nMaxDepth)
+				{
+					return false;
+				}
+				m_nDepth++;
+				bool bOk = fn();
+				m_nDepth--;
+				return bOk;
+			}
+
+		private:
+			const uint8_t* m_pBuffer = nullptr;
+			size_t m_nSize = 0;
+			size_t m_nMaxDepth = 64;
+			size_t m_nMaxTables = 1000000;
+			size_t m_nDepth = 0;
+			size_t m_nTables = 0;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "net_common.h"
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Timer node for the timing wheel. It is meant to be a member of the object it times (a connection keeps one for each of
+		// its deadlines), so arming, moving or cancelling it never allocates. While it is armed the node is linked in one slot
+		// of the wheel
+		struct wheel_timer
+		{
+			wheel_timer* pPrev = nullptr;
+			wheel_timer* pNext = nullptr;
+			// Absolute tick at which the timer expires
+			uint64_t nExpiry = 0;
+			// Called on the context thread when the timer expires, the owner is whatever the callback needs to find its object
+			void (*fnCallback)(wheel_timer&) = nullptr;
+			void* pOwner = nullptr;
+			// Optional reference held by the wheel while the timer is armed, it keeps a shared object alive until its timer has
+			// either fired or been cancelled
+			std::shared_ptr<void> pKeepAlive;
+
+			bool IsArmed() const
+			{
+				return pNext != nullptr;
+			}
+		};
+
+		// Hierarchical timing wheel, one per ASIO context, driving every connection deadline of that context (heartbeats, idle
+		// disconnects, handshake timeouts) from a single steady_timer. Scheduling and cancelling are O(1): a timer lands in the
+		// slot of the lowest level that can hold its delay, and every time a level completes a turn the next slot of the level
+		// above is cascaded down. With 4 levels of 256 slots and 10ms ticks the wheel covers more than 16 months, longer delays
+		// are clamped to that. All the functions must be called from the thread running the context
+		class timing_wheel
+		{
+		public:
+			static constexpr size_t nLevels = 4;
+			static constexpr size_t nSlotBits = 8;
+			static constexpr size_t nSlots = size_t(1) << nSlotBits;
+			static constexpr uint64_t nSlotMask = nSlots - 1;
+
+			timing_wheel(asio::io_context& asioContext, std::chrono::milliseconds tTick = std::chrono::milliseconds(10))
+				: m_asioContext(asioContext), m_timerTick(asioContext), m_tTick(tTick)
+			{
+				// Every slot is an empty circular list, its head points to itself
+				for (auto& level : m_vSlots)
+				{
+					for (auto& slot : level)
+					{
+						slot.pPrev = &slot;
+						slot.pNext = &slot;
+					}
+				}
+			}
+
+			timing_wheel(const timing_wheel&) = delete;
+			timing_wheel& operator=(const timing_wheel&) = delete;
+
+			~timing_wheel()
+			{
+				// The nodes are unlinked before their owners are released, an owner destroyed by that release can still call
+				// Cancel on its own nodes safely
+				std::vector<std::shared_ptr<void>> vKeepAlive;
+				for (auto& level : m_vSlots)
+				{
+					for (auto& slot : level)
+					{
+						while (slot.pNext != &slot)
+						{
+							wheel_timer* t = slot.pNext;
+							Unlink(*t);
+							vKeepAlive.push_back(std::move(t->pKeepAlive));
+						}
+					}
+				}
+			}
+
+			// Starts ticking, the current time becomes tick 0
+			void Start()
+			{
+				m_tStart = std::chrono::steady_clock::now();
+				m_nNow = 0;
+				WaitForTick();
+			}
+
+			void Stop()
+			{
+				m_timerTick.cancel();
+			}
+
+			// (Re)arms a timer, a timer already armed is moved to its new deadline
+			void Schedule(wheel_timer& timer, std::chrono::milliseconds tDelay)
+			{
+				if (timer.IsArmed())
+				{
+					Unlink(timer);
+					m_nTimers--;
+				}
+
+				// Rounded up, a timer never fires early
+				uint64_t nTicks = uint64_t((tDelay.count() + m_tTick.count() - 1) / m_tTick.count());
+				timer.nExpiry = m_nNow + std::max<uint64_t>(1, nTicks);
+				Insert(timer);
+				m_nTimers++;
+			}
+
+			// Disarms a timer, nothing happens if it was not armed. The reference the wheel held is released later on the context
+			// thread, so an owner cancelling its own timer is never destroyed in the middle of its own member function
+			void Cancel(wheel_timer& timer)
+			{
+				if (timer.IsArmed())
+				{
+					Unlink(timer);
+					m_nTimers--;
+					if (timer.pKeepAlive)
+					{
+						asio::post(m_asioContext, [pKeepAlive = std::move(timer.pKeepAlive)]() {});
+					}
+				}
+			}
+
+			// Moves the wheel forward by a number of ticks, firing everything that expires on the way. Driven by the steady_timer
+			// when the wheel is started, and it can be called directly to drive the wheel by hand (the benchmark does that)
+			void Advance(uint64_t nTicks)
+			{
+				for (uint64_t i = 0; i < nTicks; i++)
+				{
+					m_nNow++;
+
+					// When the lowest level completes a turn, the slots of the levels above are cascaded down. Each level only
+					// cascades if the one below it just wrapped around too
+					for (size_t nLevel = 1; nLevel < nLevels; nLevel++)
+					{
+						if ((m_nNow & ((uint64_t(1) << (nSlotBits * nLevel)) - 1)) != 0)
+						{
+							break;
+						}
+						Cascade(nLevel);
+					}
+
+					wheel_timer& slot = m_vSlots[0][m_nNow & nSlotMask];
+					while (slot.pNext != &slot)
+					{
+						wheel_timer* t = slot.pNext;
+						Unlink(*t);
+						m_nTimers--;
+
+						// The callback may schedule the timer again, in that case it keeps its reference
+						std::shared_ptr<void> pKeepAlive = std::move(t->pKeepAlive);
+						t->fnCallback(*t);
+						if (t->IsArmed() && !t->pKeepAlive)
+						{
+							t->pKeepAlive = std::move(pKeepAlive);
+						}
+					}
+				}
+			}
+
+			size_t Size() const
+			{
+				return m_nTimers;
+			}
+
+			uint64_t Now() const
+			{
+				return m_nNow;
+			}
+
+			std::chrono::milliseconds Tick() const
+			{
+				return m_tTick;
+			}
+
+		private:
+			// The steady_timer is set on absolute tick boundaries, when the thread falls behind every missed tick is processed
+			// in one go instead of drifting
+			void WaitForTick()
+			{
+				m_timerTick.expires_at(m_tStart + m_tTick * (m_nNow + 1));
+				m_timerTick.async_wait(
+					[this](std::error_code ec)
+					{
+						if (!ec)
+						{
+							uint64_t nTarget = uint64_t((std::chrono::steady_clock::now() - m_tStart) / m_tTick);
+							Advance(nTarget > m_nNow ? nTarget - m_nNow : 1);
+							WaitForTick();
+						}
+					});
+			}
+
+			void Insert(wheel_timer& timer)
+			{
+				uint64_t nDelta = timer.nExpiry - m_nNow;
+				size_t nLevel = 0;
+				while (nLevel < nLevels - 1 && nDelta >= (uint64_t(1) << (nSlotBits * (nLevel + 1))))
+				{
+					nLevel++;
+				}
+
+				// Delays beyond the last level are clamped to its furthest slot
+				uint64_t nMax = (uint64_t(1) << (nSlotBits * nLevels)) - 1;
+				if (nDelta > nMax)
+				{
+					timer.nExpiry = m_nNow + nMax;
+				}
+
+				wheel_timer& slot = m_vSlots[nLevel][(timer.nExpiry >> (nSlotBits * nLevel)) & nSlotMask];
+				timer.pPrev = slot.pPrev;
+				timer.pNext = &slot;
+				slot.pPrev->pNext = &timer;
+				slot.pPrev = &timer;
+			}
+
+			void Unlink(wheel_timer& timer)
+			{
+				timer.pPrev->pNext = timer.pNext;
+				timer.pNext->pPrev = timer.pPrev;
+				timer.pPrev = nullptr;
+				timer.pNext = nullptr;
+			}
+
+			// Re-inserts every timer of the current slot of a level, they all land on lower levels as they are now closer
+			void Cascade(size_t nLevel)
+			{
+				wheel_timer& slot = m_vSlots[nLevel][(m_nNow >> (nSlotBits * nLevel)) & nSlotMask];
+				wheel_timer list;
+				if (slot.pNext == &slot)
+				{
+					return;
+				}
+
+				// The whole list is detached first, as inserting may put timers back on this same level
+				list.pNext = slot.pNext;
+				list.pPrev = slot.pPrev;
+				list.pNext->pPrev = &list;
+				list.pPrev->pNext = &list;
+				slot.pNext = &slot;
+				slot.pPrev = &slot;
+
+				while (list.pNext != &list)
+				{
+					wheel_timer* t = list.pNext;
+					Unlink(*t);
+					Insert(*t);
+				}
+			}
+
+		private:
+			asio::io_context& m_asioContext;
+			asio::steady_timer m_timerTick;
+			std::chrono::milliseconds m_tTick;
+			std::chrono::steady_clock::time_point m_tStart;
+			uint64_t m_nNow = 0;
+			size_t m_nTimers = 0;
+			wheel_timer m_vSlots[nLevels][nSlots];
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "net_common.h"
+
+#include <fstream>
+#include <map>
+#include <tuple>
+
+namespace netmsg
+{
+	namespace net
+	{
+		// Stages of the pipeline a traced message goes through. The first four follow a message from a client into its handler, 
+		// the last three follow every message the handler sends while it runs, up to the moment it leaves the socket
+		enum class trace_stage : uint8_t
+		{
+			HeaderRead,
+			BodyRead,
+			Dequeued,
+			Handled,
+			SendQueued,
+			WriteStart,
+			WriteDone,
+		};
+
+		// One time stamp of one traced message, in nanoseconds of the steady clock
+		struct trace_event
+		{
+			uint64_t nTrace = 0;
+			uint64_t nTime = 0;
+			uint64_t nMessageId = 0;
+			uint32_t nClientID = 0;
+			trace_stage stage = trace_stage::HeaderRead;
+			// Number of the send on its connection for the stages of an outgoing message, 0 for the incoming ones. A handler 
+			// sending several messages to the same client gives as many chains under the same trace and client
+			uint64_t nSend = 0;
+		};
+
+		// Fixed size ring of trace events, written by any amount of threads without a lock: a writer claims a slot with a single 
+		// atomic increment and the oldest events are overwritten. Every slot carries a sequence number, odd while it is written, 
+		// so a reader copying the ring while it is written skips the slots that were torn or already overwritten. Two writers 
+		// can land on the same slot a whole ring apart, the sequence number is then taken with a compare and swap that only 
+		// moves it forward from an even value, and the writer that loses drops its event instead of writing over the other
+		class trace_ring
+		{
+		public:
+			// The capacity is rounded up to a power of two
+			trace_ring(size_t nCapacity)
+			{
+				size_t nSize = 1;
+				while (nSize < nCapacity)
+				{
+					nSize <<= 1;
+				}
+				m_vSlots = std::vector<slot>(nSize);
+				m_nMask = nSize - 1;
+			}
+
+			void Record(const trace_event& e)
+			{
+				uint64_t n = m_nHead.fetch_add(1, std::memory_order_relaxed);
+				slot& s = m_vSlots[n & m_nMask];
+				uint64_t nSeq = s.nSeq.load(std::memory_order_relaxed);
+				do
+				{
+					// Still written by an older writer, or already taken by a newer one
+					if ((nSeq & 1) || nSeq > 2 * n)
+					{
+						m_nSkipped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+				} while (!s.nSeq.compare_exchange_weak(nSeq, 2 * n + 1, std::memory_order_relaxed));
+				std::atomic_thread_fence(std::memory_order_release);
+				s.nTrace.store(e.nTrace, std::memory_order_relaxed);
+				s.nTime.store(e.nTime, std::memory_order_relaxed);
+				s.nMessageId.store(e.nMessageId, std::memory_order_relaxed);
+				s.nSend.store(e.nSend, std::memory_order_relaxed);
+				s.nInfo.store(uint64_t(e.nClientID) << 8 | uint64_t(e.stage), std::memory_order_relaxed);
+				s.nSeq.store(2 * n + 2, std::memory_order_release);
+			}
+
+			// Copies the events currently in the ring, oldest first
+			std::vector<trace_event> Snapshot() const
+			{
+				uint64_t nHead = m_nHead.load(std::memory_order_acquire);
+				uint64_t nFirst = nHead > m_vSlots.size() ? nHead - m_vSlots.size() : 0;
+
+				std::vector<trace_event> vEvents;
+				vEvents.reserve(size_t(nHead - nFirst));
+				for (uint64_t n = nFirst; n < nHead; n++)
+				{
+					const slot& s = m_vSlots[n & m_nMask];
+					if (s.nSeq.load(std::memory_order_acquire) != 2 * n + 2)
+					{
+						continue;
+					}
+					trace_event e;
+					e.nTrace = s.nTrace.load(std::memory_order_relaxed);
+					e.nTime = s.nTime.load(std::memory_order_relaxed);
+					e.nMessageId = s.nMessageId.load(std::memory_order_relaxed);
+					e.nSend = s.nSend.load(std::memory_order_relaxed);
+					uint64_t nInfo = s.nInfo.load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (s.nSeq.load(std::memory_order_relaxed) != 2 * n + 2)
+					{
+						continue;
+					}
+					e.nClientID = uint32_t(nInfo >> 8);
+					e.stage = trace_stage(nInfo & 0xFF);
+					vEvents.push_back(e);
+				}
+				return vEvents;
+			}
+
+			uint64_t Recorded() const
+			{
+				return m_nHead.load(std::memory_order_relaxed);
+			}
+
+			// Events dropped because their slot was still being written a whole ring earlier
+			uint64_t Skipped() const
+			{
+				return m_nSkipped.load(std::memory_order_relaxed);
+			}
+
+		private:
+			struct alignas(64) slot
+			{
+				std::atomic<uint64_t> nSeq{ 0 };
+				std::atomic<uint64_t> nTrace{ 0 };
+				std::atomic<uint64_t> nTime{ 0 };
+				std::atomic<uint64_t> nMessageId{ 0 };
+				std::atomic<uint64_t> nInfo{ 0 };
+				std::atomic<uint64_t> nSend{ 0 };
+			};
+
+			std::vector<slot> m_vSlots;
+			size_t m_nMask = 0;
+			std::atomic<uint64_t> m_nHead{ 0 };
+			std::atomic<uint64_t> m_nSkipped{ 0 };
+		};
+
+		// Samples one incoming message out of every n and records its way through the server. The trace of a message is 
+		// carried along with it: by the connection from the socket to the incoming queue, by Update into the handler, and by 
+		// the thread running the handler into every Send it makes, so the replies show up under the same trace
+		class message_tracer
+		{
+		public:
+			message_tracer(size_t nSampleEvery, size_t nCapacity) : m_nSampleEvery(std::max<size_t>(1, nSampleEvery)), m_ring(nCapacity)
+			{
+
+			}
+
+			static uint64_t Clock()
+			{
+				return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+			}
+
+			// Returns a new trace for one message out of every n, 0 for the others. Called for every message read, the counter 
+			// belongs to the connection so no two threads share it
+			uint64_t Sample(uint64_t& nCounter)
+			{
+				if (nCounter++ % m_nSampleEvery != 0)
+				{
+					return 0;
+				}
+				return m_nNextTrace.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			template <typename Id>
+			void Record(uint64_t nTrace, trace_stage stage, uint32_t nClientID, Id id, uint64_t nTime = Clock())
+			{
+				RecordSend(nTrace, stage, nClientID, id, 0, nTime);
+			}
+
+			// Same for the stages of an outgoing message, nSend tells the sends of a handler to one client apart
+			template <typename Id>
+			void RecordSend(uint64_t nTrace, trace_stage stage, uint32_t nClientID, Id id, uint64_t nSend, uint64_t nTime = Clock())
+			{
+				trace_event e;
+				e.nTrace = nTrace;
+				e.nTime = nTime;
+				e.nMessageId = uint64_t(id);
+				e.nClientID = nClientID;
+				e.stage = stage;
+				e.nSend = nSend;
+				m_ring.Record(e);
+			}
+
+			// Trace of the message whose handler runs on this thread, 0 outside of a traced handler
+			static uint64_t& Current()
+			{
+				thread_local uint64_t nTrace = 0;
+				return nTrace;
+			}
+
+			const trace_ring& Ring() const
+			{
+				return m_ring;
+			}
+
+			// Writes the ring in the Chrome trace event format, which chrome://tracing and Perfetto both open. Every client is 
+			// a track, and every stage of a traced message is a slice from the time stamp of the stage before it, so a slow 
+			// stage stands out by its length. The messages sent by a handler get their own slices, from Send to the socket
+			bool WriteChromeTrace(const std::string& sFile) const
+			{
+				std::ofstream file(sFile, std::ios::trunc);
+				if (!file)
+				{
+					return false;
+				}
+
+				// The events of a message are put together by trace, client and send, a broadcast is sent to many clients under 
+				// the same trace and a handler can send several messages to the same client
+				std::map<std::tuple<uint64_t, uint32_t, uint64_t>, std::vector<trace_event>> mapMessages;
+				uint64_t nOrigin = std::numeric_limits<uint64_t>::max();
+				for (const trace_event& e : m_ring.Snapshot())
+				{
+					mapMessages[{ e.nTrace, e.nClientID, e.nSend }].push_back(e);
+					nOrigin = std::min(nOrigin, e.nTime);
+				}
+
+				static const char* vSlices[] = { nullptr, "socket read", "incoming queue", "handler", nullptr, "outgoing queue", "socket write" };
+
+				file << "{\"traceEvents\":[\n";
+				bool bFirst = true;
+				for (auto& [key, vEvents] : mapMessages)
+				{
+					std::sort(vEvents.begin(), vEvents.end(), [](const trace_event& a, const trace_event& b) { return std::tie(a.stage, a.nTime) < std::tie(b.stage, b.nTime); });
+					for (size_t i = 1; i < vEvents.size(); i++)
+					{
+						const trace_event& a = vEvents[i - 1];
+						const trace_event& b = vEvents[i];
+						const char* sName = vSlices[size_t(b.stage)];
+						// Only consecutive stages make a slice, a handler that sent nothing ends the inbound chain
+						if (!sName || size_t(b.stage) != size_t(a.stage) + 1)
+						{
+							continue;
+						}
+						file << (bFirst ? "" : ",\n") << "{\"name\":\"" << sName << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << std::get<1>(key)
+							<< ",\"ts\":" << double(a.nTime - nOrigin) / 1000.0 << ",\"dur\":" << double(b.nTime - a.nTime) / 1000.0
+							<< ",\"args\":{\"trace\":" << std::get<0>(key) << ",\"id\":" << b.nMessageId << "}}";
+						bFirst = false;
+					}
+				}
+				file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+				return bool(file);
+			}
+
+		private:
+			size_t m_nSampleEvery;
+			std::atomic<uint64_t> m_nNextTrace{ 1 };
+			trace_ring m_ring;
+		};
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "net_common.h"
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace netmsg
+{
+	namespace net
+	{
+#if defined(SO_REUSEPORT)
+		// ASIO has no portable option for SO_REUSEPORT, it lets several acceptors listen on the same port and the kernel spreads 
+		// the incoming connections between them
+		using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+		// Options applied to every socket once it is connected, the default values leave the operating system defaults untouched. 
+		// The framework writes the header and the body of a message separately, so turning on TCP_NODELAY avoids waiting on the 
+		// Nagle algorithm for the second half of every message
+		struct socket_options
+		{
+			bool bNoDelay = false;
+			// Kernel send and receive buffer sizes in bytes, 0 keeps the system default
+			int nSendBufferSize = 0;
+			int nReceiveBufferSize = 0;
+			// Keep alive of the connection once it is validated, both driven by the timing wheel of the context. A heartbeat is 
+			// sent when nothing else was written for that long, and the connection is closed when nothing at all was read for the 
+			// idle timeout, which is how a dead peer is noticed without waiting for a failed write. 0 disables them, and both ends 
+			// should agree on the values as an idle timeout shorter than the heartbeat of the other side drops healthy peers
+			std::chrono::milliseconds tHeartbeat = std::chrono::milliseconds(0);
+			std::chrono::milliseconds tIdleTimeout = std::chrono::milliseconds(0);
+			// Interval of the round trip probes, which keep the RTT and the clock offset of the connection up to date. Only the 
+			// end that sets it sends probes, the other one answers them whatever its own options are
+			std::chrono::milliseconds tPing = std::chrono::milliseconds(0);
+			// Largest body accepted from the other end. The size of a body comes straight from the wire and the whole body is 
+			// allocated before it is read, a larger one is taken as a broken or hostile peer and the connection is dropped. 
+			// Messages over the limit are not sent either, both ends should agree on it. 0 removes the limit
+			uint32_t nMaxMessageSize = 16 * 1024 * 1024;
+			// Size of the pieces a stream is cut into, it is kept under the maximum message size
+			uint32_t nStreamChunkSize = 64 * 1024;
+
+			// Options are applied with the error code overloads, a platform refusing one of them should not drop the connection. 
+			// The buffer sizes apply to any stream socket of the operating system, Nagle only exists for TCP
+			template <typename Socket>
+			void Apply(Socket& socket) const
+			{
+				asio::error_code ec;
+				if constexpr (std::is_same_v<Socket, asio::ip::tcp::socket>)
+				{
+					if (bNoDelay)
+					{
+						socket.set_option(asio::ip::tcp::no_delay(true), ec);
+					}
+				}
+				if (nSendBufferSize > 0)
+				{
+					socket.set_option(asio::socket_base::send_buffer_size(nSendBufferSize), ec);
+				}
+				if (nReceiveBufferSize > 0)
+				{
+					socket.set_option(asio::socket_base::receive_buffer_size(nReceiveBufferSize), ec);
+				}
+			}
+		};
+
+		// A transport is the socket type a connection runs on, given to connection, server_interface and client_interface as 
+		// their second template parameter. It names the socket, the acceptor, what a client connects to (the endpoints) and 
+		// what a server listens on (the address), and it does the few things the framework cannot do the same way for every 
+		// kind of socket: listening, resolving, connecting and applying the socket options. Everything else (reading, writing,
+		// closing) goes through the ASIO stream functions, so any socket type ASIO can read and write fits in.
+		//
+		// TCP is the default, the connections of the framework reach other hosts through it and it is the only transport the 
+		// relay between server processes and the sharded server (SO_REUSEPORT) work with
+		struct tcp_transport
+		{
+			using socket = asio::ip::tcp::socket;
+			using acceptor = asio::ip::tcp::acceptor;
+			using endpoints = asio::ip::tcp::resolver::results_type;
+			// Port the server listens on, on every IPv4 interface
+			using address = uint16_t;
+
+			static const char* Name()
+			{
+				return "tcp";
+			}
+
+			static void Listen(acceptor& a, address nPort, bool bReusePort)
+			{
+				Listen(a, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), nPort), bReusePort);
+			}
+
+			// Same, on a single interface given by its address ("127.0.0.1", "::1", "10.0.0.5"...)
+			static void Listen(acceptor& a, const std::string& sBindAddress, address nPort, bool bReusePort)
+			{
+				Listen(a, asio::ip::tcp::endpoint(asio::ip::make_address(sBindAddress), nPort), bReusePort);
+			}
+
+			// The acceptor is opened step by step so the options can be set before it is bound to the port
+			static void Listen(acceptor& a, const asio::ip::tcp::endpoint& endpoint, bool bReusePort)
+			{
+				a.open(endpoint.protocol());
+				a.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+				if (bReusePort)
+				{
+#if defined(SO_REUSEPORT)
+					a.set_option(reuse_port(true));
+#else
+					throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+				}
+				a.bind(endpoint);
+				a.listen();
+			}
+
+			// The resolver can take an URL, an ip address or a host name
+			static endpoints Resolve(asio::io_context& context, const std::string& sHost, uint16_t nPort)
+			{
+				asio::ip::tcp::resolver resolver(context);
+				return resolver.resolve(sHost, std::to_string(nPort));
+			}
+
+			// Tries the endpoints one after the other until one of them accepts the connection
+			template <typename Handler>
+			static void AsyncConnect(socket& s, const endpoints& e, Handler&& handler)
+			{
+				asio::async_connect(s, e,
+					[handler = std::forward<Handler>(handler)](std::error_code ec, const asio::ip::tcp::endpoint&) mutable
+					{
+						handler(ec);
+					});
+			}
+
+			static void ApplyOptions(socket& s, const socket_options& options)
+			{
+				options.Apply(s);
+			}
+		};
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+		// Unix domain stream sockets, for the processes of one host (a gateway or bots next to the server). The data never 
+		// goes through the TCP stack, no checksums, no acknowledgements and no congestion control, and the server address is a 
+		// path in the file system. A client gives that path as the host of Connect, the port is not used
+		struct unix_transport
+		{
+			using protocol = asio::local::stream_protocol;
+			using socket = protocol::socket;
+			using acceptor = protocol::acceptor;
+			using endpoints = std::vector<protocol::endpoint>;
+			using address = std::string;
+
+			static const char* Name()
+			{
+				return "unix";
+			}
+
+			// The socket file of a previous run stays in the file system and would make the bind fail, it is removed first. 
+			// Only a socket is removed, a path pointing to anything else is left for bind to refuse
+			static void Listen(acceptor& a, const address& sPath, bool bReusePort)
+			{
+				if (bReusePort)
+				{
+					throw std::runtime_error("SO_REUSEPORT is only supported by the tcp transport");
+				}
+
+				struct stat st;
+				if (::stat(sPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+				{
+					::unlink(sPath.c_str());
+				}
+
+				protocol::endpoint endpoint(sPath);
+				a.open(endpoint.protocol());
+				a.bind(endpoint);
+				a.listen();
+			}
+
+			static endpoints Resolve(asio::io_context&, const std::string& sPath, uint16_t)
+			{
+				return { protocol::endpoint(sPath) };
+			}
+
+			template <typename Handler>
+			static void AsyncConnect(socket& s, const endpoints& e, Handler&& handler)
+			{
+				asio::async_connect(s, e,
+					[handler = std::forward<Handler>(handler)](std::error_code ec, const protocol::endpoint&) mutable
+					{
+						handler(ec);
+					});
+			}
+
+			static void ApplyOptions(socket& s, const socket_options& options)
+			{
+				options.Apply(s);
+			}
+		};
+#endif
+
+		// Declared here with their default transport, every other header refers to them through these declarations
+		template <typename T, typename Transport = tcp_transport>
+		class connection;
+
+		template <typename T, typename Transport = tcp_transport>
+		class server_interface;
+	}
+}
+
+/*
+	MMO Client/Server Framework using ASIO
+
+	Copyright 2018 - 2020 OneLoneCoder.com
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions
+	are met:
+	1. Redistributions or derivations of source code must retain the above
+	copyright notice, this list of conditions and the following disclaimer.
+	2. Redistributions or derivative works in binary form must reproduce
+	the above copyright notice. This list of conditions and the following
+	disclaimer must be reproduced in the documentation and/or other
+	materials provided with the distribution.
+	3. Neither the name of the copyright holder nor the names of its
+	contributors may be used to endorse or promote products derived
+	from this software without specific prior written permission.
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+	"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+	LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+	A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+	HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+	LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+	DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+	THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+	Author
+	~~~~~~
+	David Barr, aka javidx9, �OneLoneCoder 2019, 2020
+
+*/
@@ -33,8 +33,10 @@ namespace netmsg
 
 			void push_back(const T& item)
 			{
-				std::scoped_lock lock(muxQueue);
-				deqQueue.emplace_back(std::move(item));
+				{
+					std::scoped_lock lock(muxQueue);
+					deqQueue.emplace_back(std::move(item));
+				}
 
 				// The notify_one function will send a wake up signal for the server to process the incoming information, this is done 
 				// in both push front or push back tsqueue as this will contain the message information
@@ -44,8 +46,10 @@ namespace netmsg
 
 			void push_front(const T& item)
 			{
-				std::scoped_lock lock(muxQueue);
-				deqQueue.emplace_front(std::move(item));
+				{
+					std::scoped_lock lock(muxQueue);
+					deqQueue.emplace_front(std::move(item));
+				}
 
 				// The notify_one function will send a wake up signal for the server to process the incoming information, this is done in 
 				// both push front or push back tsqueue as this will contain the message information
@@ -79,6 +83,17 @@ namespace netmsg
 				return t;
 			}
 
+			// Moves up to nMax items from the front to the back of vOut under a single lock and returns how many were moved, for a
+			// consumer that takes everything queued at once instead of locking once per item
+			size_t pop_front(std::vector<T>& vOut, size_t nMax)
+			{
+				std::scoped_lock lock(muxQueue);
+				size_t nCount = std::min(nMax, deqQueue.size());
+				std::move(deqQueue.begin(), deqQueue.begin() + nCount, std::back_inserter(vOut));
+				deqQueue.erase(deqQueue.begin(), deqQueue.begin() + nCount);
+				return nCount;
+			}
+
 			T pop_back()
 			{
 				std::scoped_lock lock(muxQueue);
@@ -92,9 +107,11 @@ namespace netmsg
 			// to happen, but this code is designed so if that would happen. then it would just simply turn back into this loop
 			void wait()
 			{
+				// The blocking mutex is held while the queue is checked, a push will only be able to notify once this thread is 
+				// already sleeping on the condition variable, so the wake up signal can not be lost in between the check and the wait
+				std::unique_lock<std::mutex> ul(muxBlocking);
 				while (empty())
 				{
-					std::unique_lock<std::mutex> ul(muxBlocking);
 					// Sends the thread to sleep until a signal is received
 					cvBlocking.wait(ul);
 				}
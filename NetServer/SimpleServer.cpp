@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <cstdlib>
 #include <msg_net.h>
 
 // definition of my custom message types
@@ -15,11 +16,40 @@ enum class CustomMsgTypes : uint32_t
 // definition of custom server class which inherits from our custom server interface specialized on the previous custom message types
 class CustomServer : public netmsg::net::server_interface<CustomMsgTypes>
 {
+	using Router = netmsg::net::message_router<CustomMsgTypes>;
+
 public:
-	// the constructor of this class takes in a port number and constructs the server interface 
-	CustomServer(uint16_t nPort) : netmsg::net::server_interface<CustomMsgTypes>(nPort)
+	// the constructor of this class takes in a port number and constructs the server interface, then registers the handler of 
+	// every message the clients send, each one receives the payload of its message already decoded
+	CustomServer(uint16_t nPort, const netmsg::net::server_options& options) : netmsg::net::server_interface<CustomMsgTypes>(nPort, options)
 	{
+		// the ping carries the time the client sent it, the server only sends it back
+		m_router.On<CustomMsgTypes::ServerPing, std::chrono::steady_clock::time_point>(
+			[](auto& client, const std::chrono::steady_clock::time_point& timeSent)
+			{
+				NETMSG_LOG_INFO("[" << client->GetID() << "] Server Ping");
+				client->Send(Router::Encode<CustomMsgTypes::ServerPing>(timeSent));
+			});
+
+		m_router.On<CustomMsgTypes::MessageAll>(
+			[this](auto& client)
+			{
+				// message all trigger confirmation
+				NETMSG_LOG_INFO("[" << client->GetID() << "]: Message All");
+
+				// parameter on this function is designed so it ignores the client which sent the message, avoids message duplication. 
+				// when the server is linked to other server processes the message reaches their clients too
+				MessageWorld(Router::Encode<CustomMsgTypes::ServerMessage>(client->GetID()), client);
+			});
+	}
 
+	// a MessageAll request makes the server write to every other client, so a single client spamming it would multiply its 
+	// traffic by the amount of clients, it is limited to a few per second and anything above that is dropped
+	static netmsg::net::server_options ServerOptions()
+	{
+		netmsg::net::server_options options;
+		options.inbound.SetMessageLimit(CustomMsgTypes::MessageAll, { 5.0, 10.0, netmsg::net::limit_action::Drop });
+		return options;
 	}
 
 protected:
@@ -34,33 +64,7 @@ protected:
 
 	void OnClientDisconnect(std::shared_ptr<netmsg::net::connection<CustomMsgTypes>> client)
 	{
-		std::cout << "Removing client [" << client->GetID() << "]\n";
-	}
-
-	// checks for client messages, based on Custom types added to the message id, the client display will show specific procedures and this function wil confirm the server interaction with the client by sending back a message and printing the procedure name in the server console
-	void OnMessage(std::shared_ptr<netmsg::net::connection<CustomMsgTypes>> client, netmsg::net::message<CustomMsgTypes>& msg)
-	{
-		switch (msg.header.id)
-		{
-		case CustomMsgTypes::ServerPing:
-		{
-			std::cout << "[" << client->GetID() << "] Server Ping\n";
-			client->Send(msg);
-		}
-		break;
-		case CustomMsgTypes::MessageAll:
-		{
-			// message all trigger confirmation
-			std::cout << "[" << client->GetID() << "]: Message All\n";
-
-			netmsg::net::message<CustomMsgTypes> msg;
-			msg.header.id = CustomMsgTypes::ServerMessage;
-			msg << client->GetID();
-			// parameter on this function is designed so it ignores the client which sent the message, avoids message duplication
-			MessageAllClients(msg, client);
-		}
-		break;
-		}
+		NETMSG_LOG_INFO("Removing client [" << client->GetID() << "]");
 	}
 
 	void OnClientValidated(std::shared_ptr<netmsg::net::connection<CustomMsgTypes>> client) override
@@ -73,10 +77,28 @@ protected:
 	}
 };
 
-int main()
+// usage: SimpleServer [port] [relay port] [relay node] [relay ports of the other servers...]
+// several servers on the same machine act as one world when they are started with their own ports and relay nodes, and the
+// secret of the world in NETMSG_RELAY_SECRET, e.g. 
+//   NETMSG_RELAY_SECRET=... SimpleServer 60000 61000 1
+//   NETMSG_RELAY_SECRET=... SimpleServer 60001 61001 2 61000
+int main(int argc, char* argv[])
 {
-	CustomServer server(60000);
+	netmsg::net::server_options options = CustomServer::ServerOptions();
+	uint16_t nPort = argc > 1 ? uint16_t(std::stoul(argv[1])) : 60000;
+	options.nRelayPort = argc > 2 ? uint16_t(std::stoul(argv[2])) : 0;
+	options.nRelayNode = argc > 3 ? uint32_t(std::stoul(argv[3])) : 0;
+	if (const char* sSecret = std::getenv("NETMSG_RELAY_SECRET"))
+	{
+		options.sRelaySecret = sSecret;
+	}
+
+	CustomServer server(nPort, options);
 	server.Start();
+	for (int i = 4; i < argc; i++)
+	{
+		server.AddPeer("127.0.0.1", uint16_t(std::stoul(argv[i])));
+	}
 
 	while (1)
 	{